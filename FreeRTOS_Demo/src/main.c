@@ -144,7 +144,7 @@ void ReceiveTask( void *pvParameters )
 int main(void)
 {
 
-	// This does not do anything on our virtual environment
+	// Switch the clock tree to the PLL: 160MHz core, 80MHz and 40MHz AIPS
     Clock_Ip_Init(Clock_Ip_aClockConfig);
 
     Siul2_Port_Ip_Init(NUM_OF_CONFIGURED_PINS0, g_pin_mux_InitConfigArr0);
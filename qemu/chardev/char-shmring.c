@@ -0,0 +1,425 @@
+/*
+ * QEMU shared-memory ring buffer chardev
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu/osdep.h"
+#include "chardev/char.h"
+#include "io/channel-file.h"
+#include "io/channel-socket.h"
+#include "io/net-listener.h"
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/error-report.h"
+#include "qemu/event_notifier.h"
+#include "qemu/main-loop.h"
+#include "qemu/memfd.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qom/object.h"
+
+/*
+ * Shared-memory ring buffer chardev
+ *
+ * The backend allocates a sealed memfd holding one header page followed
+ * by two single-producer/single-consumer byte rings of @size bytes each:
+ *
+ *   q[SHMRING_OUT]: written by QEMU (guest transmit), read by the client
+ *   q[SHMRING_IN]:  written by the client, read by QEMU (guest receive)
+ *
+ * The free-running 32-bit @prod and @cons indices are only ever written
+ * by their owner, with release semantics after the payload is stored (or
+ * consumed); the byte at index i lives at offset[dir] + (i & (size - 1)).
+ * Producer and consumer fields sit in separate cache lines so that the
+ * two sides never bounce a line they both write.
+ *
+ * Data moves without system calls.  A side that runs out of work sets
+ * its @wait flag, issues a full barrier and re-checks the ring before
+ * going to sleep; the other side signals an eventfd if it sees the flag
+ * set, clearing the flag first.
+ *
+ * QEMU never polls, so the client must signal it as soon as it sees a
+ * flag of QEMU set.  @watermark only applies to the wakeups QEMU sends:
+ * a sleeping client is signalled once at least @watermark bytes of data
+ * (in the OUT ring) or of free space (in the IN ring) are available.  A
+ * client that asks for a watermark above one must therefore poll with a
+ * timeout to pick up short tails.
+ *
+ * Clients connect to the unix socket at @path and receive, in a single
+ * message, the header magic plus three descriptors via SCM_RIGHTS: the
+ * memfd, an eventfd that QEMU signals, and an eventfd that QEMU waits on.
+ */
+
+#define SHMRING_MAGIC       0x474e5253 /* "SRNG" */
+#define SHMRING_VERSION     1
+#define SHMRING_HDR_SIZE    4096
+#define SHMRING_CACHELINE   64
+
+enum {
+    SHMRING_OUT,
+    SHMRING_IN,
+    SHMRING_NR_QUEUES,
+};
+
+typedef struct ShmringQueue {
+    uint32_t prod QEMU_ALIGNED(SHMRING_CACHELINE);
+    uint32_t prod_wait;
+    uint32_t cons QEMU_ALIGNED(SHMRING_CACHELINE);
+    uint32_t cons_wait;
+} ShmringQueue;
+
+typedef struct ShmringHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t watermark;
+    uint64_t offset[SHMRING_NR_QUEUES];
+    ShmringQueue q[SHMRING_NR_QUEUES];
+} ShmringHeader;
+
+QEMU_BUILD_BUG_ON(sizeof(ShmringHeader) > SHMRING_HDR_SIZE);
+
+struct ShmringChardev {
+    Chardev parent;
+    uint32_t size;
+    uint32_t watermark;
+    size_t map_size;
+    int memfd;
+    ShmringHeader *hdr;
+    uint8_t *data[SHMRING_NR_QUEUES];
+    /* QEMU -> client and client -> QEMU wakeups */
+    EventNotifier host_notify;
+    EventNotifier guest_notify;
+    /* Set when space frees up in the OUT ring, backs chr_add_watch */
+    EventNotifier space_notify;
+    QIOChannel *space_ioc;
+    QIONetListener *listener;
+    char *path;
+};
+typedef struct ShmringChardev ShmringChardev;
+
+DECLARE_INSTANCE_CHECKER(ShmringChardev, SHMRING_CHARDEV,
+                         TYPE_CHARDEV_SHMRING)
+
+static uint32_t shmring_fill(ShmringQueue *q)
+{
+    return qatomic_load_acquire(&q->prod) - qatomic_load_acquire(&q->cons);
+}
+
+static void shmring_kick(ShmringChardev *d, uint32_t *wait, uint32_t avail)
+{
+    if (avail < d->watermark || !qatomic_read(wait)) {
+        return;
+    }
+    qatomic_set(wait, 0);
+    event_notifier_set(&d->host_notify);
+}
+
+static int shmring_chr_write(Chardev *chr, const uint8_t *buf, int len)
+{
+    ShmringChardev *d = SHMRING_CHARDEV(chr);
+    ShmringQueue *q = &d->hdr->q[SHMRING_OUT];
+    uint32_t prod = q->prod;
+    uint32_t mask = d->size - 1;
+    uint32_t n, chunk;
+
+    if (!buf || len < 0) {
+        return -1;
+    }
+
+    event_notifier_test_and_clear(&d->space_notify);
+    n = MIN((uint32_t)len, d->size - shmring_fill(q));
+    chunk = MIN(n, d->size - (prod & mask));
+    memcpy(d->data[SHMRING_OUT] + (prod & mask), buf, chunk);
+    memcpy(d->data[SHMRING_OUT], buf + chunk, n - chunk);
+    qatomic_store_release(&q->prod, prod + n);
+
+    /*
+     * Pairs with the consumer's barrier between setting cons_wait and
+     * re-reading prod.
+     */
+    smp_mb();
+    shmring_kick(d, &q->cons_wait, shmring_fill(q));
+
+    if (n < len) {
+        /* Ask the client to tell us when it has made room */
+        qatomic_set(&q->prod_wait, 1);
+        smp_mb();
+        if (shmring_fill(q) < d->size) {
+            qatomic_set(&q->prod_wait, 0);
+            event_notifier_set(&d->space_notify);
+        }
+    }
+    return n;
+}
+
+static void shmring_pump_in(ShmringChardev *d)
+{
+    Chardev *chr = CHARDEV(d);
+    ShmringQueue *q = &d->hdr->q[SHMRING_IN];
+    uint32_t mask = d->size - 1;
+
+    for (;;) {
+        uint32_t cons = q->cons;
+        uint32_t avail = shmring_fill(q);
+        int room = qemu_chr_be_can_write(chr);
+        uint32_t n, chunk;
+
+        if (!room) {
+            /* chr_accept_input will resume once the frontend drains */
+            break;
+        }
+        if (!avail) {
+            qatomic_set(&q->cons_wait, 1);
+            smp_mb();
+            if (!shmring_fill(q)) {
+                break;
+            }
+            qatomic_set(&q->cons_wait, 0);
+            continue;
+        }
+
+        n = MIN(avail, (uint32_t)room);
+        chunk = MIN(n, d->size - (cons & mask));
+        qemu_chr_be_write(chr, d->data[SHMRING_IN] + (cons & mask), chunk);
+        if (n > chunk) {
+            qemu_chr_be_write(chr, d->data[SHMRING_IN], n - chunk);
+        }
+        qatomic_store_release(&q->cons, cons + n);
+
+        smp_mb();
+        shmring_kick(d, &q->prod_wait, d->size - shmring_fill(q));
+    }
+}
+
+static void shmring_guest_notify(void *opaque)
+{
+    ShmringChardev *d = opaque;
+    ShmringQueue *q = &d->hdr->q[SHMRING_OUT];
+
+    event_notifier_test_and_clear(&d->guest_notify);
+    shmring_pump_in(d);
+
+    if (qatomic_read(&q->prod_wait) && shmring_fill(q) < d->size) {
+        qatomic_set(&q->prod_wait, 0);
+        event_notifier_set(&d->space_notify);
+    }
+}
+
+static void shmring_chr_accept_input(Chardev *chr)
+{
+    shmring_pump_in(SHMRING_CHARDEV(chr));
+}
+
+static GSource *shmring_chr_add_watch(Chardev *chr, GIOCondition cond)
+{
+    ShmringChardev *d = SHMRING_CHARDEV(chr);
+
+    /* The ring never hangs up; writability is signalled on space_notify */
+    return qio_channel_create_watch(d->space_ioc, G_IO_IN);
+}
+
+static void shmring_accept(QIONetListener *listener,
+                           QIOChannelSocket *cioc,
+                           gpointer opaque)
+{
+    ShmringChardev *d = opaque;
+    uint32_t magic = cpu_to_le32(SHMRING_MAGIC);
+    struct iovec iov = { .iov_base = &magic, .iov_len = sizeof(magic) };
+    int fds[] = {
+        d->memfd,
+        event_notifier_get_fd(&d->host_notify),
+        event_notifier_get_wfd(&d->guest_notify),
+    };
+    Error *err = NULL;
+
+    if (qio_channel_writev_full(QIO_CHANNEL(cioc), &iov, 1,
+                                fds, ARRAY_SIZE(fds), 0, &err) < 0) {
+        error_report_err(err);
+    }
+    qio_channel_close(QIO_CHANNEL(cioc), NULL);
+}
+
+static void char_shmring_finalize(Object *obj)
+{
+    ShmringChardev *d = SHMRING_CHARDEV(obj);
+
+    if (d->listener) {
+        qio_net_listener_set_client_func(d->listener, NULL, NULL, NULL);
+        qio_net_listener_disconnect(d->listener);
+        object_unref(OBJECT(d->listener));
+        unlink(d->path);
+    }
+    if (d->space_ioc) {
+        object_unref(OBJECT(d->space_ioc));
+    }
+    if (d->hdr) {
+        qemu_set_fd_handler(event_notifier_get_fd(&d->guest_notify),
+                            NULL, NULL, NULL);
+        event_notifier_cleanup(&d->host_notify);
+        event_notifier_cleanup(&d->guest_notify);
+        event_notifier_cleanup(&d->space_notify);
+        qemu_memfd_free(d->hdr, d->map_size, d->memfd);
+    }
+    g_free(d->path);
+}
+
+static void qemu_chr_open_shmring(Chardev *chr,
+                                  ChardevBackend *backend,
+                                  bool *be_opened,
+                                  Error **errp)
+{
+    ChardevShmring *opts = backend->u.shmring.data;
+    ShmringChardev *d = SHMRING_CHARDEV(chr);
+    SocketAddress addr = { .type = SOCKET_ADDRESS_TYPE_UNIX };
+    int64_t size = opts->has_size ? opts->size : 65536;
+    int64_t watermark = opts->has_watermark ? opts->watermark : 1;
+    ShmringHeader *hdr;
+    int i, ret;
+
+    /* The size must be power of 2, and fit the 32-bit ring indices */
+    if (size <= 0 || (size & (size - 1)) || size > (1U << 30)) {
+        error_setg(errp, "size of shmring chardev must be power of two");
+        return;
+    }
+    if (watermark <= 0 || watermark > size) {
+        error_setg(errp, "watermark of shmring chardev must be between 1 "
+                   "and its size");
+        return;
+    }
+    d->size = size;
+    d->watermark = watermark;
+
+    d->map_size = SHMRING_HDR_SIZE + SHMRING_NR_QUEUES * (size_t)d->size;
+    hdr = qemu_memfd_alloc("qemu-shmring", d->map_size,
+                           F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL,
+                           &d->memfd, errp);
+    if (!hdr) {
+        return;
+    }
+    ret = event_notifier_init(&d->host_notify, 0);
+    if (ret < 0) {
+        goto err_memfd;
+    }
+    ret = event_notifier_init(&d->guest_notify, 0);
+    if (ret < 0) {
+        goto err_host_notify;
+    }
+    ret = event_notifier_init(&d->space_notify, 0);
+    if (ret < 0) {
+        goto err_guest_notify;
+    }
+    d->hdr = hdr;
+
+    hdr->magic = SHMRING_MAGIC;
+    hdr->version = SHMRING_VERSION;
+    hdr->size = d->size;
+    hdr->watermark = d->watermark;
+    for (i = 0; i < SHMRING_NR_QUEUES; i++) {
+        hdr->offset[i] = SHMRING_HDR_SIZE + i * (uint64_t)d->size;
+        d->data[i] = (uint8_t *)hdr + hdr->offset[i];
+    }
+
+    d->space_ioc = QIO_CHANNEL(qio_channel_file_new_dupfd(
+                       event_notifier_get_fd(&d->space_notify), errp));
+    if (!d->space_ioc) {
+        return;
+    }
+    qemu_set_fd_handler(event_notifier_get_fd(&d->guest_notify),
+                        shmring_guest_notify, NULL, d);
+
+    d->path = g_strdup(opts->path);
+    addr.u.q_unix.path = d->path;
+    d->listener = qio_net_listener_new();
+    qio_net_listener_set_name(d->listener, "chardev-shmring-listener");
+    if (qio_net_listener_open_sync(d->listener, &addr, 1, errp) < 0) {
+        object_unref(OBJECT(d->listener));
+        d->listener = NULL;
+        return;
+    }
+    qio_net_listener_set_client_func(d->listener, shmring_accept, d, NULL);
+
+    /* QEMU is ready to consume input as soon as the client produces it */
+    qatomic_set(&hdr->q[SHMRING_IN].cons_wait, 1);
+    return;
+
+err_guest_notify:
+    event_notifier_cleanup(&d->guest_notify);
+err_host_notify:
+    event_notifier_cleanup(&d->host_notify);
+err_memfd:
+    error_setg_errno(errp, -ret, "failed to create shmring eventfds");
+    qemu_memfd_free(hdr, d->map_size, d->memfd);
+}
+
+static void qemu_chr_parse_shmring(QemuOpts *opts, ChardevBackend *backend,
+                                   Error **errp)
+{
+    const char *path = qemu_opt_get(opts, "path");
+    uint64_t val;
+    ChardevShmring *shmring;
+
+    if (path == NULL) {
+        error_setg(errp, "chardev: shmring: no unix socket path given");
+        return;
+    }
+
+    backend->type = CHARDEV_BACKEND_KIND_SHMRING;
+    shmring = backend->u.shmring.data = g_new0(ChardevShmring, 1);
+    qemu_chr_parse_common(opts, qapi_ChardevShmring_base(shmring));
+    shmring->path = g_strdup(path);
+
+    val = qemu_opt_get_size(opts, "size", 0);
+    if (val != 0) {
+        shmring->has_size = true;
+        shmring->size = val;
+    }
+    val = qemu_opt_get_size(opts, "watermark", 0);
+    if (val != 0) {
+        shmring->has_watermark = true;
+        shmring->watermark = val;
+    }
+}
+
+static void char_shmring_class_init(ObjectClass *oc, void *data)
+{
+    ChardevClass *cc = CHARDEV_CLASS(oc);
+
+    cc->parse = qemu_chr_parse_shmring;
+    cc->open = qemu_chr_open_shmring;
+    cc->chr_write = shmring_chr_write;
+    cc->chr_add_watch = shmring_chr_add_watch;
+    cc->chr_accept_input = shmring_chr_accept_input;
+}
+
+static const TypeInfo char_shmring_type_info = {
+    .name = TYPE_CHARDEV_SHMRING,
+    .parent = TYPE_CHARDEV,
+    .class_init = char_shmring_class_init,
+    .instance_size = sizeof(ShmringChardev),
+    .instance_finalize = char_shmring_finalize,
+};
+
+static void register_types(void)
+{
+    type_register_static(&char_shmring_type_info);
+}
+
+type_init(register_types);
@@ -35,307 +35,154 @@
 #include "hw/arm/nxps32k358_soc.h"
 #include "hw/char/nxps32k358_lpuart.h"
 #include "hw/dma/nxps32k358_edma.h"
+#include "hw/dma/nxps32k358_dmamux.h"
+#include "hw/block/nxps32k358_fmu.h"
 #include "hw/qdev-properties.h"
 #include "hw/qdev-clock.h"
-#include "hw/misc/unimp.h"
+#include "hw/misc/nxps32k358_fabric.h"
 #include "sysemu/sysemu.h"
 
 /**
- * @brief Creates unimplemented devices for each device listed in the
- * documentation.
+ * @brief Read the MSCM processor identification registers, as seen by a core.
  *
- * We don't care if we actually implement the devices later on
- * since unimplemented devices have the lowest priority in QEMU
- */
-static void create_unimplemented_devices(void) {
-    create_unimplemented_device("hse_xbic", 0x40008000, 0x4000);
-    create_unimplemented_device("erm1", 0x4000c000, 0x4000);
-    create_unimplemented_device("pfc1", 0x40068000, 0x4000);
-    create_unimplemented_device("pfc1_alt", 0x4006c000, 0x4000);
-    create_unimplemented_device("swt_3", 0x40070000, 0x4000);
-    create_unimplemented_device("trgmux", 0x40080000, 0x4000);
-    create_unimplemented_device("bctu", 0x40084000, 0x4000);
-    create_unimplemented_device("emios0", 0x40088000, 0x4000);
-    create_unimplemented_device("emios1", 0x4008c000, 0x4000);
-    create_unimplemented_device("emios2", 0x40090000, 0x4000);
-    create_unimplemented_device("lcu0", 0x40098000, 0x4000);
-    create_unimplemented_device("lcu1", 0x4009c000, 0x4000);
-    create_unimplemented_device("adc_0", 0x400a0000, 0x4000);
-    create_unimplemented_device("adc_1", 0x400a4000, 0x4000);
-    create_unimplemented_device("adc_2", 0x400a8000, 0x4000);
-    create_unimplemented_device("pit0", 0x400b0000, 0x4000);
-    create_unimplemented_device("pit1", 0x400b4000, 0x4000);
-    create_unimplemented_device("mu_2", 0x400b8000, 0x4000);
-    create_unimplemented_device("mu_2", 0x400bc000, 0x4000);
-    create_unimplemented_device("mu_3", 0x400c4000, 0x4000);
-    create_unimplemented_device("mu_3", 0x400c8000, 0x4000);
-    create_unimplemented_device("mu_4", 0x400cc000, 0x4000);
-    create_unimplemented_device("mu_4", 0x400d0000, 0x4000);
-    create_unimplemented_device("axbs", 0x40200000, 0x4000);
-    create_unimplemented_device("system_xbic", 0x40204000, 0x4000);
-    create_unimplemented_device("periph_xbic", 0x40208000, 0x4000);
-    create_unimplemented_device("edma", 0x4020c000, 0x4000);
-    create_unimplemented_device("edma_tcd_0", 0x40210000, 0x4000);
-    create_unimplemented_device("edma_tcd_1", 0x40214000, 0x4000);
-    create_unimplemented_device("edma_tcd_2", 0x40218000, 0x4000);
-    create_unimplemented_device("edma_tcd_3", 0x4021c000, 0x4000);
-    create_unimplemented_device("edma_tcd_4", 0x40220000, 0x4000);
-    create_unimplemented_device("edma_tcd_5", 0x40224000, 0x4000);
-    create_unimplemented_device("edma_tcd_6", 0x40228000, 0x4000);
-    create_unimplemented_device("edma_tcd_7", 0x4022c000, 0x4000);
-    create_unimplemented_device("edma_tcd_8", 0x40230000, 0x4000);
-    create_unimplemented_device("edma_tcd_9", 0x40234000, 0x4000);
-    create_unimplemented_device("edma_tcd_10", 0x40238000, 0x4000);
-    create_unimplemented_device("edma_tcd_11", 0x4023c000, 0x4000);
-    create_unimplemented_device("debug_apb_page0", 0x40240000, 0x4000);
-    create_unimplemented_device("debug_apb_page1", 0x40244000, 0x4000);
-    create_unimplemented_device("debug_apb_page2", 0x40248000, 0x4000);
-    create_unimplemented_device("debug_apb_page3", 0x4024c000, 0x4000);
-    create_unimplemented_device("debug_apb_paged_area", 0x40250000, 0x4000);
-    create_unimplemented_device("sda-ap", 0x40254000, 0x4000);
-    create_unimplemented_device("eim0", 0x40258000, 0x4000);
-    create_unimplemented_device("erm0", 0x4025c000, 0x4000);
-    create_unimplemented_device("mscm", 0x40260000, 0x4000);
-    create_unimplemented_device("pram_0", 0x40264000, 0x4000);
-    create_unimplemented_device("pfc", 0x40268000, 0x4000);
-    create_unimplemented_device("pfc_alt", 0x4026c000, 0x4000);
-    create_unimplemented_device("swt_0", 0x40270000, 0x4000);
-    create_unimplemented_device("stm_0", 0x40274000, 0x4000);
-    create_unimplemented_device("xrdc", 0x40278000, 0x4000);
-    create_unimplemented_device("intm", 0x4027c000, 0x4000);
-    create_unimplemented_device("dmamux_0", 0x40280000, 0x4000);
-    create_unimplemented_device("dmamux_1", 0x40284000, 0x4000);
-    create_unimplemented_device("rtc", 0x40288000, 0x4000);
-    create_unimplemented_device("mc_rgm", 0x4028c000, 0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac0_hse", 0x40290000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac0_hse", 0x40294000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac1_m7_0", 0x40298000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac1_m7_0", 0x4029c000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac2_m7_1", 0x402a0000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac2_m7_1", 0x402a4000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac3", 0x402a8000, 0x4000);
-    create_unimplemented_device("dcm", 0x402ac000, 0x4000);
-    create_unimplemented_device("wkpu", 0x402b4000, 0x4000);
-    create_unimplemented_device("cmu", 0x402bc000, 0x4000);
-    create_unimplemented_device("tspc", 0x402c4000, 0x4000);
-    create_unimplemented_device("sirc", 0x402c8000, 0x4000);
-    create_unimplemented_device("sxosc", 0x402cc000, 0x4000);
-    create_unimplemented_device("firc", 0x402d0000, 0x4000);
-    create_unimplemented_device("fxosc", 0x402d4000, 0x4000);
-    create_unimplemented_device("mc_cgm", 0x402d8000, 0x4000);
-    create_unimplemented_device("mc_me", 0x402dc000, 0x4000);
-    create_unimplemented_device("pll", 0x402e0000, 0x4000);
-    create_unimplemented_device("pll2", 0x402e4000, 0x4000);
-    create_unimplemented_device("pmc", 0x402e8000, 0x4000);
-    create_unimplemented_device("fmu", 0x402ec000, 0x4000);
-    create_unimplemented_device("fmu_alt", 0x402f0000, 0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac4_m7_2", 0x402f4000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac4_m7_2", 0x402f8000,
-                                0x4000);
-    create_unimplemented_device("pit2", 0x402fc000, 0x4000);
-    create_unimplemented_device("pit3", 0x40300000, 0x4000);
-    create_unimplemented_device("flexcan_0", 0x40304000, 0x4000);
-    create_unimplemented_device("flexcan_1", 0x40308000, 0x4000);
-    create_unimplemented_device("flexcan_2", 0x4030c000, 0x4000);
-    create_unimplemented_device("flexcan_3", 0x40310000, 0x4000);
-    create_unimplemented_device("flexcan_4", 0x40314000, 0x4000);
-    create_unimplemented_device("flexcan_5", 0x40318000, 0x4000);
-    create_unimplemented_device("flexcan_6", 0x4031c000, 0x4000);
-    create_unimplemented_device("flexcan_7", 0x40320000, 0x4000);
-    create_unimplemented_device("flexio", 0x40324000, 0x4000);
-    create_unimplemented_device("lpuart_0", 0x40328000, 0x4000);
-    create_unimplemented_device("lpuart_1", 0x4032c000, 0x4000);
-    create_unimplemented_device("lpuart_2", 0x40330000, 0x4000);
-    create_unimplemented_device("lpuart_3", 0x40334000, 0x4000);
-    create_unimplemented_device("lpuart_4", 0x40338000, 0x4000);
-    create_unimplemented_device("lpuart_5", 0x4033c000, 0x4000);
-    create_unimplemented_device("lpuart_6", 0x40340000, 0x4000);
-    create_unimplemented_device("lpuart_7", 0x40344000, 0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac5_m7_3", 0x40348000,
-                                0x4000);
-    create_unimplemented_device("siul_virtwrapper_pdac5_m7_3", 0x4034c000,
-                                0x4000);
-    create_unimplemented_device("lpi2c_0", 0x40350000, 0x4000);
-    create_unimplemented_device("lpi2c_1", 0x40354000, 0x4000);
-    create_unimplemented_device("lpspi_0", 0x40358000, 0x4000);
-    create_unimplemented_device("lpspi_1", 0x4035c000, 0x4000);
-    create_unimplemented_device("lpspi_2", 0x40360000, 0x4000);
-    create_unimplemented_device("lpspi_3", 0x40364000, 0x4000);
-    create_unimplemented_device("sai0", 0x4036c000, 0x4000);
-    create_unimplemented_device("lpcmp_0", 0x40370000, 0x4000);
-    create_unimplemented_device("lpcmp_1", 0x40374000, 0x4000);
-    create_unimplemented_device("tmu", 0x4037c000, 0x4000);
-    create_unimplemented_device("crc", 0x40380000, 0x4000);
-    create_unimplemented_device("fccu_", 0x40384000, 0x4000);
-    create_unimplemented_device("mu_0", 0x4038c000, 0x4000);
-    create_unimplemented_device("mu_1", 0x40390000, 0x4000);
-    create_unimplemented_device("jdc", 0x40394000, 0x4000);
-    create_unimplemented_device("configuration_gpr", 0x4039c000, 0x4000);
-    create_unimplemented_device("stcu", 0x403a0000, 0x4000);
-    create_unimplemented_device("selftest_gpr", 0x403b0000, 0x4000);
-    create_unimplemented_device("aes_accel", 0x403c0000, 0x10000);
-    create_unimplemented_device("aes_app0", 0x403d0000, 0x10000);
-    create_unimplemented_device("aes_app1", 0x403e0000, 0x10000);
-    create_unimplemented_device("aes_app2", 0x403f0000, 0x10000);
-    create_unimplemented_device("tcm_xbic", 0x40400000, 0x4000);
-    create_unimplemented_device("edma_xbic", 0x40404000, 0x4000);
-    create_unimplemented_device("pram2_tcm_xbic", 0x40408000, 0x4000);
-    create_unimplemented_device("aes_mux_xbic", 0x4040c000, 0x4000);
-    create_unimplemented_device("edma_tcd_12", 0x40410000, 0x4000);
-    create_unimplemented_device("edma_tcd_13", 0x40414000, 0x4000);
-    create_unimplemented_device("edma_tcd_14", 0x40418000, 0x4000);
-    create_unimplemented_device("edma_tcd_15", 0x4041c000, 0x4000);
-    create_unimplemented_device("edma_tcd_16", 0x40420000, 0x4000);
-    create_unimplemented_device("edma_tcd_17", 0x40424000, 0x4000);
-    create_unimplemented_device("edma_tcd_18", 0x40428000, 0x4000);
-    create_unimplemented_device("edma_tcd_19", 0x4042c000, 0x4000);
-    create_unimplemented_device("edma_tcd_20", 0x40430000, 0x4000);
-    create_unimplemented_device("edma_tcd_21", 0x40434000, 0x4000);
-    create_unimplemented_device("edma_tcd_22", 0x40438000, 0x4000);
-    create_unimplemented_device("edma_tcd_23", 0x4043c000, 0x4000);
-    create_unimplemented_device("edma_tcd_24", 0x40440000, 0x4000);
-    create_unimplemented_device("edma_tcd_25", 0x40444000, 0x4000);
-    create_unimplemented_device("edma_tcd_26", 0x40448000, 0x4000);
-    create_unimplemented_device("edma_tcd_27", 0x4044c000, 0x4000);
-    create_unimplemented_device("edma_tcd_28", 0x40450000, 0x4000);
-    create_unimplemented_device("edma_tcd_29", 0x40454000, 0x4000);
-    create_unimplemented_device("edma_tcd_30", 0x40458000, 0x4000);
-    create_unimplemented_device("edma_tcd_31", 0x4045c000, 0x4000);
-    create_unimplemented_device("sema42", 0x40460000, 0x4000);
-    create_unimplemented_device("pram_1", 0x40464000, 0x4000);
-    create_unimplemented_device("pram_2", 0x40468000, 0x4000);
-    create_unimplemented_device("swt_1", 0x4046c000, 0x4000);
-    create_unimplemented_device("swt_2", 0x40470000, 0x4000);
-    create_unimplemented_device("stm_1", 0x40474000, 0x4000);
-    create_unimplemented_device("stm_2", 0x40478000, 0x4000);
-    create_unimplemented_device("stm_3", 0x4047c000, 0x4000);
-    create_unimplemented_device("emac", 0x40480000, 0x4000);
-    create_unimplemented_device("gmac0", 0x40484000, 0x4000);
-    create_unimplemented_device("gmac1", 0x40488000, 0x4000);
-    create_unimplemented_device("lpuart_8", 0x4048c000, 0x4000);
-    create_unimplemented_device("lpuart_9", 0x40490000, 0x4000);
-    create_unimplemented_device("lpuart_10", 0x40494000, 0x4000);
-    create_unimplemented_device("lpuart_11", 0x40498000, 0x4000);
-    create_unimplemented_device("lpuart_12", 0x4049c000, 0x4000);
-    create_unimplemented_device("lpuart_13", 0x404a0000, 0x4000);
-    create_unimplemented_device("lpuart_14", 0x404a4000, 0x4000);
-    create_unimplemented_device("lpuart_15", 0x404a8000, 0x4000);
-    create_unimplemented_device("lpspi_4", 0x404bc000, 0x4000);
-    create_unimplemented_device("lpspi_5", 0x404c0000, 0x4000);
-    create_unimplemented_device("quadspi", 0x404cc000, 0x4000);
-    create_unimplemented_device("sai1", 0x404dc000, 0x4000);
-    create_unimplemented_device("usdhc", 0x404e4000, 0x4000);
-    create_unimplemented_device("lpcmp_2", 0x404e8000, 0x4000);
-    create_unimplemented_device("mu_1", 0x404ec000, 0x4000);
-    create_unimplemented_device("eim0", 0x4050c000, 0x4000);
-    create_unimplemented_device("eim1", 0x40510000, 0x4000);
-    create_unimplemented_device("eim2", 0x40514000, 0x4000);
-    create_unimplemented_device("eim3", 0x40518000, 0x4000);
-    create_unimplemented_device("aes_app3", 0x40520000, 0x10000);
-    create_unimplemented_device("aes_app4", 0x40530000, 0x10000);
-    create_unimplemented_device("aes_app5", 0x40540000, 0x10000);
-    create_unimplemented_device("aes_app6", 0x40550000, 0x10000);
-    create_unimplemented_device("aes_app7", 0x40560000, 0x10000);
-    create_unimplemented_device("flexcan_8", 0x40570000, 0x4000);
-    create_unimplemented_device("flexcan_9", 0x40574000, 0x4000);
-    create_unimplemented_device("flexcan_10", 0x40578000, 0x4000);
-    create_unimplemented_device("flexcan_11", 0x4057c000, 0x4000);
-    create_unimplemented_device("fmu1", 0x40580000, 0x4000);
-    create_unimplemented_device("fmu1_alt", 0x40584000, 0x4000);
-    create_unimplemented_device("pram_3", 0x40588000, 0x4000);
-}
-
-/**
- * @brief Super basic implementation of the read function for the MC_ME (Mode
- * Control Module)
- *
- * It does not do anything but return a magic value when reading at offset
- * 0x310. This is needed to boot using the default startup code.
+ * Only CPXNUM (offset 0x4), which holds the number of the core performing the
+ * access, is implemented: the startup code reads it to tell the cores apart.
+ * The other registers read as 0.
  *
- * @param opaque A pointer to the opaque data structure.
+ * @param opaque The number of the core, cast to a pointer.
  * @param addr The offset from the start of the memory region being
  * read from.
  * @param size The size of the value being read.
  *
  * @return The value read from the memory region.
  */
-static uint64_t mc_me_read(void *opaque, hwaddr addr, unsigned size) {
-    uint32_t ret = 0;
-
+static uint64_t mscm_cpx_read(void *opaque, hwaddr addr, unsigned size) {
     switch (addr) {
-        case 0x310:
-            ret = 0x1000000;
-            break;
+        case 0x4:
+            return (uintptr_t)opaque;
         default:
-            ret = 0x0;
-            break;
+            return 0;
     }
-
-    return ret;
 }
 
 /**
- * @brief Handles write operations to the MC_ME (Mode Entry) module.
- *
- * It does not perform any actions for any address (MC_ME is not implemented).
+ * @brief Handles write operations to the MSCM processor identification
+ * registers, which are read-only.
  *
- * @param opaque A pointer to the opaque data structure.
+ * @param opaque The number of the core, cast to a pointer.
  * @param addr The offset from the start of the memory region being written to.
  * @param val The value being written.
  * @param size The size of the value being written.
  */
-static void mc_me_write(void *opaque, hwaddr addr, uint64_t val,
-                        unsigned size) {
-    switch (addr) {
-        default:
-            break;
-    }
+static void mscm_cpx_write(void *opaque, hwaddr addr, uint64_t val,
+                           unsigned size) {
 }
 
-static const MemoryRegionOps mc_me_ops = {
-    .read = mc_me_read,
-    .write = mc_me_write,
+static const MemoryRegionOps mscm_cpx_ops = {
+    .read = mscm_cpx_read,
+    .write = mscm_cpx_write,
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+/**
+ * @brief Get the input of an interrupt of the SoC.
+ *
+ * With a single core the interrupt goes straight to its NVIC; otherwise it
+ * goes to the splitter feeding the NVICs of all the cores.
+ *
+ * @param s Pointer to the NXPS32K358State structure.
+ * @param n Number of the interrupt.
+ * @return The input line of the interrupt.
+ */
+static qemu_irq nxps32k358_soc_irq(NXPS32K358State *s, int n) {
+    if (s->num_cpus == 1) {
+        return qdev_get_gpio_in(DEVICE(&s->armv7m[0]), n);
+    }
+    return qdev_get_gpio_in(DEVICE(&s->irq_splitter[n]), 0);
+}
+
+/**
+ * @brief Get the memory of a memory backend holding the contents of a flash.
+ *
+ * The backend is marked as mapped, so that it cannot be used twice.
+ *
+ * @param backend The memory backend.
+ * @param prop Name of the property the backend was given with, for errors.
+ * @param size Size of the flash.
+ * @param errp Pointer to an error object.
+ * @return The memory region of the backend, NULL if the backend is already in
+ * use or its size does not match the flash.
+ */
+static MemoryRegion *nxps32k358_soc_flash_memdev(HostMemoryBackend *backend,
+                                                 const char *prop,
+                                                 uint64_t size,
+                                                 Error **errp) {
+    MemoryRegion *mr;
+
+    if (host_memory_backend_is_mapped(backend)) {
+        error_setg(errp, "%s: memory backend '%s' is already in use", prop,
+                   object_get_canonical_path_component(OBJECT(backend)));
+        return NULL;
+    }
+    mr = host_memory_backend_get_memory(backend);
+    if (memory_region_size(mr) != size) {
+        error_setg(errp, "%s: memory backend '%s' must be %" PRIu64
+                   " bytes, not %" PRIu64, prop,
+                   object_get_canonical_path_component(OBJECT(backend)), size,
+                   memory_region_size(mr));
+        return NULL;
+    }
+    host_memory_backend_set_mapped(backend, true);
+    return mr;
+}
+
 /**
  * @brief Initialize the NXP S32K358 SoC
  *
  * This function initializes the NXP S32K358 SoC by performing the following
  * steps:
- * - Initializes the ARMv7-M CPU.
- * - Sets up the base clocks for the SoC, sysclk and refclk, needed by the
- * armv7m.
- * - Initializes additional clocks required for LPUARTs, aips_plat_clk
- * and aips_slow_clk.
+ * - Sets up the clock inputs of the SoC: fxosc, the crystal, and refclk,
+ * needed by the armv7m.
+ * - Initializes the CPU clusters and the ARMv7m of every possible core, and
+ * the splitters feeding each interrupt to the NVICs of the cores.
+ * - Initializes the clock generation and mode entry, which derives the
+ * clocks of the cores and of the peripherals.
  * - Initializes the LPUARTs.
- * - Initializes the eDMA.
+ * - Initializes the eDMA and the DMAMUXes.
  *
  * @param obj Pointer to the Object structure
  */
 static void nxps32k358_soc_initfn(Object *obj) {
     NXPS32K358State *s = NXPS32K358_SOC(obj);
 
-    object_initialize_child(obj, "armv7m", &s->armv7m, TYPE_ARMV7M);
-
-    s->sysclk = qdev_init_clock_in(DEVICE(s), "sysclk", NULL, NULL, 0);
+    s->fxosc = qdev_init_clock_in(DEVICE(s), "fxosc", NULL, NULL, 0);
     s->refclk = qdev_init_clock_in(DEVICE(s), "refclk", NULL, NULL, 0);
-    s->aips_plat_clk =
-        qdev_init_clock_in(DEVICE(s), "aips_plat_clk", NULL, NULL, 0);
-    s->aips_slow_clk =
-        qdev_init_clock_in(DEVICE(s), "aips_slow_clk", NULL, NULL, 0);
+    // Each core is in its own cluster, since it has its own view of the
+    // memory. Only the first num-cpus cores are realized.
+    for (int i = 0; i < NXPS32K358_MAX_CPUS; i++) {
+        object_initialize_child(obj, "cluster[*]", &s->cluster[i],
+                                TYPE_CPU_CLUSTER);
+        qdev_prop_set_uint32(DEVICE(&s->cluster[i]), "cluster-id", i);
+        object_initialize_child(OBJECT(&s->cluster[i]), "armv7m",
+                                &s->armv7m[i], TYPE_ARMV7M);
+    }
+    // Only realized with more than one core
+    for (int i = 0; i < NXPS32K358_NUM_IRQ; i++) {
+        object_initialize_child(obj, "irq-splitter[*]", &s->irq_splitter[i],
+                                TYPE_SPLIT_IRQ);
+    }
+    object_initialize_child(obj, "mc", &s->mc, TYPE_NXPS32K358_MC);
     for (int i = 0; i < NUM_LPUARTS; i++) {
         object_initialize_child(obj, "lpuart[*]", &s->lpuart[i],
                                 TYPE_NXPS32K358_LPUART);
     }
     object_initialize_child(obj, "edma", &s->edma, TYPE_NXPS32K358_EDMA);
+    for (int i = 0; i < NUM_DMAMUX; i++) {
+        object_initialize_child(obj, "dmamux[*]", &s->dmamux[i],
+                                TYPE_NXPS32K358_DMAMUX);
+    }
+    object_initialize_child(obj, "fmu", &s->fmu, TYPE_NXPS32K358_FMU);
+    object_initialize_child(obj, "fabric", &s->fabric, TYPE_NXPS32K358_FABRIC);
 }
 
 /**
@@ -343,27 +190,39 @@ static void nxps32k358_soc_initfn(Object *obj) {
  *
  * This function initializes and sets up the NXPS32K358 SoC device. It performs
  * the following tasks:
- * - Checks the clock sources for refclk and sysclk.
- * - Sets the frequency and source for refclk. We decided that refclk always
- * runs at HCLK / 8.
- * - Sets the default frequencies for aips_plat_clk and aips_slow_clk. In theory
- * these should be configurable by the firmware.
- * - Initializes the code flash memory regions (as ROM).
- * - Initializes the data flash memory region (as ROM).
+ * - Checks the clock sources for refclk and fxosc.
+ * - Attaches the clock generation and mode entry (FXOSC, MC_CGM, MC_ME and
+ * PLL), fed by fxosc. The firmware programs its clock tree, whose outputs
+ * drive the cores and the LPUARTs.
+ * - Sets the source for refclk. We decided that refclk always runs at
+ * CORE_CLK / 8.
+ * - Initializes the code flash memory regions (as ROM, or as read-only aliases
+ * of the code-flash-memdev backend).
+ * - Attaches the FMU, which programs and erases both flashes, at its two
+ * addresses.
+ * - Maps the data flash (the array of the FMU, or a read-only alias of the
+ * data-flash-memdev backend).
  * - Initializes the SRAM memory regions (as RAM).
- * - Initializes the DTCM and ITCM memory regions (as RAM).
- * - Initializes the MC_ME memory region (with our basic implementation).
- * - Initializes the ARMv7m CPU with specific properties and connects clocks.
+ * - Initializes the DTCM and ITCM memory regions of each core (as RAM).
+ * - Realizes one ARMv7m CPU per core, each in its own cluster and with its
+ * own view of the memory, with specific properties and connects clocks.
  * Notice that there are 240 IRQs, 4 priority bits (16 levels) and 16 MPU
- * regions instead of the standard 8. Moreover, the VTOR is located at
+ * regions instead of the standard 8. Moreover, the default VTOR is located at
  * CODE_FLASH_BASE_ADDRESS + 2048 since we want to "skip" the boot header as the
  * official linker script provided by NXP states that the VTOR is located at
  * CODE_FLASH_BASE_ADDRESS + boot_header with 2048 alignment (and the header is
  * small, smaller than 2048 bytes)
- * - Attaches and initializes the LPUART devices with appropriate clocks
- * (AIPS_PLAT_CLK and AIPS_SLOW_CLK), IRQs and memory mappings.
+ * - With more than one core, realizes the splitters that feed each interrupt
+ * to the NVICs of all the cores.
+ * - Attaches and initializes the LPUART devices with their gated clocks
+ * (from AIPS_PLAT_CLK or AIPS_SLOW_CLK), IRQs and memory mappings.
  * - Attaches and initializes the eDMA controller with memory mappings and IRQs.
- * - Creates unimplemented devices with lower priority.
+ * The TCDs of channels 12-31 live in a separate memory region.
+ * - Attaches the DMAMUXes and connects their request lines to the hardware
+ * service request inputs of the eDMA channels, and the DMA requests of the
+ * LPUARTs to the DMAMUX sources.
+ * - Attaches the peripheral fabric, which stands in for the peripherals that
+ * are not modelled, below every other device.
  *
  * This function ensures that all necessary components of the NXPS32K358 SoC are
  * properly set up and ready for use.
@@ -379,56 +238,118 @@ static void nxps32k358_soc_realize(DeviceState *dev_soc, Error **errp) {
 
     MemoryRegion *system_memory = get_system_memory();
 
+    if (s->num_cpus < 1 || s->num_cpus > NXPS32K358_MAX_CPUS) {
+        error_setg(errp, "num-cpus must be between 1 and %d",
+                   NXPS32K358_MAX_CPUS);
+        return;
+    }
+
     if (clock_has_source(s->refclk)) {
         error_setg(errp, "refclk clock must not be wired up by the board code");
         return;
     }
 
-    if (!clock_has_source(s->sysclk)) {
-        error_setg(errp, "sysclk clock must be wired up by the board code");
+    if (!clock_has_source(s->fxosc)) {
+        error_setg(errp, "fxosc clock must be wired up by the board code");
         return;
     }
 
-    clock_set_mul_div(s->refclk, 8, 1);
-    clock_set_source(s->refclk, s->sysclk);
+    dev = DEVICE(&s->mc);
+    qdev_connect_clock_in(dev, "fxosc", s->fxosc);
+    if (!sysbus_realize(SYS_BUS_DEVICE(dev), errp)) {
+        return;
+    }
+    busdev = SYS_BUS_DEVICE(dev);
+    sysbus_mmio_map(busdev, 0, FXOSC_BASE_ADDRESS);
+    sysbus_mmio_map(busdev, 1, MC_CGM_BASE_ADDRESS);
+    sysbus_mmio_map(busdev, 2, MC_ME_BASE_ADDRESS);
+    sysbus_mmio_map(busdev, 3, PLL_BASE_ADDRESS);
 
-    clock_set_hz(s->aips_plat_clk, 80000000);
-    clock_set_hz(s->aips_slow_clk, 40000000);
+    clock_set_mul_div(s->refclk, 8, 1);
+    clock_set_source(s->refclk, qdev_get_clock_out(dev, "core_clk"));
 
     /*
      * Init code flash region
      */
-    memory_region_init_rom(&s->code_flash_0, OBJECT(dev_soc),
-                           "NXPS32K358.code_flash_0", CODE_FLASH_BLOCK_SIZE,
-                           &error_fatal);
-    memory_region_add_subregion(system_memory, CODE_FLASH_BASE_ADDRESS,
-                                &s->code_flash_0);
-
-    memory_region_init_rom(&s->code_flash_1, OBJECT(dev_soc),
-                           "NXPS32K358.code_flash_1", CODE_FLASH_BLOCK_SIZE,
-                           &error_fatal);
-    memory_region_add_subregion(system_memory,
-                                CODE_FLASH_BASE_ADDRESS + CODE_FLASH_BLOCK_SIZE,
-                                &s->code_flash_1);
-
-    memory_region_init_rom(&s->code_flash_2, OBJECT(dev_soc),
-                           "NXPS32K358.code_flash_2", CODE_FLASH_BLOCK_SIZE,
-                           &error_fatal);
-    memory_region_add_subregion(
-        system_memory, CODE_FLASH_BASE_ADDRESS + 2 * CODE_FLASH_BLOCK_SIZE,
-        &s->code_flash_2);
-
-    memory_region_init_rom(&s->code_flash_3, OBJECT(dev_soc),
-                           "NXPS32K358.code_flash_3", CODE_FLASH_BLOCK_SIZE,
-                           &error_fatal);
-    memory_region_add_subregion(
-        system_memory, CODE_FLASH_BASE_ADDRESS + 3 * CODE_FLASH_BLOCK_SIZE,
-        &s->code_flash_3);
+    if (s->code_flash_memdev) {
+        MemoryRegion *mr = nxps32k358_soc_flash_memdev(
+            s->code_flash_memdev, "code-flash-memdev",
+            CODE_FLASH_NUM_BLOCKS * CODE_FLASH_BLOCK_SIZE, errp);
+        if (!mr) {
+            return;
+        }
+        for (int i = 0; i < CODE_FLASH_NUM_BLOCKS; i++) {
+            g_autofree char *name =
+                g_strdup_printf("NXPS32K358.code_flash_%d", i);
+
+            memory_region_init_alias(&s->code_flash[i], OBJECT(dev_soc), name,
+                                     mr, i * CODE_FLASH_BLOCK_SIZE,
+                                     CODE_FLASH_BLOCK_SIZE);
+            memory_region_set_readonly(&s->code_flash[i], true);
+        }
+        // The FMU cannot program a backend mapped from read-only memory
+        qdev_prop_set_bit(DEVICE(&s->fmu), "code-flash-readonly",
+                          memory_region_is_rom(mr));
+    } else {
+        for (int i = 0; i < CODE_FLASH_NUM_BLOCKS; i++) {
+            g_autofree char *name =
+                g_strdup_printf("NXPS32K358.code_flash_%d", i);
+
+            memory_region_init_rom(&s->code_flash[i], OBJECT(dev_soc), name,
+                                   CODE_FLASH_BLOCK_SIZE, &error_fatal);
+        }
+    }
+    for (int i = 0; i < CODE_FLASH_NUM_BLOCKS; i++) {
+        memory_region_add_subregion(system_memory,
+                                    CODE_FLASH_BASE_ADDRESS +
+                                    i * CODE_FLASH_BLOCK_SIZE,
+                                    &s->code_flash[i]);
+    }
 
-    /* Init data flash region */
-    memory_region_init_rom(&s->data_flash, OBJECT(dev_soc),
-                           "NXPS32K358.data_flash", DATA_FLASH_SIZE,
-                           &error_fatal);
+    /* Init FMU and data flash region */
+    dev = DEVICE(&s->fmu);
+    qdev_prop_set_uint32(dev, "code-flash-base", CODE_FLASH_BASE_ADDRESS);
+    qdev_prop_set_uint32(dev, "code-flash-size",
+                         CODE_FLASH_NUM_BLOCKS * CODE_FLASH_BLOCK_SIZE);
+    qdev_prop_set_uint32(dev, "code-flash-block-size", CODE_FLASH_BLOCK_SIZE);
+    qdev_prop_set_uint32(dev, "data-flash-base", DATA_FLASH_BASE_ADDRESS);
+    qdev_prop_set_uint32(dev, "data-flash-size", DATA_FLASH_SIZE);
+    if (s->data_flash_memdev) {
+        MemoryRegion *mr;
+
+        if (s->fmu.blk) {
+            error_setg(errp, "data-flash-memdev cannot be used together with "
+                       "a drive for the FMU");
+            return;
+        }
+        mr = nxps32k358_soc_flash_memdev(s->data_flash_memdev,
+                                         "data-flash-memdev", DATA_FLASH_SIZE,
+                                         errp);
+        if (!mr) {
+            return;
+        }
+        memory_region_init_alias(&s->data_flash, OBJECT(dev_soc),
+                                 "NXPS32K358.data_flash", mr, 0,
+                                 DATA_FLASH_SIZE);
+        memory_region_set_readonly(&s->data_flash, true);
+        qdev_prop_set_bit(dev, "data-flash-readonly",
+                          memory_region_is_rom(mr));
+    }
+    if (!sysbus_realize(SYS_BUS_DEVICE(dev), errp)) {
+        return;
+    }
+    busdev = SYS_BUS_DEVICE(dev);
+    sysbus_mmio_map(busdev, 0, FMU_BASE_ADDRESS);
+    memory_region_init_alias(&s->fmu_alt, OBJECT(dev_soc), "NXPS32K358.fmu_alt",
+                             sysbus_mmio_get_region(busdev, 0), 0, FMU_SIZE);
+    memory_region_add_subregion(system_memory, FMU_ALT_BASE_ADDRESS,
+                                &s->fmu_alt);
+    if (!s->data_flash_memdev) {
+        memory_region_init_alias(&s->data_flash, OBJECT(dev_soc),
+                                 "NXPS32K358.data_flash",
+                                 sysbus_mmio_get_region(busdev, 1), 0,
+                                 DATA_FLASH_SIZE);
+    }
     memory_region_add_subregion(system_memory, DATA_FLASH_BASE_ADDRESS,
                                 &s->data_flash);
 
@@ -447,56 +368,104 @@ static void nxps32k358_soc_realize(DeviceState *dev_soc, Error **errp) {
     memory_region_add_subregion(
         system_memory, (SRAM_BASE_ADDRESS + (2 * SRAM_BLOCK_SIZE)), &s->sram_2);
 
-    /* Init DTCM */
-    memory_region_init_ram(&s->dtcm, OBJECT(dev_soc), "NXPS32K358.dtcm",
-                           DTCM_SIZE, &error_fatal);
-    memory_region_add_subregion(system_memory, DTCM_BASE_ADDRESS, &s->dtcm);
-
-    /* Init ITCM */
-    memory_region_init_ram(&s->itcm, OBJECT(dev_soc), "NXPS32K358.itcm",
-                           ITCM_SIZE, &error_fatal);
-    memory_region_add_subregion(system_memory, ITCM_BASE_ADDRESS, &s->itcm);
-
-    /* Init MC_ME */
-    memory_region_init_io(&s->mc_me, OBJECT(dev_soc), &mc_me_ops, s,
-                          "NXPS32K358.MC_ME", MC_ME_SIZE);
-    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->mc_me);
-    memory_region_add_subregion(system_memory, MC_ME_BASE_ADDRESS, &s->mc_me);
-
-    /* Init ARMv7m */
-    armv7m = DEVICE(&s->armv7m);
-    qdev_prop_set_uint32(armv7m, "num-irq", 240);
-    qdev_prop_set_uint8(armv7m, "num-prio-bits", 4);
-    qdev_prop_set_string(armv7m, "cpu-type", ARM_CPU_TYPE_NAME("cortex-m7"));
-    qdev_prop_set_bit(armv7m, "enable-bitband", true);
-    qdev_prop_set_uint32(armv7m, "init-svtor", CODE_FLASH_BASE_ADDRESS + 2048);
-    qdev_prop_set_uint32(armv7m, "init-nsvtor", CODE_FLASH_BASE_ADDRESS + 2048);
-    qdev_prop_set_uint32(armv7m, "mpu-ns-regions", 16);
-    qdev_prop_set_uint32(armv7m, "mpu-s-regions", 16);
-    qdev_connect_clock_in(armv7m, "cpuclk", s->sysclk);
-    qdev_connect_clock_in(armv7m, "refclk", s->refclk);
-    object_property_set_link(OBJECT(&s->armv7m), "memory",
-                             OBJECT(get_system_memory()), &error_abort);
-    if (!sysbus_realize(SYS_BUS_DEVICE(&s->armv7m), errp)) {
-        return;
+    /*
+     * Init the TCMs of each core. Those of core 0 live in the system memory,
+     * those of the other cores only in the memory seen by their core.
+     */
+    for (int i = 0; i < s->num_cpus; i++) {
+        g_autofree char *dtcm_name = g_strdup_printf("NXPS32K358.dtcm%d", i);
+        g_autofree char *itcm_name = g_strdup_printf("NXPS32K358.itcm%d", i);
+
+        memory_region_init_ram(&s->dtcm[i], OBJECT(dev_soc), dtcm_name,
+                               DTCM_SIZE, &error_fatal);
+        memory_region_init_ram(&s->itcm[i], OBJECT(dev_soc), itcm_name,
+                               ITCM_SIZE, &error_fatal);
+    }
+    memory_region_add_subregion(system_memory, DTCM_BASE_ADDRESS, &s->dtcm[0]);
+    memory_region_add_subregion(system_memory, ITCM_BASE_ADDRESS, &s->itcm[0]);
+
+    /* Init one ARMv7m per core */
+    for (int i = 0; i < s->num_cpus; i++) {
+        g_autofree char *name = g_strdup_printf("NXPS32K358.cpu%d", i);
+
+        // The core sees the system memory, overlaid with its own TCMs and
+        // identification registers
+        memory_region_init(&s->cpu_container[i], OBJECT(dev_soc), name,
+                           UINT64_MAX);
+        memory_region_init_alias(&s->sysmem_alias[i], OBJECT(dev_soc),
+                                 "NXPS32K358.sysmem", system_memory, 0,
+                                 UINT64_MAX);
+        memory_region_add_subregion_overlap(&s->cpu_container[i], 0,
+                                            &s->sysmem_alias[i], -1);
+        if (i > 0) {
+            memory_region_add_subregion(&s->cpu_container[i],
+                                        DTCM_BASE_ADDRESS, &s->dtcm[i]);
+            memory_region_add_subregion(&s->cpu_container[i],
+                                        ITCM_BASE_ADDRESS, &s->itcm[i]);
+        }
+        memory_region_init_io(&s->mscm_cpx[i], OBJECT(dev_soc), &mscm_cpx_ops,
+                              (void *)(uintptr_t)i, "NXPS32K358.mscm_cpx",
+                              MSCM_CPX_SIZE);
+        memory_region_add_subregion(&s->cpu_container[i], MSCM_BASE_ADDRESS,
+                                    &s->mscm_cpx[i]);
+
+        armv7m = DEVICE(&s->armv7m[i]);
+        qdev_prop_set_uint32(armv7m, "num-irq", NXPS32K358_NUM_IRQ);
+        qdev_prop_set_uint8(armv7m, "num-prio-bits", 4);
+        qdev_prop_set_string(armv7m, "cpu-type",
+                             ARM_CPU_TYPE_NAME("cortex-m7"));
+        qdev_prop_set_bit(armv7m, "enable-bitband", true);
+        qdev_prop_set_uint32(armv7m, "init-svtor", s->init_vtor[i]);
+        qdev_prop_set_uint32(armv7m, "init-nsvtor", s->init_vtor[i]);
+        qdev_prop_set_uint32(armv7m, "mpu-ns-regions", 16);
+        qdev_prop_set_uint32(armv7m, "mpu-s-regions", 16);
+        qdev_connect_clock_in(armv7m, "cpuclk",
+                              qdev_get_clock_out(DEVICE(&s->mc), "core_clk"));
+        qdev_connect_clock_in(armv7m, "refclk", s->refclk);
+        object_property_set_link(OBJECT(armv7m), "memory",
+                                 OBJECT(&s->cpu_container[i]), &error_abort);
+        if (!sysbus_realize(SYS_BUS_DEVICE(armv7m), errp)) {
+            return;
+        }
+        // The cluster is realized once its CPU, created by the armv7m
+        // realize, exists
+        if (!qdev_realize(DEVICE(&s->cluster[i]), NULL, errp)) {
+            return;
+        }
+    }
+
+    if (s->num_cpus > 1) {
+        for (int i = 0; i < NXPS32K358_NUM_IRQ; i++) {
+            DeviceState *splitter = DEVICE(&s->irq_splitter[i]);
+
+            qdev_prop_set_uint16(splitter, "num-lines", s->num_cpus);
+            if (!qdev_realize(splitter, NULL, errp)) {
+                return;
+            }
+            for (int j = 0; j < s->num_cpus; j++) {
+                qdev_connect_gpio_out(splitter, j,
+                                      qdev_get_gpio_in(DEVICE(&s->armv7m[j]),
+                                                       i));
+            }
+        }
     }
 
     for (int i = 0; i < NUM_LPUARTS; i++) {
+        g_autofree char *clk_name = g_strdup_printf("lpuart%d_clk", i);
+
         dev = DEVICE(&(s->lpuart[i]));
         qdev_prop_set_chr(dev, "chardev", serial_hd(i));
-        // LPUART 0, 1 and 8 use AIPS_PLAT_CLK (MUX_0_DC_1)
-        // LPUART 2 to 7 and 9 to 15 use AIPS_SLOW_CLK (MUX_0_DC_2)
-        if (i < 2 || i == 8) {
-            qdev_connect_clock_in(dev, "clk", s->aips_plat_clk);
-        } else {
-            qdev_connect_clock_in(dev, "clk", s->aips_slow_clk);
-        }
+        qdev_prop_set_uint32(dev, "port", i);
+        // LPUART 0, 1 and 8 use AIPS_PLAT_CLK (MUX_0_DC_1), LPUART 2 to 7
+        // and 9 to 15 use AIPS_SLOW_CLK (MUX_0_DC_2), each gated by MC_ME
+        qdev_connect_clock_in(dev, "clk",
+                              qdev_get_clock_out(DEVICE(&s->mc), clk_name));
         if (!sysbus_realize(SYS_BUS_DEVICE(&s->lpuart[i]), errp)) {
             return;
         }
         busdev = SYS_BUS_DEVICE(dev);
         sysbus_mmio_map(busdev, 0, LPUART_ADDR(i));
-        sysbus_connect_irq(busdev, 0, qdev_get_gpio_in(armv7m, LPUART_IRQ(i)));
+        sysbus_connect_irq(busdev, 0, nxps32k358_soc_irq(s, LPUART_IRQ(i)));
     }
 
     dev = DEVICE(&s->edma);
@@ -505,17 +474,62 @@ static void nxps32k358_soc_realize(DeviceState *dev_soc, Error **errp) {
     }
     busdev = SYS_BUS_DEVICE(dev);
     sysbus_mmio_map(busdev, 0, EDMA_BASE_ADDRESS);
+    sysbus_mmio_map(busdev, 1, EDMA_TCD12_BASE_ADDRESS);
     for (int i = 0; i < NUM_EDMA_CHANNELS; i++) {
-        sysbus_connect_irq(busdev, i, qdev_get_gpio_in(armv7m, EDMA_IRQ(i)));
+        sysbus_connect_irq(busdev, i, nxps32k358_soc_irq(s, EDMA_IRQ(i)));
+    }
+
+    for (int i = 0; i < NUM_DMAMUX; i++) {
+        DeviceState *dmamux = DEVICE(&s->dmamux[i]);
+        if (!sysbus_realize(SYS_BUS_DEVICE(dmamux), errp)) {
+            return;
+        }
+        sysbus_mmio_map(SYS_BUS_DEVICE(dmamux), 0, DMAMUX_ADDR(i));
+        for (int j = 0; j < DMAMUX_CHANNELS; j++) {
+            qdev_connect_gpio_out_named(
+                dmamux, NXPS32K358_DMAMUX_REQ, j,
+                qdev_get_gpio_in_named(dev, NXPS32K358_EDMA_REQ,
+                                       i * DMAMUX_CHANNELS + j));
+        }
+    }
+
+    for (int i = 0; i < NUM_LPUARTS; i++) {
+        DeviceState *dmamux = DEVICE(&s->dmamux[LPUART_DMAMUX(i)]);
+        qdev_connect_gpio_out_named(
+            DEVICE(&s->lpuart[i]), NXPS32K358_LPUART_DMA_RX, 0,
+            qdev_get_gpio_in_named(dmamux, NXPS32K358_DMAMUX_SOURCE,
+                                   LPUART_DMA_RX_SOURCE(i)));
+        qdev_connect_gpio_out_named(
+            DEVICE(&s->lpuart[i]), NXPS32K358_LPUART_DMA_TX, 0,
+            qdev_get_gpio_in_named(dmamux, NXPS32K358_DMAMUX_SOURCE,
+                                   LPUART_DMA_TX_SOURCE(i)));
     }
 
-    create_unimplemented_devices();
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->fabric), errp)) {
+        return;
+    }
+    sysbus_mmio_map_overlap(SYS_BUS_DEVICE(&s->fabric), 0, FABRIC_BASE_ADDRESS,
+                            -1000);
 }
 
+static Property nxps32k358_soc_properties[] = {
+    DEFINE_PROP_UINT32("num-cpus", NXPS32K358State, num_cpus, 1),
+    DEFINE_PROP_LINK("code-flash-memdev", NXPS32K358State, code_flash_memdev,
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("data-flash-memdev", NXPS32K358State, data_flash_memdev,
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_UINT32("cpu0-vtor", NXPS32K358State, init_vtor[0],
+                       CODE_FLASH_BASE_ADDRESS + 2048),
+    DEFINE_PROP_UINT32("cpu1-vtor", NXPS32K358State, init_vtor[1],
+                       CODE_FLASH_BASE_ADDRESS + 2048),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void nxps32k358_soc_class_init(ObjectClass *klass, void *data) {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = nxps32k358_soc_realize;
+    device_class_set_props(dc, nxps32k358_soc_properties);
 }
 
 static const TypeInfo nxps32k358_soc_info = {
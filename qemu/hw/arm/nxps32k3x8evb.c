@@ -28,6 +28,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/cutils.h"
 #include "qemu/units.h"
 #include "qapi/error.h"
 #include "hw/arm/boot.h"
@@ -36,6 +37,121 @@
 #include "hw/boards.h"
 #include "hw/arm/nxps32k3x8evb.h"
 #include "hw/qdev-clock.h"
+#include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "sysemu/blockdev.h"
+#include "sysemu/hostmem.h"
+
+/**
+ * @brief Wire the LPUART ports listed in the "lpuart-links" property to each
+ * other.
+ *
+ * Each A-B pair sets the "peer" link of LPUART A to LPUART B; the LPUART
+ * makes the link symmetric when it is realized. A port can be paired with
+ * itself for a loopback.
+ *
+ * @param m_state The machine state.
+ * @param errp Pointer to an error object.
+ * @return true on success, false if the property cannot be parsed.
+ */
+static bool NXPS32K3X8EVB_link_lpuarts(NXPS32K3X8EVBMachineState *m_state,
+                                       Error **errp) {
+    g_auto(GStrv) pairs = NULL;
+
+    if (!m_state->lpuart_links || !*m_state->lpuart_links) {
+        return true;
+    }
+
+    pairs = g_strsplit(m_state->lpuart_links, ":", -1);
+    for (int i = 0; pairs[i]; i++) {
+        const char *end;
+        uint64_t a, b;
+
+        if (qemu_strtou64(pairs[i], &end, 10, &a) < 0 || *end != '-' ||
+            qemu_strtou64(end + 1, NULL, 10, &b) < 0 ||
+            a >= NUM_LPUARTS || b >= NUM_LPUARTS) {
+            error_setg(errp, "Invalid LPUART link '%s', expected A-B with "
+                       "ports between 0 and %d", pairs[i], NUM_LPUARTS - 1);
+            return false;
+        }
+        if (!object_property_set_link(OBJECT(&m_state->s32k.lpuart[a]),
+                                      "peer",
+                                      OBJECT(&m_state->s32k.lpuart[b]),
+                                      errp)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Back a flash of the SoC with the memory backend given to the machine.
+ *
+ * Memory backends are created after the machine properties are set, so the
+ * machine takes the id of the backend and resolves it here.
+ *
+ * @param m_state The machine state.
+ * @param id Id of the memory backend, NULL to keep the flash as ROM.
+ * @param prop The link property of the SoC to set.
+ * @param errp Pointer to an error object.
+ * @return true on success, false if there is no such memory backend.
+ */
+static bool NXPS32K3X8EVB_set_flash(NXPS32K3X8EVBMachineState *m_state,
+                                    const char *id, const char *prop,
+                                    Error **errp) {
+    Object *backend;
+
+    if (!id) {
+        return true;
+    }
+
+    backend = object_resolve_path_type(id, TYPE_MEMORY_BACKEND, NULL);
+    if (!backend) {
+        error_setg(errp, "Memory backend '%s' not found", id);
+        return false;
+    }
+    return object_property_set_link(OBJECT(&m_state->s32k), prop, backend,
+                                    errp);
+}
+
+/**
+ * @brief Check that the kernel image can be loaded on top of the flashes.
+ *
+ * The ELF segments are loaded in the code flash or in the data flash. The
+ * loader writes them into the host memory of the backend of that flash, which
+ * a ROM backend (memory-backend-file with readonly=on and the default rom=auto,
+ * or with rom=on) maps read-only, so the kernel is refused in that case.
+ *
+ * @param machine The generic MachineState passed by QEMU.
+ * @param errp Pointer to an error object.
+ * @return true if there is no kernel or no flash is backed by a ROM backend.
+ */
+static bool NXPS32K3X8EVB_check_kernel(MachineState *machine, Error **errp) {
+    NXPS32K358State *s = &NXPS32K3X8EVB_MACHINE(machine)->s32k;
+    HostMemoryBackend *backends[] = {s->code_flash_memdev,
+                                     s->data_flash_memdev};
+
+    if (!machine->kernel_filename) {
+        return true;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(backends); i++) {
+        MemoryRegion *mr;
+
+        if (!backends[i]) {
+            continue;
+        }
+        mr = host_memory_backend_get_memory(backends[i]);
+        if (memory_region_is_rom(mr)) {
+            error_setg(errp, "-kernel cannot be loaded on top of memory "
+                       "backend '%s', which is ROM: create it with rom=off",
+                       object_get_canonical_path_component(
+                           OBJECT(backends[i])));
+            return false;
+        }
+    }
+    return true;
+}
 
 /**
  * @brief Initialize the NXP S32K3X8EVB board.
@@ -43,9 +159,16 @@
  * This function initializes the NXP S32K3X8EVB board by performing the
  * following steps:
  * 1. Casts the generic MachineState to NXPS32K3X8EVBMachineState.
- * 2. Initializes the system clock and sets its frequency.
- * 3. Initializes the SoC (System on Chip) and connects the system clock to it.
- * 4. Loads the kernel image into the ARM CPU's flash memory.
+ * 2. Initializes the clock of the FXOSC crystal and sets its frequency.
+ * 3. Initializes the SoC (System on Chip) with one core per CPU requested with
+ *    -smp, and connects the crystal to it.
+ * 4. Wires the LPUART ports listed in "lpuart-links" to each other.
+ * 5. Backs the flashes with the memory backends given as "code-flash" and
+ *    "data-flash", if any, and the data flash written by the FMU with the
+ *    first -drive if=pflash, if any.
+ * 6. Loads the kernel image into the flash memory, and registers the reset of
+ *    each core. With a prebuilt flash image the kernel can be omitted; it is
+ *    refused if a flash is backed by a ROM memory backend.
  *
  * @param machine The generic MachineState passed by QEMU.
  */
@@ -53,20 +176,80 @@ static void NXPS32K3X8EVB_init(MachineState *machine) {
     // Cast the NXP machine from the generic machine
     NXPS32K3X8EVBMachineState *m_state = NXPS32K3X8EVB_MACHINE(machine);
 
-    // Initialize system clock
-    m_state->sysclk = clock_new(OBJECT(machine), "SYSCLK");
-    clock_set_hz(m_state->sysclk, SYSCLK_FRQ);
+    // Initialize the crystal of FXOSC
+    m_state->fxosc = clock_new(OBJECT(machine), "FXOSC");
+    clock_set_hz(m_state->fxosc, FXOSC_FRQ);
 
     // Initialize the SoC
     object_initialize_child(OBJECT(machine), "s32k", &m_state->s32k,
                             TYPE_NXPS32K358_SOC);
     DeviceState *soc_state = DEVICE(&m_state->s32k);
-    qdev_connect_clock_in(soc_state, "sysclk", m_state->sysclk);
-    sysbus_realize(SYS_BUS_DEVICE(&m_state->s32k), &error_abort);
+    qdev_prop_set_uint32(soc_state, "num-cpus", machine->smp.cpus);
+    qdev_connect_clock_in(soc_state, "fxosc", m_state->fxosc);
+    NXPS32K3X8EVB_link_lpuarts(m_state, &error_fatal);
+    NXPS32K3X8EVB_set_flash(m_state, m_state->code_flash, "code-flash-memdev",
+                            &error_fatal);
+    NXPS32K3X8EVB_set_flash(m_state, m_state->data_flash, "data-flash-memdev",
+                            &error_fatal);
+    DriveInfo *dinfo = drive_get(IF_PFLASH, 0, 0);
+    if (dinfo) {
+        qdev_prop_set_drive_err(DEVICE(&m_state->s32k.fmu), "drive",
+                                blk_by_legacy_dinfo(dinfo), &error_fatal);
+    }
+    sysbus_realize(SYS_BUS_DEVICE(&m_state->s32k), &error_fatal);
+    NXPS32K3X8EVB_check_kernel(machine, &error_fatal);
+
+    // Load kernel image. Every core needs the reset handler registered by
+    // armv7m_load_kernel, but the image is loaded only once.
+    CPUState *cpu;
+    CPU_FOREACH(cpu) {
+        armv7m_load_kernel(ARM_CPU(cpu),
+                           cpu == first_cpu ? machine->kernel_filename : NULL,
+                           CODE_FLASH_BASE_ADDRESS,
+                           CODE_FLASH_BLOCK_SIZE * CODE_FLASH_NUM_BLOCKS);
+    }
+}
+
+static char *NXPS32K3X8EVB_get_lpuart_links(Object *obj, Error **errp) {
+    NXPS32K3X8EVBMachineState *m_state = NXPS32K3X8EVB_MACHINE(obj);
+
+    return g_strdup(m_state->lpuart_links);
+}
+
+static void NXPS32K3X8EVB_set_lpuart_links(Object *obj, const char *value,
+                                           Error **errp) {
+    NXPS32K3X8EVBMachineState *m_state = NXPS32K3X8EVB_MACHINE(obj);
+
+    g_free(m_state->lpuart_links);
+    m_state->lpuart_links = g_strdup(value);
+}
+
+static char *NXPS32K3X8EVB_get_code_flash(Object *obj, Error **errp) {
+    NXPS32K3X8EVBMachineState *m_state = NXPS32K3X8EVB_MACHINE(obj);
 
-    // Load kernel image
-    armv7m_load_kernel(ARM_CPU(first_cpu), machine->kernel_filename,
-                       CODE_FLASH_BASE_ADDRESS, CODE_FLASH_BLOCK_SIZE * 4);
+    return g_strdup(m_state->code_flash);
+}
+
+static void NXPS32K3X8EVB_set_code_flash(Object *obj, const char *value,
+                                         Error **errp) {
+    NXPS32K3X8EVBMachineState *m_state = NXPS32K3X8EVB_MACHINE(obj);
+
+    g_free(m_state->code_flash);
+    m_state->code_flash = g_strdup(value);
+}
+
+static char *NXPS32K3X8EVB_get_data_flash(Object *obj, Error **errp) {
+    NXPS32K3X8EVBMachineState *m_state = NXPS32K3X8EVB_MACHINE(obj);
+
+    return g_strdup(m_state->data_flash);
+}
+
+static void NXPS32K3X8EVB_set_data_flash(Object *obj, const char *value,
+                                         Error **errp) {
+    NXPS32K3X8EVBMachineState *m_state = NXPS32K3X8EVB_MACHINE(obj);
+
+    g_free(m_state->data_flash);
+    m_state->data_flash = g_strdup(value);
 }
 
 /**
@@ -80,8 +263,10 @@ static void NXPS32K3X8EVB_init(MachineState *machine) {
  * function, and defines CPU attributes such as the default CPU type and
  * the number of CPUs. Additionally, it indicates that the board does not
  * have any media drives (floppy or CD-ROM) and does not support parallel
- * threads. In our implementation we have only one core; in the real thing there
- * are 2 cores.
+ * threads. One core is emulated by default; "-smp 2" adds the second
+ * Cortex-M7, which runs in its own host thread under MTTCG. The
+ * "lpuart-links" property wires LPUART ports to each other, and the
+ * "code-flash"/"data-flash" properties back the flashes with memory backends.
  */
 static void NXPS32K3X8EVB_class_init(ObjectClass *oc, void *data) {
     MachineClass *mc = MACHINE_CLASS(oc);
@@ -95,10 +280,28 @@ static void NXPS32K3X8EVB_class_init(ObjectClass *oc, void *data) {
     mc->default_cpu_type = ARM_CPU_TYPE_NAME("cortex-m7");
     mc->valid_cpu_types = valid_cpu_types;
     mc->min_cpus = mc->default_cpus;
-    mc->max_cpus = mc->default_cpus;
+    mc->max_cpus = NXPS32K358_MAX_CPUS;
     mc->no_floppy = 1;
     mc->no_cdrom = 1;
     mc->no_parallel = 1;
+
+    object_class_property_add_str(oc, "lpuart-links",
+                                  NXPS32K3X8EVB_get_lpuart_links,
+                                  NXPS32K3X8EVB_set_lpuart_links);
+    object_class_property_set_description(
+        oc, "lpuart-links",
+        "LPUART ports wired to each other, as A-B pairs separated by ':'");
+
+    object_class_property_add_str(oc, "code-flash",
+                                  NXPS32K3X8EVB_get_code_flash,
+                                  NXPS32K3X8EVB_set_code_flash);
+    object_class_property_set_description(
+        oc, "code-flash", "Id of the memory backend holding the code flash");
+    object_class_property_add_str(oc, "data-flash",
+                                  NXPS32K3X8EVB_get_data_flash,
+                                  NXPS32K3X8EVB_set_data_flash);
+    object_class_property_set_description(
+        oc, "data-flash", "Id of the memory backend holding the data flash");
 }
 
 static const TypeInfo NXPS32K3X8EVB_machine_types[] = {{
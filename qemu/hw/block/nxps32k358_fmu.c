@@ -0,0 +1,587 @@
+/*
+ * NXPS32K358 FMU
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_fmu.c
+ * @brief Implementation of the NXPS32K358 FMU (Flash Management Unit).
+ */
+
+#include "qemu/osdep.h"
+#include "hw/block/nxps32k358_fmu.h"
+#include "hw/block/block.h"
+#include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "exec/address-spaces.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+/**
+ * @brief Find the flash containing an address.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ * @param addr The flash address.
+ * @param block Set to the address of the erase block containing addr.
+ * @param block_size Set to the size of that erase block.
+ * @param readonly Set to true if the flash cannot be modified.
+ * @return true if addr is in the code or the data flash, false otherwise.
+ */
+static bool nxps32k358_fmu_find_block(NXPS32K358FMUState *s, uint32_t addr,
+                                      uint32_t *block, uint32_t *block_size,
+                                      bool *readonly) {
+    if (addr - s->code_flash_base < s->code_flash_size) {
+        *block_size = s->code_flash_block_size;
+        *block = addr - (addr - s->code_flash_base) % *block_size;
+        *readonly = s->code_flash_readonly;
+        return true;
+    }
+    if (addr - s->data_flash_base < s->data_flash_size) {
+        *block_size = s->data_flash_size;
+        *block = s->data_flash_base;
+        *readonly = s->data_flash_readonly;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Writes a modified range of the data flash through to the block
+ * backend.
+ *
+ * As in pflash_cfi01, the range is widened to whole sectors of the backend.
+ * Ranges outside the data flash, or a data flash without a writable backend,
+ * are left alone.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ * @param addr Flash address of the modified range.
+ * @param size Size of the modified range.
+ */
+static void nxps32k358_fmu_update(NXPS32K358FMUState *s, uint32_t addr,
+                                  uint32_t size) {
+    uint32_t offset, offset_end;
+    int ret;
+
+    if (!s->blk || s->blk_ro ||
+        addr - s->data_flash_base >= s->data_flash_size) {
+        return;
+    }
+
+    offset = QEMU_ALIGN_DOWN(addr - s->data_flash_base, BDRV_SECTOR_SIZE);
+    offset_end = QEMU_ALIGN_UP(addr - s->data_flash_base + size,
+                               BDRV_SECTOR_SIZE);
+    ret = blk_pwrite(s->blk, offset, offset_end - offset, s->storage + offset,
+                     0);
+    if (ret < 0) {
+        error_report("nxps32k358-fmu: could not update the data flash: %s",
+                     strerror(-ret));
+    }
+}
+
+/**
+ * @brief Programs the words written to the DATA registers into the quad-page
+ * addressed by PEADR.
+ *
+ * Programming can only clear bits: each word becomes the AND of its current
+ * value and of the DATA register.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ */
+static void nxps32k358_fmu_program(NXPS32K358FMUState *s) {
+    uint32_t page = s->peadr & ~(FMU_PAGE_SIZE - 1);
+
+    for (int i = 0; i < FMU_DATA_NUM; i++) {
+        uint32_t word;
+
+        if (!(s->data_written & (1U << i))) {
+            continue;
+        }
+        address_space_read(&address_space_memory, page + 4 * i,
+                           MEMTXATTRS_UNSPECIFIED, &word, 4);
+        word &= cpu_to_le32(s->data[i]);
+        address_space_write_rom(&address_space_memory, page + 4 * i,
+                                MEMTXATTRS_UNSPECIFIED, &word, 4);
+    }
+    nxps32k358_fmu_update(s, page, FMU_PAGE_SIZE);
+}
+
+/**
+ * @brief Erases the sector addressed by PEADR, or its whole block if
+ * MCR[ESS] is set.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ * @param start Address of the erased range.
+ * @param size Size of the erased range.
+ */
+static void nxps32k358_fmu_erase(NXPS32K358FMUState *s, uint32_t start,
+                                 uint32_t size) {
+    uint8_t erased[FMU_SECTOR_SIZE];
+
+    memset(erased, 0xFF, sizeof(erased));
+    for (uint32_t addr = start; addr < start + size; addr += FMU_SECTOR_SIZE) {
+        address_space_write_rom(&address_space_memory, addr,
+                                MEMTXATTRS_UNSPECIFIED, erased,
+                                sizeof(erased));
+    }
+    nxps32k358_fmu_update(s, start, size);
+}
+
+/**
+ * @brief Returns the range erased by the operation selected in MCR.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ * @param start Set to the address of the erased range.
+ * @param size Set to the size of the erased range.
+ */
+static void nxps32k358_fmu_erase_range(NXPS32K358FMUState *s, uint32_t *start,
+                                       uint32_t *size) {
+    uint32_t block, block_size;
+    bool readonly;
+
+    nxps32k358_fmu_find_block(s, s->peadr, &block, &block_size, &readonly);
+    if (FIELD_EX32(s->mcr, FMU_MCR, ESS)) {
+        *start = block;
+        *size = block_size;
+    } else {
+        *start = s->peadr & ~(FMU_SECTOR_SIZE - 1);
+        *size = FMU_SECTOR_SIZE;
+    }
+}
+
+/**
+ * @brief Completes the running program or erase operation.
+ *
+ * The flash is modified only now, so that an operation aborted by clearing
+ * MCR[EHV] leaves it untouched.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ */
+static void nxps32k358_fmu_complete(NXPS32K358FMUState *s) {
+    if (FIELD_EX32(s->mcr, FMU_MCR, PGM)) {
+        nxps32k358_fmu_program(s);
+    } else {
+        uint32_t start, size;
+
+        nxps32k358_fmu_erase_range(s, &start, &size);
+        nxps32k358_fmu_erase(s, start, size);
+    }
+
+    trace_nxps32k358_fmu_done(s->peadr, true);
+    s->mcrs = FIELD_DP32(s->mcrs, FMU_MCRS, DONE, 1);
+    s->mcrs = FIELD_DP32(s->mcrs, FMU_MCRS, PEG, 1);
+}
+
+/**
+ * @brief Timer callback ending a timed program or erase operation.
+ *
+ * @param opaque Pointer to the NXPS32K358FMUState structure.
+ */
+static void nxps32k358_fmu_timer_cb(void *opaque) {
+    nxps32k358_fmu_complete(opaque);
+}
+
+/**
+ * @brief Starts the program or erase operation selected in MCR, after
+ * MCR[EHV] has been set.
+ *
+ * The operation fails immediately (MCRS[DONE] = 1, MCRS[PEG] = 0) if PEADR is
+ * not a flash address, if the flash is read-only, or if no DATA register was
+ * written for a program operation. Otherwise MCRS[DONE] is cleared until the
+ * operation completes, at once or after its modelled duration if the FMU is
+ * timed.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ */
+static void nxps32k358_fmu_start(NXPS32K358FMUState *s) {
+    bool pgm = FIELD_EX32(s->mcr, FMU_MCR, PGM);
+    uint32_t block, block_size, start, size;
+    bool readonly;
+    int64_t duration;
+
+    trace_nxps32k358_fmu_start(s->peadr, pgm, FIELD_EX32(s->mcr, FMU_MCR, ESS));
+    s->mcrs = FIELD_DP32(s->mcrs, FMU_MCRS, PEG, 0);
+
+    if (!nxps32k358_fmu_find_block(s, s->peadr, &block, &block_size,
+                                   &readonly)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad flash address 0x%08" PRIx32
+                      "\n", __func__, s->peadr);
+        trace_nxps32k358_fmu_done(s->peadr, false);
+        return;
+    }
+    if (readonly) {
+        qemu_log_mask(LOG_UNIMP, "%s: Flash at 0x%08" PRIx32 " is read-only\n",
+                      __func__, s->peadr);
+        trace_nxps32k358_fmu_done(s->peadr, false);
+        return;
+    }
+    if (pgm && !s->data_written) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: No DATA register written\n",
+                      __func__);
+        trace_nxps32k358_fmu_done(s->peadr, false);
+        return;
+    }
+
+    if (!s->timed) {
+        nxps32k358_fmu_complete(s);
+        return;
+    }
+
+    if (pgm) {
+        duration = FMU_PROGRAM_NS;
+    } else {
+        nxps32k358_fmu_erase_range(s, &start, &size);
+        duration = (int64_t)FMU_SECTOR_ERASE_NS * (size / FMU_SECTOR_SIZE);
+    }
+    s->mcrs = FIELD_DP32(s->mcrs, FMU_MCRS, DONE, 0);
+    timer_mod(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + duration);
+}
+
+/**
+ * @brief Writes MCR, starting or aborting program and erase operations.
+ *
+ * While an operation is running, only MCR[EHV] can be cleared, which aborts
+ * the operation: the flash is left untouched and MCRS[PEG] stays clear.
+ * Setting EHV starts the operation selected by exactly one of PGM and ERS.
+ * Setting PGM clears the record of the written DATA registers.
+ *
+ * @param s Pointer to the NXPS32K358FMUState structure.
+ * @param value Value to write.
+ */
+static void nxps32k358_fmu_write_mcr(NXPS32K358FMUState *s, uint32_t value) {
+    bool ehv = FIELD_EX32(value, FMU_MCR, EHV);
+    bool pgm = FIELD_EX32(value, FMU_MCR, PGM);
+    bool ers = FIELD_EX32(value, FMU_MCR, ERS);
+
+    if (!FIELD_EX32(s->mcrs, FMU_MCRS, DONE)) {
+        if (!ehv) {
+            timer_del(s->timer);
+            trace_nxps32k358_fmu_done(s->peadr, false);
+            s->mcr = FIELD_DP32(s->mcr, FMU_MCR, EHV, 0);
+            s->mcrs = FIELD_DP32(s->mcrs, FMU_MCRS, DONE, 1);
+        }
+        return;
+    }
+
+    if (pgm && !FIELD_EX32(s->mcr, FMU_MCR, PGM)) {
+        s->data_written = 0;
+    }
+
+    if (ehv && !FIELD_EX32(s->mcr, FMU_MCR, EHV)) {
+        s->mcr = value;
+        if (pgm == ers) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: EHV set without exactly one of PGM and ERS\n",
+                          __func__);
+            s->mcrs = FIELD_DP32(s->mcrs, FMU_MCRS, PEG, 0);
+            return;
+        }
+        nxps32k358_fmu_start(s);
+        return;
+    }
+    s->mcr = value;
+}
+
+/**
+ * @brief Reads a register of the FMU.
+ *
+ * @param opaque Pointer to the NXPS32K358FMUState structure.
+ * @param offset Offset of the register to read.
+ * @param size Size of the read operation (always 4).
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_fmu_read(void *opaque, hwaddr offset,
+                                    unsigned size) {
+    NXPS32K358FMUState *s = opaque;
+    uint64_t value;
+
+    switch (offset) {
+    case A_FMU_MCR:
+        value = s->mcr;
+        break;
+    case A_FMU_MCRS:
+        value = s->mcrs;
+        break;
+    case A_FMU_MCRE:
+        value = 0;
+        break;
+    case A_FMU_CTL:
+        value = s->ctl;
+        break;
+    case A_FMU_ADR:
+    case A_FMU_PEADR:
+        value = s->peadr;
+        break;
+    case FMU_DATA_BASE_ADDR ... FMU_DATA_BASE_ADDR + 4 * FMU_DATA_NUM - 1:
+        value = s->data[(offset - FMU_DATA_BASE_ADDR) / 4];
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+
+    trace_nxps32k358_fmu_read(offset, value);
+    return value;
+}
+
+/**
+ * @brief Writes a register of the FMU.
+ *
+ * PEADR and the DATA registers cannot be written while an operation is
+ * running. ADR, the address of the last operation, mirrors PEADR.
+ *
+ * @param opaque Pointer to the NXPS32K358FMUState structure.
+ * @param offset Offset of the register to write.
+ * @param value Value to write.
+ * @param size Size of the write operation (always 4).
+ */
+static void nxps32k358_fmu_write(void *opaque, hwaddr offset, uint64_t value,
+                                 unsigned size) {
+    NXPS32K358FMUState *s = opaque;
+    bool busy = !FIELD_EX32(s->mcrs, FMU_MCRS, DONE);
+
+    trace_nxps32k358_fmu_write(offset, value);
+
+    switch (offset) {
+    case A_FMU_MCR:
+        nxps32k358_fmu_write_mcr(s, value);
+        return;
+    case A_FMU_MCRS:
+    case A_FMU_MCRE:
+    case A_FMU_ADR:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Read-only offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return;
+    case A_FMU_CTL:
+        s->ctl = value;
+        return;
+    case A_FMU_PEADR:
+        if (!busy && !FIELD_EX32(s->mcr, FMU_MCR, EHV)) {
+            s->peadr = value;
+        }
+        return;
+    case FMU_DATA_BASE_ADDR ... FMU_DATA_BASE_ADDR + 4 * FMU_DATA_NUM - 1:
+        if (!busy && !FIELD_EX32(s->mcr, FMU_MCR, EHV)) {
+            int n = (offset - FMU_DATA_BASE_ADDR) / 4;
+
+            s->data[n] = value;
+            s->data_written |= 1U << n;
+        }
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+    }
+}
+
+static const MemoryRegionOps nxps32k358_fmu_ops = {
+    .read = nxps32k358_fmu_read,
+    .write = nxps32k358_fmu_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl.min_access_size = 4,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+/**
+ * @brief Reads the data flash array.
+ *
+ * The array stays in ROMD mode, so reads normally never get here.
+ *
+ * @param opaque Pointer to the NXPS32K358FMUState structure.
+ * @param offset Offset in the data flash.
+ * @param size Size of the read operation.
+ * @return The value read.
+ */
+static uint64_t nxps32k358_fmu_flash_read(void *opaque, hwaddr offset,
+                                          unsigned size) {
+    NXPS32K358FMUState *s = opaque;
+
+    return ldn_le_p(s->storage + offset, size);
+}
+
+/**
+ * @brief Traps a direct write to the data flash array, which can only be
+ * modified through the FMU.
+ *
+ * @param opaque Pointer to the NXPS32K358FMUState structure.
+ * @param offset Offset in the data flash.
+ * @param value Value to write.
+ * @param size Size of the write operation.
+ */
+static void nxps32k358_fmu_flash_write(void *opaque, hwaddr offset,
+                                       uint64_t value, unsigned size) {
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: Write to data flash offset 0x%"
+                  HWADDR_PRIx ", use the FMU\n", __func__, offset);
+}
+
+static const MemoryRegionOps nxps32k358_fmu_flash_ops = {
+    .read = nxps32k358_fmu_flash_read,
+    .write = nxps32k358_fmu_flash_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 1,
+    .valid.max_access_size = 4,
+};
+
+/**
+ * @brief Initialize the NXP S32K358 FMU.
+ *
+ * This function sets up the memory-mapped I/O region of the FMU registers.
+ *
+ * @param obj Pointer to the Object structure.
+ */
+static void nxps32k358_fmu_init(Object *obj) {
+    NXPS32K358FMUState *s = NXPS32K358_FMU(obj);
+
+    memory_region_init_io(&s->mmio, obj, &nxps32k358_fmu_ops, s,
+                          TYPE_NXPS32K358_FMU, 0x4000);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+}
+
+/**
+ * @brief Realize the NXP S32K358 FMU.
+ *
+ * This function creates the data flash array, a ROM device exported as the
+ * second memory-mapped region of the FMU. The array is loaded from the block
+ * backend if there is one (taking write permission on it if possible), or
+ * filled as erased (0xFF) otherwise. It also creates the timer of the timed
+ * operations.
+ *
+ * @param dev Pointer to the DeviceState structure.
+ * @param errp Pointer to an error object.
+ */
+static void nxps32k358_fmu_realize(DeviceState *dev, Error **errp) {
+    NXPS32K358FMUState *s = NXPS32K358_FMU(dev);
+
+    if (!s->code_flash_block_size ||
+        s->code_flash_size % s->code_flash_block_size ||
+        s->code_flash_block_size % FMU_SECTOR_SIZE ||
+        s->data_flash_size % FMU_SECTOR_SIZE) {
+        error_setg(errp, "flash sizes must be multiples of the sector size");
+        return;
+    }
+
+    if (!memory_region_init_rom_device(&s->data_flash, OBJECT(dev),
+                                       &nxps32k358_fmu_flash_ops, s,
+                                       "NXPS32K358.data_flash",
+                                       s->data_flash_size, errp)) {
+        return;
+    }
+    s->storage = memory_region_get_ram_ptr(&s->data_flash);
+    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->data_flash);
+
+    if (s->blk) {
+        uint64_t perm;
+
+        s->blk_ro = !blk_supports_write_perm(s->blk);
+        perm = BLK_PERM_CONSISTENT_READ | (s->blk_ro ? 0 : BLK_PERM_WRITE);
+        if (blk_set_perm(s->blk, perm, BLK_PERM_ALL, errp) < 0) {
+            return;
+        }
+        if (!blk_check_size_and_read_all(s->blk, dev, s->storage,
+                                         s->data_flash_size, errp)) {
+            return;
+        }
+    } else {
+        memset(s->storage, 0xFF, s->data_flash_size);
+    }
+
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nxps32k358_fmu_timer_cb, s);
+}
+
+/**
+ * @brief Unrealize the NXP S32K358 FMU, freeing its timer.
+ *
+ * @param dev Pointer to the DeviceState structure.
+ */
+static void nxps32k358_fmu_unrealize(DeviceState *dev) {
+    NXPS32K358FMUState *s = NXPS32K358_FMU(dev);
+
+    timer_free(s->timer);
+}
+
+/**
+ * @brief Reset the NXP S32K358 FMU.
+ *
+ * A running operation is abandoned, leaving the flash untouched. The flash
+ * contents are kept.
+ *
+ * @param dev Pointer to the DeviceState structure.
+ */
+static void nxps32k358_fmu_reset(DeviceState *dev) {
+    NXPS32K358FMUState *s = NXPS32K358_FMU(dev);
+
+    timer_del(s->timer);
+    s->mcr = FMU_MCR_RESET;
+    s->mcrs = FMU_MCRS_RESET;
+    s->ctl = 0;
+    s->peadr = 0;
+    memset(s->data, 0, sizeof(s->data));
+    s->data_written = 0;
+}
+
+static Property nxps32k358_fmu_properties[] = {
+    DEFINE_PROP_DRIVE("drive", NXPS32K358FMUState, blk),
+    DEFINE_PROP_BOOL("timed", NXPS32K358FMUState, timed, false),
+    DEFINE_PROP_UINT32("code-flash-base", NXPS32K358FMUState, code_flash_base,
+                       0),
+    DEFINE_PROP_UINT32("code-flash-size", NXPS32K358FMUState, code_flash_size,
+                       0),
+    DEFINE_PROP_UINT32("code-flash-block-size", NXPS32K358FMUState,
+                       code_flash_block_size, 0),
+    DEFINE_PROP_UINT32("data-flash-base", NXPS32K358FMUState, data_flash_base,
+                       0),
+    DEFINE_PROP_UINT32("data-flash-size", NXPS32K358FMUState, data_flash_size,
+                       0),
+    DEFINE_PROP_BOOL("code-flash-readonly", NXPS32K358FMUState,
+                     code_flash_readonly, false),
+    DEFINE_PROP_BOOL("data-flash-readonly", NXPS32K358FMUState,
+                     data_flash_readonly, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void nxps32k358_fmu_class_init(ObjectClass *klass, void *data) {
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    device_class_set_legacy_reset(dc, nxps32k358_fmu_reset);
+    device_class_set_props(dc, nxps32k358_fmu_properties);
+    dc->realize = nxps32k358_fmu_realize;
+    dc->unrealize = nxps32k358_fmu_unrealize;
+}
+
+static const TypeInfo nxps32k358_fmu_info = {
+    .name = TYPE_NXPS32K358_FMU,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(NXPS32K358FMUState),
+    .class_init = nxps32k358_fmu_class_init,
+    .instance_init = nxps32k358_fmu_init,
+};
+
+static void nxps32k358_fmu_register_types(void) {
+    type_register_static(&nxps32k358_fmu_info);
+}
+
+type_init(nxps32k358_fmu_register_types)
@@ -32,281 +32,1359 @@
 #include "hw/irq.h"
 #include "chardev/char-serial.h"
 #include "qapi/error.h"
+#include "qapi/qapi-builtin-visit.h"
+#include "qapi/visitor.h"
 #include "hw/qdev-clock.h"
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "sysemu/stats.h"
+#include "trace.h"
 
-// If NXP_LPUART_DEBUG is 0, no debug messages will be printed
-// If it is 1, only write logs will be printed
-// If it is 2, read and write logs will be printed
-#ifndef NXP_LPUART_DEBUG
-#define NXP_LPUART_DEBUG 0
-#endif
+// Writable bits of FIFO: RXFE, TXFE, RXUFE, TXOFE and RXIDEN
+#define FIFO_WR_MASK 0x00001F88
 
-#define DB_PRINT_L(lvl, fmt, args...)               \
-    do {                                            \
-        if (NXP_LPUART_DEBUG >= lvl) {              \
-            qemu_log("%s: " fmt, __func__, ##args); \
-        }                                           \
-    } while (0)
+// Write 1 to clear bits of FIFO: RXUF and TXOF
+#define FIFO_W1C_MASK 0x00030000
 
-#define DB_PRINT(fmt, args...) DB_PRINT_L(1, fmt, ##args)
-#define DB_PRINT_READ(fmt, args...) DB_PRINT_L(2, fmt, ##args)
+// Writable bits of WATER: TXWATER and RXWATER
+#define WATER_WR_MASK 0x000F000F
+
+// Write 1 to clear bits of STAT: LBKDIF, RXEDGIF, IDLE, OR, NF, FE, PF, MA1F
+// and MA2F
+#define STAT_W1C_MASK 0xC01FC000
+
+// Writable bits of STAT: MSBF, RXINV, RWUID, BRK13 and LBKDE
+#define STAT_WR_MASK 0x3E000000
+
+// Writable bits of MATCH: MA1 and MA2
+#define MATCH_WR_MASK 0x03FF03FF
+
+// Writable bits of MODIR: TXCTSE, TXRTSE, TXRTSPOL, RXRTSE, TXCTSC, TXCTSSRC,
+// RTSWATER, TNP and IREN
+#define MODIR_WR_MASK 0x00070F3F
+
+// Writable bits of MCR: CTS, DSR, RIN and DCD (interrupt enables of MSR), DTR
+// and RTS
+#define MCR_WR_MASK 0x0000030F
+
+// Interval at which a transmitter waiting for CTS checks the line again
+#define CTS_POLL_NS (100 * SCALE_US)
+
+// Writable bits of TOCR: TOEN and TOIE
+#define TOCR_WR_MASK 0x00000F0F
+
+// Writable bits of TIMEOUT[n]: VALUE and CFG
+#define TIMEOUT_WR_MASK 0xC0003FFF
+
+// Events tracked while the receiver is idle: the four timeouts, the idle line
+// detection and the receive idle empty of the FIFO
+#define IDLE_EV_TIMEOUT(n) (1U << (n))
+#define IDLE_EV_IDLE (1U << LPUART_TIMEOUT_NUM)
+#define IDLE_EV_RXIDEN (2U << LPUART_TIMEOUT_NUM)
+
+/**
+ * @brief Get the depth of the receive buffer.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return The size of the receive FIFO reported by PARAM if the FIFO is
+ * enabled (FIFO[RXFE]), 1 otherwise.
+ */
+static uint32_t nxps32k358_lpuart_rx_depth(NXPS32K358LPUartState *s) {
+    if (s->regs[R_FIFO] & R_FIFO_RXFE_MASK) {
+        return 1 << FIELD_EX32(s->regs[R_PARAM], PARAM, RXFIFO);
+    }
+    return 1;
+}
+
+/**
+ * @brief Get the depth of the transmit buffer.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return The size of the transmit FIFO reported by PARAM if the FIFO is
+ * enabled (FIFO[TXFE]), 1 otherwise.
+ */
+static uint32_t nxps32k358_lpuart_tx_depth(NXPS32K358LPUartState *s) {
+    if (s->regs[R_FIFO] & R_FIFO_TXFE_MASK) {
+        return 1 << FIELD_EX32(s->regs[R_PARAM], PARAM, TXFIFO);
+    }
+    return 1;
+}
+
+/**
+ * @brief Compute the duration of a number of bit periods on the line.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @param bits The number of bit periods.
+ * @return The duration in nanoseconds, 0 if the baud rate is 0.
+ */
+static int64_t nxps32k358_lpuart_bits_ns(NXPS32K358LPUartState *s,
+                                         uint32_t bits) {
+    uint32_t baud = LPUART_BAUD_RATE(s);
+
+    if (baud == 0) {
+        return 0;
+    }
+    return muldiv64(bits, NANOSECONDS_PER_SECOND, baud);
+}
+
+/**
+ * @brief Compute the number of bits of a character frame.
+ *
+ * A frame is made of a start bit, the data bits (7, 8, 9 or 10 depending on
+ * CONTROL[M7], CONTROL[M] and BAUD[M10]; with CONTROL[PE] set the parity bit
+ * is the most significant of them) and one or two stop bits (BAUD[SBNS]).
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return The number of bits of a frame.
+ */
+static uint32_t nxps32k358_lpuart_frame_bits(NXPS32K358LPUartState *s) {
+    uint32_t bits = 8;
+
+    if (s->regs[R_BAUD] & R_BAUD_M10_MASK) {
+        bits = 10;
+    } else if (s->regs[R_CONTROL] & R_CONTROL_M_MASK) {
+        bits = 9;
+    } else if (s->regs[R_CONTROL] & R_CONTROL_M7_MASK) {
+        bits = 7;
+    }
+    return bits + 1 + ((s->regs[R_BAUD] & R_BAUD_SBNS_MASK) ? 2 : 1);
+}
+
+/**
+ * @brief Compute the time taken by a character on the line.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return The frame time in nanoseconds, 0 if characters take no time: in
+ * turbo mode, or if the baud rate is 0.
+ */
+static int64_t nxps32k358_lpuart_frame_ns(NXPS32K358LPUartState *s) {
+    int64_t ns;
+
+    if (!s->paced) {
+        return 0;
+    }
+
+    ns = nxps32k358_lpuart_bits_ns(s, nxps32k358_lpuart_frame_bits(s));
+    return LPUART_BAUD_RATE(s) ? MAX(ns, 1) : 0;
+}
+
+/**
+ * @brief Check whether the clock of the LPUART is gated.
+ *
+ * A gated LPUART is frozen: its transmitter and receiver stop and none of
+ * its timers runs until the clock comes back.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return true if the clock is stopped.
+ */
+static bool nxps32k358_lpuart_gated(NXPS32K358LPUartState *s) {
+    return !clock_is_enabled(s->clk);
+}
+
+/**
+ * @brief Compute the state of the RTS output.
+ *
+ * With MODIR[RXRTSE] set the receiver drives RTS: it is deasserted while the
+ * receive buffer holds RTSWATER words or more, or while it is full if the
+ * FIFO is disabled or RTSWATER is 0. Otherwise RTS follows MCR[RTS].
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return true if RTS is asserted.
+ */
+static bool nxps32k358_lpuart_rts(NXPS32K358LPUartState *s) {
+    uint32_t depth = nxps32k358_lpuart_rx_depth(s);
+    uint32_t water = FIELD_EX32(s->regs[R_MODIR], MODIR, RTSWATER);
+
+    if (!(s->regs[R_MODIR] & R_MODIR_RXRTSE_MASK)) {
+        return s->regs[R_MCR] & R_MCR_RTS_MASK;
+    }
+    if (!(s->regs[R_FIFO] & R_FIFO_RXFE_MASK) || water == 0 || water > depth) {
+        water = depth;
+    }
+    return fifo8_num_used(&s->rx_fifo) < water;
+}
+
+/**
+ * @brief Propagate the RTS and DTR outputs to the character backend.
+ *
+ * The backend is only told about actual changes of the lines, so that the
+ * modem ioctls are not issued for every character. The lines of the host are
+ * left alone after reset until the firmware enables modem control, setting
+ * MODIR[RXRTSE], MCR[RTS] or MCR[DTR]. A port linked to a peer has no backend:
+ * the peer samples the lines directly.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_update_tiocm(NXPS32K358LPUartState *s) {
+    int tiocm = 0;
+    int flags;
+
+    if (s->tiocm < 0 && !(s->regs[R_MODIR] & R_MODIR_RXRTSE_MASK) &&
+        !(s->regs[R_MCR] & (R_MCR_RTS_MASK | R_MCR_DTR_MASK))) {
+        return;
+    }
+
+    if (nxps32k358_lpuart_rts(s)) {
+        tiocm |= CHR_TIOCM_RTS;
+    }
+    if (s->regs[R_MCR] & R_MCR_DTR_MASK) {
+        tiocm |= CHR_TIOCM_DTR;
+    }
+    if (tiocm == s->tiocm) {
+        return;
+    }
+    s->tiocm = tiocm;
+
+    if (s->peer ||
+        qemu_chr_fe_ioctl(&s->chr, CHR_IOCTL_SERIAL_GET_TIOCM, &flags) < 0) {
+        return;
+    }
+    flags &= ~(CHR_TIOCM_RTS | CHR_TIOCM_DTR);
+    flags |= tiocm;
+    qemu_chr_fe_ioctl(&s->chr, CHR_IOCTL_SERIAL_SET_TIOCM, &flags);
+}
+
+/**
+ * @brief Update the flags derived from the fill level of the buffers.
+ *
+ * The flags follow the watermark rules of the LPUART:
+ * - STAT[RDRF] is set while the receive buffer holds more than RXWATER words,
+ *   or while it is not empty and the receiver is idle (FIFO[RXIDEN]);
+ * - STAT[TDRE] is set while the transmit buffer holds at most TXWATER words;
+ * - STAT[TC] is set while the transmit buffer and shifter are empty;
+ * - FIFO[RXEMPT] and FIFO[TXEMPT] are set while the buffers are empty.
+ * The watermarks are only used while the FIFOs are enabled, and they are
+ * capped to the FIFO depth minus one. The RTS output, which may follow the
+ * receive buffer too, is updated as well.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_update_stat(NXPS32K358LPUartState *s) {
+    uint32_t rx = fifo8_num_used(&s->rx_fifo);
+    uint32_t tx = fifo8_num_used(&s->tx_fifo);
+    uint32_t rxwater = MIN(FIELD_EX32(s->regs[R_WATER], WATER, RXWATER),
+                           nxps32k358_lpuart_rx_depth(s) - 1);
+    uint32_t txwater = MIN(FIELD_EX32(s->regs[R_WATER], WATER, TXWATER),
+                           nxps32k358_lpuart_tx_depth(s) - 1);
+
+    s->regs[R_STAT] &=
+        ~(R_STAT_RDRF_MASK | R_STAT_TDRE_MASK | R_STAT_TC_MASK);
+    s->regs[R_FIFO] &= ~(R_FIFO_RXEMPT_MASK | R_FIFO_TXEMPT_MASK);
+
+    if (rx > rxwater || (s->rx_idle && rx > 0)) {
+        s->regs[R_STAT] |= R_STAT_RDRF_MASK;
+    }
+    if (tx <= txwater) {
+        s->regs[R_STAT] |= R_STAT_TDRE_MASK;
+    }
+    if (tx == 0) {
+        s->regs[R_FIFO] |= R_FIFO_TXEMPT_MASK;
+        if (!timer_pending(s->tx_timer)) {
+            s->regs[R_STAT] |= R_STAT_TC_MASK;
+        }
+    }
+    if (rx == 0) {
+        s->regs[R_FIFO] |= R_FIFO_RXEMPT_MASK;
+    }
+
+    nxps32k358_lpuart_update_tiocm(s);
+}
+
+/**
+ * @brief Check if the LPUART can receive data.
+ *
+ * In turbo mode the free space of the receive buffer is advertised, so that
+ * the character backend can hand over whole bursts of data in a single call.
+ * In paced mode a single character is accepted per frame time, once the
+ * receive shifter is empty. Nothing is accepted while the clock is gated.
+ *
+ * @param opaque Pointer to the NXPS32K358LPUartState structure.
+ * @return The number of bytes the LPUART can receive.
+ */
+static int nxps32k358_lpuart_can_receive(void *opaque) {
+    NXPS32K358LPUartState *s = opaque;
+    int free = nxps32k358_lpuart_rx_depth(s) - fifo8_num_used(&s->rx_fifo);
+
+    if (nxps32k358_lpuart_gated(s)) {
+        return 0;
+    }
+    if (nxps32k358_lpuart_frame_ns(s)) {
+        return timer_pending(s->rx_timer) ? 0 : MIN(free, 1);
+    }
+    return free;
+}
+
+/**
+ * @brief Update the interrupt request (IRQ) status for the NXPS32K358 LPUART.
+ *
+ * This function checks the status and control registers of the LPUART to
+ * determine if an interrupt should be triggered. It sets or clears the IRQ
+ * based on the result of this check. The buffer underflow and overflow flags
+ * of the FIFO register are enabled by the FIFO register itself, the timeout
+ * flags by TOCR[TOIE] and the framing error flag by CONTROL[FEIE].
+ *
+ * The DMA request lines follow the same flags: the receiver requests a
+ * transfer while STAT[RDRF] is set and BAUD[RDMAE] is enabled, the
+ * transmitter while STAT[TDRE] is set and BAUD[TDMAE] is enabled. Since the
+ * flags follow the watermarks, a DMA channel servicing the LPUART moves data
+ * until the FIFO crosses the watermark again.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure containing the
+ *          LPUART state.
+ */
+static void nxps32k358_lpuart_update_irq(NXPS32K358LPUartState *s) {
+    uint32_t mask = s->regs[R_STAT] & s->regs[R_CONTROL];
+    bool fifo_irq = ((s->regs[R_FIFO] & R_FIFO_RXUF_MASK) &&
+                     (s->regs[R_FIFO] & R_FIFO_RXUFE_MASK)) ||
+                    ((s->regs[R_FIFO] & R_FIFO_TXOF_MASK) &&
+                     (s->regs[R_FIFO] & R_FIFO_TXOFE_MASK));
+    bool timeout_irq = FIELD_EX32(s->regs[R_TOSR], TOSR, TOF) &
+                       FIELD_EX32(s->regs[R_TOCR], TOCR, TOIE);
+    bool error_irq = (s->regs[R_STAT] & R_STAT_FE_MASK) &&
+                     (s->regs[R_CONTROL] & R_CONTROL_FEIE_MASK);
+
+    bool level = fifo_irq || timeout_irq || error_irq ||
+                 (mask & (R_CONTROL_TIE_MASK | R_CONTROL_TCIE_MASK |
+                          R_CONTROL_RIE_MASK | R_CONTROL_ILIE_MASK |
+                          R_CONTROL_MA1IE_MASK | R_CONTROL_MA2IE_MASK));
+
+    if (level != s->irq_level) {
+        trace_nxps32k358_lpuart_irq(s->lpuart_port, level);
+        s->irq_level = level;
+        s->stats.irqs += level;
+    }
+    qemu_set_irq(s->irq, level);
+
+    qemu_set_irq(s->dma_rx_req, (s->regs[R_BAUD] & R_BAUD_RDMAE_MASK) &&
+                                (s->regs[R_STAT] & R_STAT_RDRF_MASK));
+    qemu_set_irq(s->dma_tx_req, (s->regs[R_BAUD] & R_BAUD_TDMAE_MASK) &&
+                                (s->regs[R_STAT] & R_STAT_TDRE_MASK));
+}
+
+/**
+ * @brief Compute the virtual time of an idle line or timeout event.
+ *
+ * The receiver must stay idle, counting from the end of the last character:
+ * - 2^IDLECFG characters for the idle line flag (STAT[IDLE]);
+ * - 2^(RXIDEN - 1) characters for the receive idle empty (FIFO[RXIDEN]);
+ * - VALUE bit periods for the timeout n (TIMEOUT[n]).
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @param ev The event, one of the IDLE_EV_* bits.
+ * @return The virtual time of the event, in nanoseconds.
+ */
+static int64_t nxps32k358_lpuart_idle_deadline(NXPS32K358LPUartState *s,
+                                               uint32_t ev) {
+    uint32_t bits = nxps32k358_lpuart_frame_bits(s);
+
+    if (ev == IDLE_EV_IDLE) {
+        bits <<= FIELD_EX32(s->regs[R_CONTROL], CONTROL, IDLECFG);
+    } else if (ev == IDLE_EV_RXIDEN) {
+        uint32_t rxiden = FIELD_EX32(s->regs[R_FIFO], FIFO, RXIDEN);
+        bits <<= rxiden ? rxiden - 1 : 0;
+    } else {
+        bits = FIELD_EX32(s->regs[R_TIMEOUT(ctz32(ev))], TIMEOUT, VALUE);
+    }
+
+    return s->last_rx_ns + nxps32k358_lpuart_bits_ns(s, bits);
+}
+
+/**
+ * @brief Arm the idle timer for the first pending idle line or timeout
+ * event.
+ *
+ * While the clock is gated the events stay pending, without a timer.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_idle_schedule(NXPS32K358LPUartState *s) {
+    int64_t next = INT64_MAX;
+
+    for (uint32_t p = s->idle_pending; p; p &= p - 1) {
+        next = MIN(next, nxps32k358_lpuart_idle_deadline(s, p & -p));
+    }
+
+    if (s->idle_pending && !nxps32k358_lpuart_gated(s)) {
+        timer_mod(s->idle_timer, next);
+    } else {
+        timer_del(s->idle_timer);
+    }
+}
+
+/**
+ * @brief Idle timer callback, raising the idle line and timeout events
+ * whose time has come.
+ *
+ * @param opaque Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_idle_timer_cb(void *opaque) {
+    NXPS32K358LPUartState *s = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    for (uint32_t p = s->idle_pending; p; p &= p - 1) {
+        uint32_t ev = p & -p;
+
+        if (nxps32k358_lpuart_idle_deadline(s, ev) > now) {
+            continue;
+        }
+        s->idle_pending &= ~ev;
+
+        if (ev == IDLE_EV_IDLE) {
+            s->regs[R_STAT] |= R_STAT_IDLE_MASK;
+            // An idle line wakes up the receiver in idle line wakeup mode
+            if (!(s->regs[R_CONTROL] & R_CONTROL_WAKE_MASK)) {
+                s->regs[R_CONTROL] &= ~R_CONTROL_RWU_MASK;
+            }
+        } else if (ev == IDLE_EV_RXIDEN) {
+            s->rx_idle = true;
+        } else {
+            s->regs[R_TOSR] |= ev << R_TOSR_TOF_SHIFT;
+            s->regs[R_TOSR] |= ev << R_TOSR_TOZ_SHIFT;
+        }
+    }
+
+    nxps32k358_lpuart_update_stat(s);
+    nxps32k358_lpuart_update_irq(s);
+    nxps32k358_lpuart_idle_schedule(s);
+}
+
+/**
+ * @brief Restart the idle line detection and the timeouts after a character
+ * is received.
+ *
+ * The idle line flag can only be set again after a new character, while the
+ * timeouts enabled in TOCR restart their counter (TOSR[TOZ] is cleared).
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_rx_activity(NXPS32K358LPUartState *s) {
+    uint32_t toen = FIELD_EX32(s->regs[R_TOCR], TOCR, TOEN);
+
+    s->last_rx_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->rx_idle = false;
+
+    s->idle_pending = IDLE_EV_IDLE | toen;
+    if (FIELD_EX32(s->regs[R_FIFO], FIFO, RXIDEN)) {
+        s->idle_pending |= IDLE_EV_RXIDEN;
+    }
+    s->regs[R_TOSR] &= ~(toen << R_TOSR_TOZ_SHIFT);
+
+    nxps32k358_lpuart_idle_schedule(s);
+}
+
+/**
+ * @brief Tell the sources of received data that the receive buffer or
+ * shifter may have room again.
+ *
+ * The character backend is polled through nxps32k358_lpuart_can_receive(),
+ * while a peer whose transmitter is blocked on this port is restarted.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_accept_input(NXPS32K358LPUartState *s);
+
+/**
+ * @brief Apply the address matching and the receiver wakeup to a received
+ * character.
+ *
+ * A character is an address when its most significant data bit (the address
+ * mark) is set. With BAUD[MAEN1] or BAUD[MAEN2] set in address match wakeup
+ * mode (BAUD[MATCFG] = 0), address characters are compared with MATCH[MA1]
+ * and MATCH[MA2]: a match sets STAT[MA1F] or STAT[MA2F], a mismatch discards
+ * the character. With CONTROL[RWU] set the receiver is in standby and
+ * discards every character until it is woken up, by an accepted address
+ * character if CONTROL[WAKE] = 1 or by an idle line if CONTROL[WAKE] = 0;
+ * the wakeup clears CONTROL[RWU]. Frames addressed to other nodes thus never
+ * reach the receive buffer nor raise interrupts.
+ *
+ * The other match configurations are not modelled: MATCH is ignored.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @param c The received character.
+ * @return true if the character is to be stored in the receive buffer.
+ */
+static bool nxps32k358_lpuart_rx_filter(NXPS32K358LPUartState *s,
+                                        uint8_t c) {
+    uint32_t mark = (s->regs[R_CONTROL] & R_CONTROL_M7_MASK) ? 0x40 : 0x80;
+    uint32_t data = c & (2 * mark - 1);
+    bool standby = s->regs[R_CONTROL] & R_CONTROL_RWU_MASK;
+    bool maen1 = s->regs[R_BAUD] & R_BAUD_MAEN1_MASK;
+    bool maen2 = s->regs[R_BAUD] & R_BAUD_MAEN2_MASK;
+
+    if (!(data & mark)) {
+        s->stats.rx_drops += standby;
+        return !standby;
+    }
+    if (standby && !(s->regs[R_CONTROL] & R_CONTROL_WAKE_MASK)) {
+        s->stats.rx_drops++;
+        return false;
+    }
+
+    if ((maen1 || maen2) && FIELD_EX32(s->regs[R_BAUD], BAUD, MATCFG) == 0) {
+        bool ma1 = maen1 && data == FIELD_EX32(s->regs[R_MATCH], MATCH, MA1);
+        bool ma2 = maen2 && data == FIELD_EX32(s->regs[R_MATCH], MATCH, MA2);
+
+        if (ma1) {
+            s->regs[R_STAT] |= R_STAT_MA1F_MASK;
+        }
+        if (ma2) {
+            s->regs[R_STAT] |= R_STAT_MA2F_MASK;
+        }
+        s->rx_match = ma1 || ma2;
+        if (!s->rx_match) {
+            s->stats.rx_drops++;
+            return false;
+        }
+    }
+
+    s->regs[R_CONTROL] &= ~R_CONTROL_RWU_MASK;
+    return true;
+}
+
+/**
+ * @brief Handles the reception of data for the NXP S32K358 LPUART.
+ *
+ * @param opaque A pointer to the opaque state structure for the LPUART.
+ * @param buf A pointer to the buffer containing the data to be received.
+ * @param size The size of the data buffer.
+ *
+ * This function processes incoming data for the LPUART. If the read
+ * operation is not enabled (as indicated by the R_CONTROL_RE_MASK bit
+ * in the control register), the data is dropped and a debug message is
+ * printed. Otherwise, the data accepted by the address matching
+ * (nxps32k358_lpuart_rx_filter()) is pushed into the receive buffer, the flags
+ * are updated following the receive watermark, and an interrupt is triggered
+ * if necessary. Data not fitting in the buffer is dropped and reported as an
+ * overrun (STAT[OR]). The end of the batch restarts the idle line detection
+ * and the receive timeouts.
+ *
+ * In paced mode the character is first held in the receive shifter, and
+ * reaches the buffer when its frame time has elapsed (see
+ * nxps32k358_lpuart_rx_timer_cb()).
+ */
+static void nxps32k358_lpuart_receive(void *opaque, const uint8_t *buf,
+                                      int size) {
+    NXPS32K358LPUartState *s = opaque;
+    int64_t frame_ns = nxps32k358_lpuart_frame_ns(s);
+
+    trace_nxps32k358_lpuart_receive(s->lpuart_port, size);
+
+    if (!(s->regs[R_CONTROL] & R_CONTROL_RE_MASK)) {
+        /* Read not enabled - drop the chars */
+        trace_nxps32k358_lpuart_rx_disabled(s->lpuart_port, size);
+        s->stats.rx_drops += size;
+        return;
+    }
+
+    if (frame_ns && size > 0) {
+        s->rx_shift = *buf;
+        timer_mod(s->rx_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + frame_ns);
+        return;
+    }
+
+    for (int i = 0; i < size; i++) {
+        if (!nxps32k358_lpuart_rx_filter(s, buf[i])) {
+            continue;
+        }
+        if (fifo8_num_used(&s->rx_fifo) < nxps32k358_lpuart_rx_depth(s)) {
+            fifo8_push(&s->rx_fifo, buf[i]);
+            s->stats.rx_bytes++;
+        } else {
+            s->regs[R_STAT] |= R_STAT_OR_MASK;
+            s->stats.rx_overruns++;
+        }
+    }
+    nxps32k358_lpuart_rx_activity(s);
+
+    nxps32k358_lpuart_update_stat(s);
+    nxps32k358_lpuart_update_irq(s);
+}
+
+/**
+ * @brief Receive timer callback, called when the character in the receive
+ * shifter has been received (paced mode).
+ *
+ * @param opaque Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_rx_timer_cb(void *opaque) {
+    NXPS32K358LPUartState *s = opaque;
+
+    if (!nxps32k358_lpuart_rx_filter(s, s->rx_shift)) {
+        // Discarded by the address matching
+    } else if (fifo8_num_used(&s->rx_fifo) < nxps32k358_lpuart_rx_depth(s)) {
+        fifo8_push(&s->rx_fifo, s->rx_shift);
+        s->stats.rx_bytes++;
+    } else {
+        s->regs[R_STAT] |= R_STAT_OR_MASK;
+        s->stats.rx_overruns++;
+    }
+    nxps32k358_lpuart_rx_activity(s);
+
+    nxps32k358_lpuart_update_stat(s);
+    nxps32k358_lpuart_update_irq(s);
+    // The receive shifter is empty, ready for the next character
+    nxps32k358_lpuart_accept_input(s);
+}
+
+/**
+ * @brief Deliver characters sent by a linked LPUART.
+ *
+ * The receiver takes as many characters as its buffer (turbo mode) or its
+ * shifter (paced mode) can hold, exactly as it does for a character backend.
+ * In paced mode both ports time the character with their own frame time; if
+ * their baud rates differ by more than 5%, the receiver would not sample the
+ * frame correctly and the character is flagged with STAT[FE].
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure of the sender.
+ * @param buf The characters to send.
+ * @param len The number of characters to send.
+ * @return The number of characters accepted by the peer.
+ */
+static int nxps32k358_lpuart_peer_write(NXPS32K358LPUartState *s,
+                                        const uint8_t *buf, int len) {
+    NXPS32K358LPUartState *peer = s->peer;
+    int n = MIN(len, nxps32k358_lpuart_can_receive(peer));
+
+    if (n <= 0) {
+        return 0;
+    }
+
+    if (s->paced && peer->paced &&
+        (peer->regs[R_CONTROL] & R_CONTROL_RE_MASK)) {
+        int64_t tx = LPUART_BAUD_RATE(s);
+        int64_t rx = LPUART_BAUD_RATE(peer);
+
+        if (llabs(tx - rx) * 20 > rx) {
+            peer->regs[R_STAT] |= R_STAT_FE_MASK;
+        }
+    }
+
+    nxps32k358_lpuart_receive(peer, buf, n);
+    return n;
+}
+
+/**
+ * @brief Read the DATA register of the NXP S32K358 LPUART.
+ *
+ * The oldest word of the receive buffer is returned. Reading from an empty
+ * buffer returns the RXEMPT flag and, if the FIFO is enabled, sets the
+ * underflow flag (FIFO[RXUF]).
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @param pop true to remove the word from the buffer (DATA), false to leave
+ * it there (DATARO).
+ * @return The value of the DATA register.
+ */
+static uint32_t nxps32k358_lpuart_read_data(NXPS32K358LPUartState *s,
+                                            bool pop) {
+    if (fifo8_is_empty(&s->rx_fifo)) {
+        if (pop && (s->regs[R_FIFO] & R_FIFO_RXFE_MASK)) {
+            s->regs[R_FIFO] |= R_FIFO_RXUF_MASK;
+            nxps32k358_lpuart_update_irq(s);
+        }
+        return R_DATA_RXEMPT_MASK;
+    }
+
+    uint32_t data = pop ? fifo8_pop(&s->rx_fifo) : fifo8_peek(&s->rx_fifo);
+    if (s->regs[R_CONTROL] & R_CONTROL_M7_MASK) {
+        data &= 0x7F;
+    }
+    if (!pop) {
+        return data;
+    }
+
+    s->regs[R_DATA] = data;
+    trace_nxps32k358_lpuart_data_read(s->lpuart_port, data);
+
+    nxps32k358_lpuart_update_stat(s);
+    nxps32k358_lpuart_accept_input(s);
+    nxps32k358_lpuart_update_irq(s);
+
+    return s->regs[R_DATA];
+}
+
+/**
+ * @brief Check whether the transmitter may start a character.
+ *
+ * With MODIR[TXCTSE] set the transmitter only sends while CTS is asserted.
+ * CTS is the receiver match result if MODIR[TXCTSSRC] is set, otherwise the
+ * RTS output of the peer for a linked port, or the CTS line of the character
+ * backend (always asserted if the backend has no modem lines).
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return true if the transmitter may send.
+ */
+static bool nxps32k358_lpuart_cts(NXPS32K358LPUartState *s) {
+    int tiocm;
+
+    if (!(s->regs[R_MODIR] & R_MODIR_TXCTSE_MASK)) {
+        return true;
+    }
+    if (s->regs[R_MODIR] & R_MODIR_TXCTSSRC_MASK) {
+        return s->rx_match;
+    }
+    if (s->peer) {
+        return nxps32k358_lpuart_rts(s->peer);
+    }
+    if (qemu_chr_fe_ioctl(&s->chr, CHR_IOCTL_SERIAL_GET_TIOCM, &tiocm) < 0) {
+        return true;
+    }
+    return tiocm & CHR_TIOCM_CTS;
+}
+
+/**
+ * @brief Transmit as much of the transmit buffer as the backend accepts.
+ *
+ * The buffer is handed to the character backend with non-blocking writes.
+ * The data not accepted stays in the buffer and a watch on the backend
+ * resumes the transmission when it becomes writable again. Meanwhile TDRE
+ * and TC stay clear, so a slow consumer throttles the firmware instead of
+ * blocking the vCPU. Without a backend, or if the backend cannot be watched,
+ * the buffer is drained instantly.
+ *
+ * A port linked to a peer LPUART hands the buffer to the receiver of the peer
+ * instead; when the peer has no room the transmitter waits, and the peer
+ * restarts it once its receiver is drained (nxps32k358_lpuart_accept_input()).
+ *
+ * While CTS is deasserted (see nxps32k358_lpuart_cts()) nothing is sent: a
+ * port waiting for the RTS of its peer is restarted by the peer, otherwise
+ * the transmit timer checks CTS again after CTS_POLL_NS.
+ *
+ * In paced mode only the first character is sent, and the transmit shifter
+ * stays busy for its frame time: nxps32k358_lpuart_tx_timer_cb() sends the
+ * next one.
+ *
+ * The time spent with data that cannot be sent is accounted in
+ * NXPS32K358LPUartStats::tx_stall_ns.
+ *
+ * This function is also the callback of the watch.
+ *
+ * @param do_not_use Unused.
+ * @param cond Unused.
+ * @param opaque Pointer to the NXPS32K358LPUartState structure.
+ * @return G_SOURCE_REMOVE, as a new watch is added when needed.
+ */
+static gboolean nxps32k358_lpuart_xmit(void *do_not_use, GIOCondition cond,
+                                       void *opaque) {
+    NXPS32K358LPUartState *s = opaque;
+    int64_t frame_ns = nxps32k358_lpuart_frame_ns(s);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    bool stalled = false;
+
+    s->watch_tag = 0;
+    s->peer_blocked = false;
+    if (s->tx_stalled) {
+        s->stats.tx_stall_ns += now - s->tx_stall_start;
+        s->tx_stalled = false;
+    }
+
+    while (!fifo8_is_empty(&s->tx_fifo)) {
+        if (!s->peer && !qemu_chr_fe_backend_connected(&s->chr)) {
+            s->stats.tx_drops += fifo8_num_used(&s->tx_fifo);
+            fifo8_reset(&s->tx_fifo);
+            break;
+        }
+
+        if (!nxps32k358_lpuart_cts(s)) {
+            if (s->peer && !(s->regs[R_MODIR] & R_MODIR_TXCTSSRC_MASK)) {
+                s->peer_blocked = true;
+            } else {
+                timer_mod(s->tx_timer, now + CTS_POLL_NS);
+            }
+            stalled = true;
+            break;
+        }
+
+        uint32_t len;
+        const uint8_t *buf = fifo8_peek_bufptr(
+            &s->tx_fifo, frame_ns ? 1 : fifo8_num_used(&s->tx_fifo), &len);
+        if (s->peer) {
+            int ret = nxps32k358_lpuart_peer_write(s, buf, len);
+            if (ret <= 0) {
+                s->peer_blocked = true;
+                stalled = true;
+                break;
+            }
+            fifo8_drop(&s->tx_fifo, ret);
+            s->stats.tx_bytes += ret;
+            if (frame_ns) {
+                timer_mod(s->tx_timer, now + frame_ns);
+                break;
+            }
+            continue;
+        }
+
+        int ret = qemu_chr_fe_write(&s->chr, buf, len);
+        if (ret <= 0) {
+            s->watch_tag = qemu_chr_fe_add_watch(
+                &s->chr, G_IO_OUT | G_IO_HUP, nxps32k358_lpuart_xmit, s);
+            if (!s->watch_tag) {
+                s->stats.tx_drops += fifo8_num_used(&s->tx_fifo);
+                fifo8_reset(&s->tx_fifo);
+            }
+            stalled = s->watch_tag;
+            break;
+        }
+        fifo8_drop(&s->tx_fifo, ret);
+        s->stats.tx_bytes += ret;
+
+        if (frame_ns) {
+            timer_mod(s->tx_timer, now + frame_ns);
+            break;
+        }
+    }
+
+    if (stalled) {
+        trace_nxps32k358_lpuart_tx_stall(s->lpuart_port,
+                                         fifo8_num_used(&s->tx_fifo));
+        s->tx_stalled = true;
+        s->tx_stall_start = now;
+    }
+
+    nxps32k358_lpuart_update_stat(s);
+    nxps32k358_lpuart_update_irq(s);
+
+    return G_SOURCE_REMOVE;
+}
+
+/**
+ * @brief Start the transmission of the transmit buffer.
+ *
+ * If a watch is pending the backend is not writable yet, if the peer is
+ * blocked its receiver is full, and if the transmit timer is pending the
+ * shifter is busy: the data just queued will be sent by
+ * nxps32k358_lpuart_xmit() together with the rest of the buffer. While the
+ * clock is gated the data waits for the clock to come back.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_tx_drain(NXPS32K358LPUartState *s) {
+    if (s->watch_tag || s->peer_blocked || timer_pending(s->tx_timer) ||
+        nxps32k358_lpuart_gated(s)) {
+        nxps32k358_lpuart_update_stat(s);
+        nxps32k358_lpuart_update_irq(s);
+    } else {
+        nxps32k358_lpuart_xmit(NULL, G_IO_OUT, s);
+    }
+}
+
+/**
+ * @brief Transmit timer callback, called when the character in the transmit
+ * shifter has been sent (paced mode).
+ *
+ * @param opaque Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_tx_timer_cb(void *opaque) {
+    NXPS32K358LPUartState *s = opaque;
+
+    nxps32k358_lpuart_tx_drain(s);
+}
+
+static void nxps32k358_lpuart_accept_input(NXPS32K358LPUartState *s) {
+    qemu_chr_fe_accept_input(&s->chr);
+
+    if (s->peer && s->peer->peer_blocked) {
+        s->peer->peer_blocked = false;
+        nxps32k358_lpuart_tx_drain(s->peer);
+    }
+}
+
+/**
+ * @brief Cancel the pending watch on the character backend, if any.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ */
+static void nxps32k358_lpuart_remove_watch(NXPS32K358LPUartState *s) {
+    if (s->watch_tag) {
+        g_source_remove(s->watch_tag);
+        s->watch_tag = 0;
+    }
+}
 
 /**
- * @brief Check if the LPUART can receive data.
+ * @brief Reset the NXP S32K358 LPUART device state.
  *
- * This function checks the status register of the LPUART to determine if
- * it can receive data.
+ * This function resets all the registers of the NXP S32K358 LPUART device to
+ * the reset values of their access tables, except VERID, PARAM and FIFO whose
+ * reset values depend on the port. Additionally, it updates the IRQ status of
+ * the device after resetting the registers.
  *
- * @param opaque Pointer to the NXPS32K358LPUartState structure.
- * @return 1 if the LPUART can receive data, 0 otherwise.
+ * @param dev Pointer to the DeviceState structure for the LPUART device.
  */
-static int nxps32k358_lpuart_can_receive(void *opaque) {
-    NXPS32K358LPUartState *s = opaque;
+static void nxps32k358_lpuart_reset(DeviceState *dev) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(dev);
 
-    if (s->lpuart_stat & R_STAT_RDRF_MASK) {
-        return 0;
+    // The post-write hooks are not run, unlike register_reset(): they have
+    // side effects on the rest of the device state, reset below
+    for (int i = 0; i < LPUART_R_MAX; i++) {
+        if (s->regs_info[i].access) {
+            s->regs[i] = s->regs_info[i].access->reset;
+        }
     }
+    // The FIFOs, and so the registers describing them, depend on the port
+    s->regs[R_VERID] = LPUART_VERID_RESET(s->lpuart_port);
+    s->regs[R_PARAM] = LPUART_PARAM_RESET(s->lpuart_port);
+    s->regs[R_FIFO] = LPUART_FIFO_RESET(s->lpuart_port);
 
-    return 1;
+    nxps32k358_lpuart_remove_watch(s);
+    timer_del(s->tx_timer);
+    timer_del(s->rx_timer);
+    timer_del(s->idle_timer);
+    s->idle_pending = 0;
+    s->rx_idle = false;
+    s->peer_blocked = false;
+    s->tx_stalled = false;
+    s->rx_match = false;
+    // The modem lines are not driven until the firmware enables them
+    s->tiocm = -1;
+    fifo8_reset(&s->rx_fifo);
+    fifo8_reset(&s->tx_fifo);
+    nxps32k358_lpuart_update_stat(s);
+
+    nxps32k358_lpuart_update_irq(s);
 }
 
 /**
- * @brief Update the interrupt request (IRQ) status for the NXPS32K358 LPUART.
+ * @brief Update the UART parameters for the NXPS32K358 LPUART.
  *
- * This function checks the status and control registers of the LPUART to
- * determine if an interrupt should be triggered. It sets or clears the IRQ
- * based on the result of this check.
+ * This function updates the UART parameters, specifically the baud rate, for
+ * the NXPS32K358 LPUART. It sets the baud rate in the QEMUSerialSetParams
+ * structure and then applies these parameters using the qemu_chr_fe_ioctl
+ * function.
  *
- * @param s Pointer to the NXPS32K358LPUartState structure containing the
- *          LPUART state.
+ * @param s Pointer to the NXPS32K358LPUartState structure.
  */
-static void nxps32k358_lpuart_update_irq(NXPS32K358LPUartState *s) {
-    uint32_t mask = s->lpuart_stat & s->lpuart_control;
+static void nxps32k358_lpuart_update_params(NXPS32K358LPUartState *s) {
+    QEMUSerialSetParams ssp;
+    ssp.speed = LPUART_BAUD_RATE(s);
+    trace_nxps32k358_lpuart_update_params(s->lpuart_port, ssp.speed);
 
-    if (mask &
-        (R_CONTROL_TIE_MASK | R_CONTROL_TCIE_MASK | R_CONTROL_RIE_MASK)) {
-        qemu_set_irq(s->irq, 1);
-    } else {
-        qemu_set_irq(s->irq, 0);
+    if (ssp.speed == 0) {
+        return;
     }
+
+    qemu_chr_fe_ioctl(&s->chr, CHR_IOCTL_SERIAL_SET_PARAMS, &ssp);
 }
 
 /**
- * @brief Handles the reception of data for the NXP S32K358 LPUART.
+ * @brief Clock callback, called when the frequency of the LPUART clock
+ * changes.
  *
- * @param opaque A pointer to the opaque state structure for the LPUART.
- * @param buf A pointer to the buffer containing the data to be received.
- * @param size The size of the data buffer.
+ * When the clock is gated every timer is cancelled and the watch on the
+ * character backend removed, so that a stopped LPUART costs nothing on the
+ * host; a character in the receive shifter is lost. When the clock runs, the
+ * baud rate is applied again and the transmitter, the receiver and the idle
+ * line detection restart where they stopped.
  *
- * This function processes incoming data for the LPUART. If the read
- * operation is not enabled (as indicated by the R_CONTROL_RE_MASK bit
- * in the control register), the data is dropped and a debug message is
- * printed. Otherwise, the data is stored in the lpuart_data register,
- * the RDRF (Receive Data Register Full) flag is set in the status
- * register, and an interrupt is triggered if necessary. A debug message
- * is printed with the received character.
+ * @param opaque Pointer to the NXPS32K358LPUartState structure.
+ * @param event The clock event (always ClockUpdate).
  */
-static void nxps32k358_lpuart_receive(void *opaque, const uint8_t *buf,
-                                      int size) {
+static void nxps32k358_lpuart_clk_update(void *opaque, ClockEvent event) {
     NXPS32K358LPUartState *s = opaque;
 
-    if (!(s->lpuart_control & R_CONTROL_RE_MASK)) {
-        /* Read not enabled - drop the chars */
-        DB_PRINT("Dropping the chars, read is disabled\n");
+    trace_nxps32k358_lpuart_clk_update(s->lpuart_port, clock_get_hz(s->clk));
+
+    if (nxps32k358_lpuart_gated(s)) {
+        if (timer_pending(s->rx_timer)) {
+            timer_del(s->rx_timer);
+            s->stats.rx_drops++;
+        }
+        timer_del(s->tx_timer);
+        timer_del(s->idle_timer);
+        nxps32k358_lpuart_remove_watch(s);
         return;
     }
 
-    s->lpuart_data = *buf;
+    nxps32k358_lpuart_update_params(s);
+    nxps32k358_lpuart_idle_schedule(s);
+    nxps32k358_lpuart_accept_input(s);
+    nxps32k358_lpuart_tx_drain(s);
+}
+
+/**
+ * @brief Read the MSR register of the NXP S32K358 LPUART.
+ *
+ * The state of the modem input lines is sampled from the character backend,
+ * or from the outputs of the peer for a linked port (RTS to CTS, DTR to DSR
+ * and DCD). The change flags are not modelled.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @return The value of the MSR register.
+ */
+static uint32_t nxps32k358_lpuart_read_msr(NXPS32K358LPUartState *s) {
+    uint32_t msr = s->regs[R_MSR];
+    int tiocm = 0;
+
+    if (s->peer) {
+        if (nxps32k358_lpuart_rts(s->peer)) {
+            tiocm |= CHR_TIOCM_CTS;
+        }
+        if (s->peer->regs[R_MCR] & R_MCR_DTR_MASK) {
+            tiocm |= CHR_TIOCM_DSR | CHR_TIOCM_CAR;
+        }
+    } else if (qemu_chr_fe_ioctl(&s->chr, CHR_IOCTL_SERIAL_GET_TIOCM,
+                                 &tiocm) < 0) {
+        tiocm = 0;
+    }
+
+    msr = FIELD_DP32(msr, MSR, CTS, !!(tiocm & CHR_TIOCM_CTS));
+    msr = FIELD_DP32(msr, MSR, DSR, !!(tiocm & CHR_TIOCM_DSR));
+    msr = FIELD_DP32(msr, MSR, RIN, !!(tiocm & CHR_TIOCM_RI));
+    msr = FIELD_DP32(msr, MSR, DCD, !!(tiocm & CHR_TIOCM_CAR));
+    return msr;
+}
+
+/**
+ * @brief Handle writes to the GLOBAL register: writing 1 to RST resets the
+ * device.
+ *
+ * @param reg The GLOBAL register.
+ * @param val The value written.
+ */
+static void nxps32k358_lpuart_global_postw(RegisterInfo *reg, uint64_t val) {
+    if (val & R_GLOBAL_RST_MASK) {
+        nxps32k358_lpuart_reset(DEVICE(reg->opaque));
+    }
+}
 
-    s->lpuart_stat |= R_STAT_RDRF_MASK;
+/**
+ * @brief Handle writes to the BAUD register, which changes the baud rate and
+ * may enable the DMA requests (RDMAE and TDMAE).
+ *
+ * @param reg The BAUD register.
+ * @param val The value written.
+ */
+static void nxps32k358_lpuart_baud_postw(RegisterInfo *reg, uint64_t val) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(reg->opaque);
 
+    nxps32k358_lpuart_update_params(s);
     nxps32k358_lpuart_update_irq(s);
+}
 
-    DB_PRINT("Receiving: %c\n", s->lpuart_data);
+/**
+ * @brief Handle writes to the registers that only affect the interrupt and
+ * DMA request lines: STAT, CONTROL, TOCR and TOSR.
+ *
+ * @param reg The register written.
+ * @param val The value written.
+ */
+static void nxps32k358_lpuart_irq_postw(RegisterInfo *reg, uint64_t val) {
+    nxps32k358_lpuart_update_irq(NXPS32K358_LPUART(reg->opaque));
 }
 
 /**
- * @brief Reset the NXP S32K358 LPUART device state.
+ * @brief Handle writes to the DATA register.
  *
- * This function resets all the registers of the NXP S32K358 LPUART device to
- * their default values. Additionally, it updates the IRQ status of the device
- * after resetting the registers.
+ * The written word is pushed to the transmit buffer, or sets the overflow
+ * flag (FIFO[TXOF]) if the buffer is full. The 9-bit data format is not
+ * supported.
  *
- * @param dev Pointer to the DeviceState structure for the LPUART device.
+ * @param reg The DATA register.
+ * @param val The value written.
+ * @return The current value of the register, which keeps the last word read
+ * from the receive buffer.
  */
-static void nxps32k358_lpuart_reset(DeviceState *dev) {
-    NXPS32K358LPUartState *s = NXPS32K358_LPUART(dev);
+static uint64_t nxps32k358_lpuart_data_prew(RegisterInfo *reg, uint64_t val) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(reg->opaque);
+    uint32_t value = val;
+
+    if (s->regs[R_CONTROL] & R_CONTROL_M_MASK) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: 9-bit data format not supported\n", __func__);
+        return s->regs[R_DATA];
+    }
+    if (s->regs[R_CONTROL] & R_CONTROL_M7_MASK) {
+        value &= 0x7F;
+    }
+    if (fifo8_num_used(&s->tx_fifo) >= nxps32k358_lpuart_tx_depth(s)) {
+        s->regs[R_FIFO] |= R_FIFO_TXOF_MASK;
+        nxps32k358_lpuart_update_irq(s);
+        return s->regs[R_DATA];
+    }
+    trace_nxps32k358_lpuart_data_write(s->lpuart_port, value);
+    fifo8_push(&s->tx_fifo, value);
+    nxps32k358_lpuart_tx_drain(s);
+    return s->regs[R_DATA];
+}
+
+/**
+ * @brief Handle reads of the DATA register, which pop the receive buffer.
+ *
+ * @param reg The DATA register.
+ * @param val The stored value of the register.
+ * @return The oldest word of the receive buffer.
+ */
+static uint64_t nxps32k358_lpuart_data_postr(RegisterInfo *reg, uint64_t val) {
+    return nxps32k358_lpuart_read_data(NXPS32K358_LPUART(reg->opaque), true);
+}
+
+/**
+ * @brief Handle reads of the DATARO register, identical to DATA but without
+ * popping the receive buffer.
+ *
+ * @param reg The DATARO register.
+ * @param val The stored value of the register.
+ * @return The oldest word of the receive buffer.
+ */
+static uint64_t nxps32k358_lpuart_dataro_postr(RegisterInfo *reg,
+                                               uint64_t val) {
+    return nxps32k358_lpuart_read_data(NXPS32K358_LPUART(reg->opaque), false);
+}
+
+/**
+ * @brief Handle writes to the FIFO register.
+ *
+ * Enabling or disabling a FIFO changes the depth of the buffer, so the buffer
+ * is flushed, as it is by writing 1 to RXFLUSH/TXFLUSH. The underflow and
+ * overflow flags are write 1 to clear through the access table.
+ *
+ * @param reg The FIFO register.
+ * @param val The value to be stored.
+ * @return The value to be stored, without the flush bits, which read as 0.
+ */
+static uint64_t nxps32k358_lpuart_fifo_prew(RegisterInfo *reg, uint64_t val) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(reg->opaque);
+    uint32_t changed = s->regs[R_FIFO] ^ val;
 
-    s->lpuart_verid = LPUART_VERID_RESET(s->lpuart_port);
-    s->lpuart_param = LPUART_PARAM_RESET(s->lpuart_port);
-    s->lpuart_global = LPUART_GLOBAL_RESET;
-    s->lpuart_pincfg = LPUART_PINCFG_RESET;
-    s->lpuart_baud = LPUART_BAUD_RESET;
-    s->lpuart_stat = LPUART_STAT_RESET;
-    s->lpuart_control = LPUART_CONTROL_RESET;
-    s->lpuart_data = LPUART_DATA_RESET;
-    s->lpuart_match = LPUART_MATCH_RESET;
-    s->lpuart_modir = LPUART_MODIR_RESET;
-    s->lpuart_fifo = LPUART_FIFO_RESET(s->lpuart_port);
-    s->lpuart_water = LPUART_WATER_RESET;
-    s->lpuart_dataro = LPUART_DATARO_RESET;
-    s->lpuart_mcr = LPUART_MCR_RESET;
-    s->lpuart_msr = LPUART_MSR_RESET;
-    s->lpuart_reir = LPUART_REIR_RESET;
-    s->lpuart_teir = LPUART_TEIR_RESET;
-    s->lpuart_hdcr = LPUART_HDCR_RESET;
-    s->lpuart_tocr = LPUART_TOCR_RESET;
-    s->lpuart_tosr = LPUART_TOSR_RESET;
-    for (int i = 0; i < LPUART_TIMEOUT_NUM; i++) {
-        s->lpuart_timeout[i] = LPUART_TIMEOUT_RESET;
-    }
-    for (int i = 0; i < LPUART_TCBR_NUM; i++) {
-        s->lpuart_tcb[i] = LPUART_TCB_RESET;
-    }
-    for (int i = 0; i < LPUART_TDBR_NUM; i++) {
-        s->lpuart_tdb[i] = LPUART_TDB_RESET;
+    if ((val & R_FIFO_RXFLUSH_MASK) || (changed & R_FIFO_RXFE_MASK)) {
+        fifo8_reset(&s->rx_fifo);
+    }
+    if ((val & R_FIFO_TXFLUSH_MASK) || (changed & R_FIFO_TXFE_MASK)) {
+        fifo8_reset(&s->tx_fifo);
     }
+    return val & ~(R_FIFO_RXFLUSH_MASK | R_FIFO_TXFLUSH_MASK);
+}
+
+/**
+ * @brief Update the flags and the lines after a write to FIFO or WATER.
+ *
+ * @param reg The register written.
+ * @param val The value written.
+ */
+static void nxps32k358_lpuart_fifo_postw(RegisterInfo *reg, uint64_t val) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(reg->opaque);
 
+    nxps32k358_lpuart_update_stat(s);
     nxps32k358_lpuart_update_irq(s);
+    // The receive buffer may have room for more data now
+    nxps32k358_lpuart_accept_input(s);
 }
 
 /**
- * @brief Update the UART parameters for the NXPS32K358 LPUART.
+ * @brief Handle reads of the WATER register, adding the number of words in
+ * the buffers.
  *
- * This function updates the UART parameters, specifically the baud rate, for
- * the NXPS32K358 LPUART. It sets the baud rate in the QEMUSerialSetParams
- * structure and then applies these parameters using the qemu_chr_fe_ioctl
- * function.
+ * @param reg The WATER register.
+ * @param val The stored value of the register.
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_lpuart_water_postr(RegisterInfo *reg, uint64_t val) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(reg->opaque);
+
+    val = FIELD_DP32(val, WATER, TXCOUNT, fifo8_num_used(&s->tx_fifo));
+    return FIELD_DP32(val, WATER, RXCOUNT, fifo8_num_used(&s->rx_fifo));
+}
+
+/**
+ * @brief Handle writes to MODIR and MCR, which drive the modem lines.
+ *
+ * @param reg The register written.
+ * @param val The value written.
+ */
+static void nxps32k358_lpuart_modem_postw(RegisterInfo *reg, uint64_t val) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(reg->opaque);
+
+    nxps32k358_lpuart_update_tiocm(s);
+    // The RTS of the port may have been asserted
+    nxps32k358_lpuart_accept_input(s);
+}
+
+/**
+ * @brief Handle reads of the MSR register, sampling the modem input lines.
+ *
+ * @param reg The MSR register.
+ * @param val The stored value of the register.
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_lpuart_msr_postr(RegisterInfo *reg, uint64_t val) {
+    return nxps32k358_lpuart_read_msr(NXPS32K358_LPUART(reg->opaque));
+}
+
+// Access tables of the single registers. VERID, PARAM and FIFO have no reset
+// value here, since it depends on the port (see nxps32k358_lpuart_reset).
+static const RegisterAccessInfo nxps32k358_lpuart_fixed_regs[] = {
+    { .name = "VERID", .addr = A_VERID, .ro = 0xFFFFFFFF },
+    { .name = "PARAM", .addr = A_PARAM, .ro = 0xFFFFFFFF },
+    { .name = "GLOBAL", .addr = A_GLOBAL,
+      .reset = LPUART_GLOBAL_RESET, .ro = ~R_GLOBAL_RST_MASK,
+      .post_write = nxps32k358_lpuart_global_postw },
+    { .name = "PINCFG", .addr = A_PINCFG, .reset = LPUART_PINCFG_RESET },
+    { .name = "BAUD", .addr = A_BAUD, .reset = LPUART_BAUD_RESET,
+      .post_write = nxps32k358_lpuart_baud_postw },
+    { .name = "STAT", .addr = A_STAT, .reset = LPUART_STAT_RESET,
+      .ro = ~(STAT_WR_MASK | STAT_W1C_MASK), .w1c = STAT_W1C_MASK,
+      .post_write = nxps32k358_lpuart_irq_postw },
+    { .name = "CONTROL", .addr = A_CONTROL, .reset = LPUART_CONTROL_RESET,
+      .post_write = nxps32k358_lpuart_irq_postw },
+    { .name = "DATA", .addr = A_DATA, .reset = LPUART_DATA_RESET,
+      .pre_write = nxps32k358_lpuart_data_prew,
+      .post_read = nxps32k358_lpuart_data_postr },
+    { .name = "MATCH", .addr = A_MATCH, .reset = LPUART_MATCH_RESET,
+      .ro = ~MATCH_WR_MASK },
+    { .name = "MODIR", .addr = A_MODIR, .reset = LPUART_MODIR_RESET,
+      .ro = ~MODIR_WR_MASK, .post_write = nxps32k358_lpuart_modem_postw },
+    { .name = "FIFO", .addr = A_FIFO,
+      .ro = ~(FIFO_WR_MASK | FIFO_W1C_MASK | R_FIFO_RXFLUSH_MASK |
+              R_FIFO_TXFLUSH_MASK),
+      .w1c = FIFO_W1C_MASK,
+      .pre_write = nxps32k358_lpuart_fifo_prew,
+      .post_write = nxps32k358_lpuart_fifo_postw },
+    { .name = "WATER", .addr = A_WATER, .reset = LPUART_WATER_RESET,
+      .ro = ~WATER_WR_MASK, .post_write = nxps32k358_lpuart_fifo_postw,
+      .post_read = nxps32k358_lpuart_water_postr },
+    { .name = "DATARO", .addr = A_DATARO, .reset = LPUART_DATARO_RESET,
+      .ro = 0xFFFFFFFF, .post_read = nxps32k358_lpuart_dataro_postr },
+    { .name = "MCR", .addr = A_MCR, .reset = LPUART_MCR_RESET,
+      .ro = ~MCR_WR_MASK, .post_write = nxps32k358_lpuart_modem_postw },
+    { .name = "MSR", .addr = A_MSR, .reset = LPUART_MSR_RESET,
+      .ro = 0xFFFFFFFF, .post_read = nxps32k358_lpuart_msr_postr },
+    { .name = "REIR", .addr = A_REIR, .reset = LPUART_REIR_RESET },
+    { .name = "TEIR", .addr = A_TEIR, .reset = LPUART_TEIR_RESET },
+    { .name = "HDCR", .addr = A_HDCR, .reset = LPUART_HDCR_RESET },
+    { .name = "TOCR", .addr = A_TOCR, .reset = LPUART_TOCR_RESET,
+      .ro = ~TOCR_WR_MASK, .post_write = nxps32k358_lpuart_irq_postw },
+    // TOF is write 1 to clear, TOZ is read-only
+    { .name = "TOSR", .addr = A_TOSR, .reset = LPUART_TOSR_RESET,
+      .ro = ~R_TOSR_TOF_MASK, .w1c = R_TOSR_TOF_MASK,
+      .post_write = nxps32k358_lpuart_irq_postw },
+};
+
+#define LPUART_NUM_ACCESS                                                     \
+    (ARRAY_SIZE(nxps32k358_lpuart_fixed_regs) + LPUART_TIMEOUT_NUM +          \
+     LPUART_TCBR_NUM + LPUART_TDBR_NUM)
+
+// Access tables of the whole register map, shared by all the instances and
+// generated by nxps32k358_lpuart_build_access()
+static RegisterAccessInfo nxps32k358_lpuart_access[LPUART_NUM_ACCESS];
+
+/**
+ * @brief Generate the access tables of the register map.
+ *
+ * The tables of the single registers are followed by the ones of the
+ * TIMEOUT, TCBR and TDBR arrays, one entry per element.
+ */
+static void nxps32k358_lpuart_build_access(void) {
+    RegisterAccessInfo *ac = nxps32k358_lpuart_access;
+
+    memcpy(ac, nxps32k358_lpuart_fixed_regs,
+           sizeof(nxps32k358_lpuart_fixed_regs));
+    ac += ARRAY_SIZE(nxps32k358_lpuart_fixed_regs);
+
+    for (int i = 0; i < LPUART_TIMEOUT_NUM; i++, ac++) {
+        ac->name = g_strdup_printf("TIMEOUT%d", i);
+        ac->addr = LPUART_TIMEOUT(i);
+        ac->reset = LPUART_TIMEOUT_RESET;
+        ac->ro = ~TIMEOUT_WR_MASK;
+    }
+    for (int i = 0; i < LPUART_TCBR_NUM; i++, ac++) {
+        ac->name = g_strdup_printf("TCBR%d", i);
+        ac->addr = LPUART_TCBR(i);
+        ac->reset = LPUART_TCB_RESET;
+    }
+    for (int i = 0; i < LPUART_TDBR_NUM; i++, ac++) {
+        ac->name = g_strdup_printf("TDBR%d", i);
+        ac->addr = LPUART_TDBR(i);
+        ac->reset = LPUART_TDB_RESET;
+    }
+}
+
+/**
+ * @brief Look up the register at an offset of the LPUART.
+ *
+ * The registers are indexed by offset, so the lookup takes constant time.
  *
  * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @param addr Offset of the access.
+ * @return The register, NULL if no register starts at the offset.
  */
-static void nxps32k358_lpuart_update_params(NXPS32K358LPUartState *s) {
-    QEMUSerialSetParams ssp;
-    ssp.speed = LPUART_BAUD_RATE(s);
-    DB_PRINT("Baud rate: %d\n", ssp.speed);
+static RegisterInfo *nxps32k358_lpuart_reg(NXPS32K358LPUartState *s,
+                                           hwaddr addr) {
+    RegisterInfo *reg;
 
-    qemu_chr_fe_ioctl(&s->chr, CHR_IOCTL_SERIAL_SET_PARAMS, &ssp);
+    if (addr >= sizeof(s->regs)) {
+        return NULL;
+    }
+    reg = &s->regs_info[addr / 4];
+    if (!reg->access || reg->access->addr != addr) {
+        return NULL;
+    }
+    return reg;
 }
 
 /**
- * nxps32k358_lpuart_read - Read from the NXP S32K358 LPUART register
- * @opaque: Pointer to the LPUART state
- * @addr: Address of the register to read
- * @size: Size of the read operation
+ * @brief Read a register of the NXP S32K358 LPUART.
  *
- * This function reads the value from the specified LPUART register
- * based on the provided address. It handles different registers
- * such as A_VERID, A_STAT, A_GLOBAL, A_DATA, A_DATARO, A_CONTROL,
- * and A_BAUD. For the A_DATA and A_DATARO registers, it also updates
- * the status register and processes input acceptance.
+ * The access is dispatched to the register at the offset, whose access table
+ * gives the read side effects (DATA pops the receive buffer, DATARO peeks it,
+ * WATER and MSR are computed on read).
  *
- * @return the value read from the specified register. If the address
- * is invalid, it logs an error and returns 0.
+ * @param opaque Pointer to the register block of the LPUART.
+ * @param addr Offset of the register to read.
+ * @param size Size of the read operation.
+ * @return The value read. If no register starts at the offset, an error is
+ * logged and 0 is returned.
  */
 static uint64_t nxps32k358_lpuart_read(void *opaque, hwaddr addr,
                                        unsigned int size) {
-    NXPS32K358LPUartState *s = NXPS32K358_LPUART(opaque);
-
-    DB_PRINT_READ("Read 0x%" HWADDR_PRIx "\n", addr);
-
-    switch (addr) {
-        case A_VERID:
-            return s->lpuart_verid;
-        case A_STAT:
-            return s->lpuart_stat;
-        case A_GLOBAL:
-            return s->lpuart_global;
-        case A_DATA:
-        case A_DATARO:  // read only data, identical to A_DATA but only for
-                        // reading
-            DB_PRINT_READ("Value: 0x%" PRIx32 ", %c\n", s->lpuart_data,
-                          (char)s->lpuart_data);
-            s->lpuart_stat &= ~R_STAT_RDRF_MASK;
-            qemu_chr_fe_accept_input(&s->chr);
-            nxps32k358_lpuart_update_irq(s);
-            return s->lpuart_data;
-        case A_CONTROL:
-            return s->lpuart_control;
-        case A_BAUD:
-            return s->lpuart_baud;
-        default:
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad offset 0x%" HWADDR_PRIx "\n", __func__,
-                          addr);
-            return 0;
-    }
+    RegisterInfoArray *reg_array = opaque;
+    NXPS32K358LPUartState *s =
+        NXPS32K358_LPUART(memory_region_owner(&reg_array->mem));
+    RegisterInfo *reg = nxps32k358_lpuart_reg(s, addr);
 
-    return 0;
+    trace_nxps32k358_lpuart_read(s->lpuart_port, addr);
+
+    if (!reg) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Bad offset 0x%" HWADDR_PRIx "\n", __func__, addr);
+        return 0;
+    }
+    return extract64(register_read(reg, MAKE_64BIT_MASK(0, size * 8),
+                                   reg_array->prefix, reg_array->debug),
+                     0, size * 8);
 }
 
 /**
- * @brief Handle writes to the NXP S32K358 LPUART registers.
+ * @brief Write a register of the NXP S32K358 LPUART.
  *
- * This function handles writes to various registers of the NXP S32K358 LPUART
- * device. Depending on the address, it updates the corresponding register in
- * the device state and performs necessary actions such as resetting the device,
- * writing data to the character device, updating IRQs, or updating baud rate
- * parameters.
+ * The access is dispatched to the register at the offset, whose access table
+ * gives the read-only and write 1 to clear bits and the write side effects.
  *
- * @param opaque Pointer to the device state.
- * @param addr Address of the register being written to.
+ * @param opaque Pointer to the register block of the LPUART.
+ * @param addr Offset of the register being written to.
  * @param val64 Value to write to the register.
  * @param size Size of the value being written.
  *
- * If an invalid address is provided, an error is logged.
- *
- * @note The status register is currently not completely implemented as it is
- * treated as read-only while it is not (it can be written to clear some bits).
+ * If no register starts at the offset, an error is logged.
  */
 static void nxps32k358_lpuart_write(void *opaque, hwaddr addr, uint64_t val64,
                                     unsigned int size) {
-    NXPS32K358LPUartState *s = NXPS32K358_LPUART(opaque);
-    uint32_t value = val64;
-    unsigned char ch;
+    RegisterInfoArray *reg_array = opaque;
+    NXPS32K358LPUartState *s =
+        NXPS32K358_LPUART(memory_region_owner(&reg_array->mem));
+    RegisterInfo *reg = nxps32k358_lpuart_reg(s, addr);
 
-    DB_PRINT("Write 0x%" PRIx32 ", 0x%" HWADDR_PRIx "\n", value, addr);
+    trace_nxps32k358_lpuart_write(s->lpuart_port, addr, val64);
 
-    switch (addr) {
-        case A_GLOBAL:
-            s->lpuart_global = value;
-            if (value & R_GLOBAL_RST_MASK) {
-                nxps32k358_lpuart_reset(DEVICE(s));
-            }
-            return;
-        case READONLY A_STAT:
-            return;
-        case A_DATA:
-            bool is_7bit = s->lpuart_control & R_CONTROL_M7_MASK;
-            bool is_9bit = s->lpuart_control & R_CONTROL_M_MASK;
-            if (is_9bit) {
-                qemu_log_mask(LOG_GUEST_ERROR,
-                              "%s: 9-bit data format not supported\n",
-                              __func__);
-                return;
-            }
-            if (is_7bit) {
-                value &= 0x7F;
-            }
-            ch = value;
-            qemu_chr_fe_write_all(&s->chr, &ch, 1);
-            return;
-        case A_CONTROL:
-            s->lpuart_control = value;
-            nxps32k358_lpuart_update_irq(s);
-            return;
-        case A_BAUD:
-            s->lpuart_baud = value;
-            nxps32k358_lpuart_update_params(s);
-            return;
-        default:
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad offset 0x%" HWADDR_PRIx "\n", __func__,
-                          addr);
+    if (!reg) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Bad offset 0x%" HWADDR_PRIx "\n", __func__, addr);
+        return;
     }
+    register_write(reg, val64, MAKE_64BIT_MASK(0, size * 8),
+                   reg_array->prefix, reg_array->debug);
 }
 
 static const MemoryRegionOps nxps32k358_lpuart_ops = {
@@ -315,8 +1393,202 @@ static const MemoryRegionOps nxps32k358_lpuart_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+/**
+ * @struct NXPS32K358LPUartCounter
+ * @brief Describes a per-port counter.
+ *
+ * @var NXPS32K358LPUartCounter::name
+ * Name of the counter in query-stats. The read-only QOM property has the same
+ * name with a "stats-" prefix.
+ *
+ * @var NXPS32K358LPUartCounter::offset
+ * Offset of the counter in NXPS32K358LPUartStats.
+ *
+ * @var NXPS32K358LPUartCounter::unit
+ * Unit of measure of the counter.
+ *
+ * @var NXPS32K358LPUartCounter::has_unit
+ * false if the counter is a plain number of events.
+ *
+ * @var NXPS32K358LPUartCounter::exponent
+ * Power of ten the unit is multiplied by.
+ */
+struct NXPS32K358LPUartCounter {
+    const char *name;
+    size_t offset;
+    StatsUnit unit;
+    bool has_unit;
+    int16_t exponent;
+};
+
+static const struct NXPS32K358LPUartCounter nxps32k358_lpuart_counters[] = {
+    { "tx-bytes", offsetof(struct NXPS32K358LPUartStats, tx_bytes),
+      STATS_UNIT_BYTES, true, 0 },
+    { "rx-bytes", offsetof(struct NXPS32K358LPUartStats, rx_bytes),
+      STATS_UNIT_BYTES, true, 0 },
+    { "rx-overruns", offsetof(struct NXPS32K358LPUartStats, rx_overruns) },
+    { "rx-drops", offsetof(struct NXPS32K358LPUartStats, rx_drops) },
+    { "tx-drops", offsetof(struct NXPS32K358LPUartStats, tx_drops) },
+    { "tx-stall-time", offsetof(struct NXPS32K358LPUartStats, tx_stall_ns),
+      STATS_UNIT_SECONDS, true, -9 },
+    { "irqs", offsetof(struct NXPS32K358LPUartStats, irqs) },
+};
+
+/**
+ * @brief Read a counter of an LPUART port.
+ *
+ * The stall time includes the current stall, if the transmitter is stalled.
+ *
+ * @param s Pointer to the NXPS32K358LPUartState structure.
+ * @param counter The counter to be read.
+ * @return The value of the counter.
+ */
+static uint64_t
+nxps32k358_lpuart_counter(NXPS32K358LPUartState *s,
+                          const struct NXPS32K358LPUartCounter *counter) {
+    uint64_t value = *(uint64_t *)((uint8_t *)&s->stats + counter->offset);
+
+    if (counter->offset == offsetof(struct NXPS32K358LPUartStats,
+                                    tx_stall_ns) && s->tx_stalled) {
+        value += qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - s->tx_stall_start;
+    }
+    return value;
+}
+
+/**
+ * @brief Getter of the read-only "stats-*" QOM properties.
+ *
+ * @param obj The LPUART object.
+ * @param v The visitor.
+ * @param name Name of the property.
+ * @param opaque The NXPS32K358LPUartCounter of the property.
+ * @param errp Pointer to an error object.
+ */
+static void nxps32k358_lpuart_get_counter(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp) {
+    uint64_t value = nxps32k358_lpuart_counter(NXPS32K358_LPUART(obj), opaque);
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+/**
+ * @struct NXPS32K358LPUartStatsArgs
+ * @brief Arguments of a query-stats walk over the QOM tree.
+ *
+ * @var NXPS32K358LPUartStatsArgs::result
+ * The results being built.
+ *
+ * @var NXPS32K358LPUartStatsArgs::names
+ * The counters requested, NULL for all of them.
+ */
+struct NXPS32K358LPUartStatsArgs {
+    StatsResultList **result;
+    strList *names;
+};
+
+/**
+ * @brief Adds the counters of an LPUART port to the query-stats results.
+ *
+ * @param obj The object being visited.
+ * @param opaque Pointer to the NXPS32K358LPUartStatsArgs of the query.
+ * @return Always 0, to visit every object.
+ */
+static int nxps32k358_lpuart_stats_query(Object *obj, void *opaque) {
+    struct NXPS32K358LPUartStatsArgs *args = opaque;
+    StatsList *stats_list = NULL;
+    g_autofree char *path = NULL;
+    NXPS32K358LPUartState *s;
+
+    if (!object_dynamic_cast(obj, TYPE_NXPS32K358_LPUART)) {
+        return 0;
+    }
+    s = NXPS32K358_LPUART(obj);
+
+    for (int i = ARRAY_SIZE(nxps32k358_lpuart_counters) - 1; i >= 0; i--) {
+        Stats *stats;
+
+        if (!apply_str_list_filter(nxps32k358_lpuart_counters[i].name,
+                                   args->names)) {
+            continue;
+        }
+
+        stats = g_new0(Stats, 1);
+
+        stats->name = g_strdup(nxps32k358_lpuart_counters[i].name);
+        stats->value = g_new0(StatsValue, 1);
+        stats->value->type = QTYPE_QNUM;
+        stats->value->u.scalar =
+            nxps32k358_lpuart_counter(s, &nxps32k358_lpuart_counters[i]);
+        QAPI_LIST_PREPEND(stats_list, stats);
+    }
+
+    path = object_get_canonical_path(obj);
+    add_stats_entry(args->result, STATS_PROVIDER_NXPS32K358_LPUART, path,
+                    stats_list);
+
+    return 0;
+}
+
+/**
+ * @brief query-stats callback of the LPUART statistics provider.
+ *
+ * Every LPUART port in the machine reports one value per counter.
+ *
+ * @param result The results being built.
+ * @param target The kind of object queried.
+ * @param names The counters requested, NULL for all of them.
+ * @param targets The objects requested (unused for devices).
+ * @param errp Pointer to an error object.
+ */
+static void nxps32k358_lpuart_stats_cb(StatsResultList **result,
+                                       StatsTarget target, strList *names,
+                                       strList *targets, Error **errp) {
+    struct NXPS32K358LPUartStatsArgs args = { result, names };
+
+    if (target == STATS_TARGET_DEVICE) {
+        object_child_foreach_recursive(object_get_root(),
+                                       nxps32k358_lpuart_stats_query, &args);
+    }
+}
+
+/**
+ * @brief query-stats-schemas callback of the LPUART statistics provider.
+ *
+ * @param result The schemas being built.
+ * @param errp Pointer to an error object.
+ */
+static void nxps32k358_lpuart_schemas_cb(StatsSchemaList **result,
+                                         Error **errp) {
+    StatsSchemaValueList *list = NULL;
+
+    for (int i = ARRAY_SIZE(nxps32k358_lpuart_counters) - 1; i >= 0; i--) {
+        const struct NXPS32K358LPUartCounter *counter =
+            &nxps32k358_lpuart_counters[i];
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(counter->name);
+        value->type = STATS_TYPE_CUMULATIVE;
+        value->has_unit = counter->has_unit;
+        value->unit = counter->unit;
+        value->exponent = counter->exponent;
+        if (counter->exponent) {
+            value->has_base = true;
+            value->base = 10;
+        }
+        QAPI_LIST_PREPEND(list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_NXPS32K358_LPUART,
+                     STATS_TARGET_DEVICE, list);
+}
+
 static Property nxps32k358_lpuart_properties[] = {
     DEFINE_PROP_CHR("chardev", NXPS32K358LPUartState, chr),
+    DEFINE_PROP_UINT32("port", NXPS32K358LPUartState, lpuart_port, 0),
+    DEFINE_PROP_BOOL("paced", NXPS32K358LPUartState, paced, false),
+    DEFINE_PROP_LINK("peer", NXPS32K358LPUartState, peer,
+                     TYPE_NXPS32K358_LPUART, NXPS32K358LPUartState *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -324,27 +1596,48 @@ static Property nxps32k358_lpuart_properties[] = {
  * @brief Initialize the NXP S32K358 LPUART device.
  *
  * This function initializes the NXP S32K358 LPUART device by setting up
- * the necessary system bus IRQ, memory-mapped I/O region, and clock input.
+ * the necessary system bus IRQ, DMA request lines, memory-mapped I/O region,
+ * and clock input.
  *
  * @param obj Pointer to the Object structure representing the device.
  *
  * Steps performed:
  * - Cast the generic Object pointer to NXPS32K358LPUartState structure.
  * - Initialize the system bus IRQ for the device.
- * - Initialize the memory-mapped I/O region for the device.
+ * - Initialize the named GPIO outputs for the DMA requests.
+ * - Create the register block from the access tables, with its memory-mapped
+ *   I/O region.
  * - Register the memory-mapped I/O region with the system bus.
- * - Initialize the clock input for the device.
+ * - Initialize the clock input for the device, whose gating stops it.
  */
 static void nxps32k358_lpuart_init(Object *obj) {
     NXPS32K358LPUartState *s = NXPS32K358_LPUART(obj);
 
     sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->dma_rx_req,
+                             NXPS32K358_LPUART_DMA_RX, 1);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->dma_tx_req,
+                             NXPS32K358_LPUART_DMA_TX, 1);
+
+    s->reg_array = register_init_block32(DEVICE(obj), nxps32k358_lpuart_access,
+                                         LPUART_NUM_ACCESS, s->regs_info,
+                                         s->regs, &nxps32k358_lpuart_ops,
+                                         false, 0x4000);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->reg_array->mem);
 
-    memory_region_init_io(&s->mmio, obj, &nxps32k358_lpuart_ops, s,
-                          TYPE_NXPS32K358_LPUART, 0x4000);
-    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+    s->clk = qdev_init_clock_in(DEVICE(s), "clk",
+                                nxps32k358_lpuart_clk_update, s, ClockUpdate);
+}
+
+/**
+ * @brief Finalize the NXP S32K358 LPUART device, freeing its register block.
+ *
+ * @param obj Pointer to the Object structure representing the device.
+ */
+static void nxps32k358_lpuart_finalize(Object *obj) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(obj);
 
-    s->clk = qdev_init_clock_in(DEVICE(s), "clk", NULL, s, 0);
+    register_finalize_block(s->reg_array);
 }
 
 /**
@@ -353,7 +1646,15 @@ static void nxps32k358_lpuart_init(Object *obj) {
  * This function initializes the NXPS32K358 LPUART device. It checks if the
  * LPUART clock source is properly configured. If the clock source is not
  * set, it reports an error and returns. If the clock source is set, it
- * sets the character device handlers for the LPUART.
+ * allocates the receive and transmit buffers, as deep as the FIFOs of the
+ * port, creates the timers of the shifters used in paced mode and of the idle
+ * line detection, and sets the
+ * character device handlers for the LPUART.
+ *
+ * A port linked to a peer ignores its character backend: the link is made
+ * symmetric, so that the peer transmits to this port as well and stops
+ * listening to its own backend if it was realized first, and it is rejected
+ * if the peer is already wired to a third port.
  *
  * @param dev The device state.
  * @param errp Pointer to an error object.
@@ -364,17 +1665,65 @@ static void nxps32k358_lpuart_realize(DeviceState *dev, Error **errp) {
         error_setg(errp, "LPUART clock must be wired up by SoC code");
         return;
     }
+    if (s->peer && s->peer->peer && s->peer->peer != s) {
+        error_setg(errp, "LPUART %" PRIu32 " is already linked to LPUART %"
+                   PRIu32, s->peer->lpuart_port, s->peer->peer->lpuart_port);
+        return;
+    }
+
+    uint32_t param = LPUART_PARAM_RESET(s->lpuart_port);
+    fifo8_create(&s->rx_fifo, 1 << FIELD_EX32(param, PARAM, RXFIFO));
+    fifo8_create(&s->tx_fifo, 1 << FIELD_EX32(param, PARAM, TXFIFO));
+
+    s->tx_timer =
+        timer_new_ns(QEMU_CLOCK_VIRTUAL, nxps32k358_lpuart_tx_timer_cb, s);
+    s->rx_timer =
+        timer_new_ns(QEMU_CLOCK_VIRTUAL, nxps32k358_lpuart_rx_timer_cb, s);
+    s->idle_timer =
+        timer_new_ns(QEMU_CLOCK_VIRTUAL, nxps32k358_lpuart_idle_timer_cb, s);
+
+    if (s->peer) {
+        // The board sets the link on one side only: if the peer was realized
+        // first it is listening to its own backend, which it must now ignore
+        s->peer->peer = s;
+        qemu_chr_fe_set_handlers(&s->peer->chr, NULL, NULL, NULL, NULL, NULL,
+                                 NULL, true);
+        return;
+    }
 
     qemu_chr_fe_set_handlers(&s->chr, nxps32k358_lpuart_can_receive,
                              nxps32k358_lpuart_receive, NULL, NULL, s, NULL,
                              true);
 }
 
+/**
+ * @brief Unrealize the NXPS32K358 LPUART device, freeing its buffers and
+ * timers and cancelling the pending transmission.
+ *
+ * @param dev The device state.
+ */
+static void nxps32k358_lpuart_unrealize(DeviceState *dev) {
+    NXPS32K358LPUartState *s = NXPS32K358_LPUART(dev);
+
+    nxps32k358_lpuart_remove_watch(s);
+    if (s->peer && s->peer->peer == s) {
+        s->peer->peer = NULL;
+        s->peer->peer_blocked = false;
+    }
+    timer_free(s->tx_timer);
+    timer_free(s->rx_timer);
+    timer_free(s->idle_timer);
+    fifo8_destroy(&s->rx_fifo);
+    fifo8_destroy(&s->tx_fifo);
+}
+
 /**
  * @brief Initialize the NXP S32K358 LPUART class
  *
  * This function sets up the NXP S32K358 LPUART device class by configuring
- * its legacy reset handler, properties, and realize function.
+ * its legacy reset handler, properties, realize and unrealize functions. It
+ * also generates the access tables of the register arrays, adds the read-only
+ * "stats-*" properties and registers the statistics provider of query-stats.
  *
  * @param klass The ObjectClass to initialize
  * @param data Additional data for initialization (unused)
@@ -385,6 +1734,21 @@ static void nxps32k358_lpuart_class_init(ObjectClass *klass, void *data) {
     device_class_set_legacy_reset(dc, nxps32k358_lpuart_reset);
     device_class_set_props(dc, nxps32k358_lpuart_properties);
     dc->realize = nxps32k358_lpuart_realize;
+    dc->unrealize = nxps32k358_lpuart_unrealize;
+
+    nxps32k358_lpuart_build_access();
+
+    for (int i = 0; i < ARRAY_SIZE(nxps32k358_lpuart_counters); i++) {
+        g_autofree char *name =
+            g_strdup_printf("stats-%s", nxps32k358_lpuart_counters[i].name);
+        object_class_property_add(klass, name, "uint64",
+                                  nxps32k358_lpuart_get_counter, NULL, NULL,
+                                  (void *)&nxps32k358_lpuart_counters[i]);
+    }
+
+    add_stats_callbacks(STATS_PROVIDER_NXPS32K358_LPUART,
+                        nxps32k358_lpuart_stats_cb,
+                        nxps32k358_lpuart_schemas_cb);
 }
 
 static const TypeInfo nxps32k358_lpuart_info = {
@@ -392,6 +1756,7 @@ static const TypeInfo nxps32k358_lpuart_info = {
     .parent = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(NXPS32K358LPUartState),
     .instance_init = nxps32k358_lpuart_init,
+    .instance_finalize = nxps32k358_lpuart_finalize,
     .class_init = nxps32k358_lpuart_class_init,
 };
 
@@ -0,0 +1,195 @@
+/*
+ * NXPS32K358 DMAMUX
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_dmamux.c
+ * @brief Implementation of the NXPS32K358 DMAMUX module.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/dma/nxps32k358_dmamux.h"
+#include "hw/irq.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+
+/**
+ * @brief Propagates the routed source level to an eDMA channel request line.
+ *
+ * The request line of a channel is asserted if the channel is enabled and the
+ * peripheral source selected in its CHCFG register is asserting a request.
+ *
+ * @param s Pointer to the NXPS32K358DMAMUXState structure.
+ * @param ch The DMAMUX channel to update.
+ */
+static void nxps32k358_dmamux_update(NXPS32K358DMAMUXState *s, int ch) {
+    uint8_t cfg = s->chcfg[ch];
+    int src = FIELD_EX8(cfg, DMAMUX_CHCFG, SOURCE);
+    bool level = FIELD_EX8(cfg, DMAMUX_CHCFG, ENBL) &&
+                 (s->source_level & (1ULL << src));
+
+    qemu_set_irq(s->req[ch], level);
+}
+
+/**
+ * @brief GPIO handler for the peripheral request sources.
+ *
+ * @param opaque Pointer to the NXPS32K358DMAMUXState structure.
+ * @param n The source number.
+ * @param level The new level of the request.
+ */
+static void nxps32k358_dmamux_set_source(void *opaque, int n, int level) {
+    NXPS32K358DMAMUXState *s = opaque;
+
+    if (level) {
+        s->source_level |= 1ULL << n;
+    } else {
+        s->source_level &= ~(1ULL << n);
+    }
+
+    for (int i = 0; i < DMAMUX_CHANNELS; i++) {
+        if (FIELD_EX8(s->chcfg[i], DMAMUX_CHCFG, SOURCE) == n) {
+            nxps32k358_dmamux_update(s, i);
+        }
+    }
+}
+
+/**
+ * @brief Reads a CHCFG register of the DMAMUX.
+ *
+ * @param opaque Pointer to the NXPS32K358DMAMUXState structure.
+ * @param offset Offset of the register to read.
+ * @param size Size of the read operation (always 1).
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_dmamux_read(void *opaque, hwaddr offset,
+                                       unsigned size) {
+    NXPS32K358DMAMUXState *s = opaque;
+
+    if (offset >= DMAMUX_CHANNELS) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+
+    return s->chcfg[A_DMAMUX_CHCFG(offset)];
+}
+
+/**
+ * @brief Writes a CHCFG register of the DMAMUX.
+ *
+ * The request line of the channel is updated immediately, so that enabling a
+ * channel whose source is already asserting a request starts the eDMA.
+ *
+ * @param opaque Pointer to the NXPS32K358DMAMUXState structure.
+ * @param offset Offset of the register to write.
+ * @param value Value to write.
+ * @param size Size of the write operation (always 1).
+ */
+static void nxps32k358_dmamux_write(void *opaque, hwaddr offset,
+                                    uint64_t value, unsigned size) {
+    NXPS32K358DMAMUXState *s = opaque;
+    int ch;
+
+    if (offset >= DMAMUX_CHANNELS) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+
+    ch = A_DMAMUX_CHCFG(offset);
+    if (value & R_DMAMUX_CHCFG_TRIG_MASK) {
+        qemu_log_mask(LOG_UNIMP, "%s: Periodic trigger not supported\n",
+                      __func__);
+    }
+    s->chcfg[ch] = value;
+    nxps32k358_dmamux_update(s, ch);
+}
+
+static const MemoryRegionOps nxps32k358_dmamux_ops = {
+    .read = nxps32k358_dmamux_read,
+    .write = nxps32k358_dmamux_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl.min_access_size = 1,
+    .impl.max_access_size = 1,
+    .valid.min_access_size = 1,
+    .valid.max_access_size = 4,
+};
+
+/**
+ * @brief Initialize the NXP S32K358 DMAMUX.
+ *
+ * This function sets up the memory-mapped I/O region, the peripheral request
+ * inputs and the eDMA request outputs of the DMAMUX.
+ *
+ * @param obj Pointer to the Object structure.
+ */
+static void nxps32k358_dmamux_init(Object *obj) {
+    NXPS32K358DMAMUXState *s = NXPS32K358_DMAMUX(obj);
+
+    memory_region_init_io(&s->mmio, obj, &nxps32k358_dmamux_ops, s,
+                          TYPE_NXPS32K358_DMAMUX, 0x4000);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+
+    qdev_init_gpio_in_named(DEVICE(obj), nxps32k358_dmamux_set_source,
+                            NXPS32K358_DMAMUX_SOURCE, DMAMUX_SOURCES);
+    qdev_init_gpio_out_named(DEVICE(obj), s->req, NXPS32K358_DMAMUX_REQ,
+                             DMAMUX_CHANNELS);
+}
+
+/**
+ * @brief Reset the NXP S32K358 DMAMUX.
+ *
+ * All the channels are disabled, so every eDMA request line is deasserted.
+ * The source levels are kept, as they belong to the peripherals.
+ *
+ * @param dev Pointer to the DeviceState structure.
+ */
+static void nxps32k358_dmamux_reset(DeviceState *dev) {
+    NXPS32K358DMAMUXState *s = NXPS32K358_DMAMUX(dev);
+
+    for (int i = 0; i < DMAMUX_CHANNELS; i++) {
+        s->chcfg[i] = DMAMUX_CHCFG_RESET;
+        nxps32k358_dmamux_update(s, i);
+    }
+}
+
+static void nxps32k358_dmamux_class_init(ObjectClass *klass, void *data) {
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    device_class_set_legacy_reset(dc, nxps32k358_dmamux_reset);
+}
+
+static const TypeInfo nxps32k358_dmamux_info = {
+    .name = TYPE_NXPS32K358_DMAMUX,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(NXPS32K358DMAMUXState),
+    .class_init = nxps32k358_dmamux_class_init,
+    .instance_init = nxps32k358_dmamux_init,
+};
+
+static void nxps32k358_dmamux_register_types(void) {
+    type_register_static(&nxps32k358_dmamux_info);
+}
+
+type_init(nxps32k358_dmamux_register_types)
@@ -29,18 +29,44 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/qapi-builtin-visit.h"
+#include "qapi/visitor.h"
 #include "hw/dma/nxps32k358_edma.h"
 #include "hw/dma/nxps32k358_tcd.h"
 #include "hw/irq.h"
+#include "exec/address-spaces.h"
+#include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
+#include "qemu/host-utils.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
+#include "sysemu/stats.h"
+#include "trace.h"
 
 #define READONLY
 #define NO_SUPPORT
 
 #define MAX_SIZE 64
 
+// Writable bits of CH_CSR: ERQ, EARQ, EEI and EBW
+#define CH_CSR_WR_MASK 0x0000000F
+
+// Writable bits of CH_PRI: APL, DPA and ECP
+#define CH_PRI_WR_MASK 0xC0000007
+
+// Alignment of the TCD images loaded by scatter-gather
+#define SGA_ALIGN 32
+
+// Maximum number of host memory copies of a bulk copy: the source and the
+// destination can each wrap once
+#define EDMA_BULK_MAX_RUNS 3
+
+// Maximum number of minor loops performed by a single run of the engine bottom
+// half before yielding to the main loop
+#define EDMA_BH_MAX_SERVICES 1024
+
 // If NXP_EDMA_DEBUG is 0, no debug messages will be printed
 // If it is 1, only write logs will be printed
 // If it is 2, read and write logs will be printed
@@ -58,54 +84,573 @@
 #define DB_PRINT(fmt, args...) DB_PRINT_L(1, fmt, ##args)
 #define DB_PRINT_READ(fmt, args...) DB_PRINT_L(2, fmt, ##args)
 
+/**
+ * @brief Extracts the iteration count from a CITER or BITER value.
+ *
+ * When minor loop channel linking is enabled (ELINK), the upper bits of the
+ * register hold the linked channel number and the count is only 9 bits wide.
+ * CITER and BITER share the same layout.
+ *
+ * @param iter The CITER or BITER register value.
+ * @return The iteration count.
+ */
+static uint16_t nxps32k358_edma_iter_count(uint16_t iter) {
+    if (FIELD_EX16(iter, TCD_CITER, ELINK)) {
+        return FIELD_EX16(iter, TCD_CITER, CITER_ELINK);
+    }
+    return FIELD_EX16(iter, TCD_CITER, CITER);
+}
+
+/**
+ * @brief Extracts the minor loop byte count of a TCD.
+ *
+ * When a minor loop offset is enabled (SMLOE or DMLOE), NBYTES shrinks to 10
+ * bits to make room for MLOFF.
+ *
+ * @param ch Pointer to the NXPS32K358EDMATCDState structure.
+ * @return The number of bytes moved by each minor loop.
+ */
+static uint32_t
+nxps32k358_edma_nbytes(const struct NXPS32K358EDMATCDState *ch) {
+    if (ch->tcd_nbytes_mloff &
+        (R_TCD_NBYTES_MLOFF_SMLOE_MASK | R_TCD_NBYTES_MLOFF_DMLOE_MASK)) {
+        return FIELD_EX32(ch->tcd_nbytes_mloff, TCD_NBYTES_MLOFF,
+                          NBYTES_MLOFFYES);
+    }
+    return FIELD_EX32(ch->tcd_nbytes_mloff, TCD_NBYTES_MLOFF, NBYTES);
+}
+
 /**
  * @brief Update the interrupt request (IRQ) status for a specific Transfer
  * Control Descriptor (TCD).
  *
- * This function checks the status of the TCD and updates the interrupt request
- * status based on the current state of the TCD's control and iteration
- * registers.
+ * The bit of the channel in the edma_int register mirrors the INT flag of the
+ * channel (CH_INT), which is set by nxps32k358_edma_transmit() and cleared by
+ * the guest. The IRQ line of the channel is shared by the transfer and the
+ * error interrupts: it is raised while INT is set, or while the channel has a
+ * recorded error (CH_ES.ERR) and error interrupts are enabled (CH_CSR.EEI).
  *
  * @param s Pointer to the NXPS32K358EDMAState structure.
  * @param tcd_no The index of the TCD to update.
+ */
+static void nxps32k358_edma_tcd_update_irq(NXPS32K358EDMAState *s, int tcd_no) {
+    struct NXPS32K358EDMATCDState *ch = &s->tcd[tcd_no];
+    bool err = (ch->ch_es & R_CH_ES_ERR_MASK) &&
+               (ch->ch_csr & R_CH_CSR_EEI_MASK);
+
+    if (ch->ch_int & R_CH_INT_INT_MASK) {
+        s->edma_int |= 1 << tcd_no;
+    } else {
+        s->edma_int &= ~(1 << tcd_no);
+    }
+    qemu_set_irq(ch->irq, (ch->ch_int & R_CH_INT_INT_MASK) || err);
+}
+
+/**
+ * @brief Updates the pending bitmaps for a channel.
  *
- * The function performs the following checks:
- * 1. If the INTHALF bit in the TCD's control and status register (tcd_csr) is
- * set and the current iteration count (tcd_citer) is greater than or equal to
- * half of the beginning iteration count (tcd_biter), the interrupt request is
- * set.
- * 2. If the INTMAJOR bit in the TCD's control and status register (tcd_csr) is
- * set and the current iteration count (tcd_citer) is zero, the interrupt
- * request is set.
+ * A channel is pending when the START bit of its TCD CSR is set or when it has
+ * an enabled hardware request (EDMA_HRS). The channel is tracked both in the
+ * channel-indexed bitmap (used by round-robin arbitration) and in the
+ * priority-ordered bitmap (used by fixed-priority arbitration).
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel to update.
+ */
+static void nxps32k358_edma_update_pending(NXPS32K358EDMAState *s, int c) {
+    bool pending = (s->tcd[c].tcd_csr & R_TCD_CSR_START_MASK) ||
+                   (s->edma_hrs & (1U << c));
+
+    if (pending) {
+        s->pending |= 1U << c;
+        s->pending_rank |= 1U << s->rank[c];
+    } else {
+        s->pending &= ~(1U << c);
+        s->pending_rank &= ~(1U << s->rank[c]);
+    }
+}
+
+/**
+ * @brief Updates the hardware request status of a channel.
  *
- * If any of the above conditions are met, the interrupt request for the TCD is
- * set and the corresponding bit in the edma_int register is updated. The IRQ is
- * then triggered using qemu_set_irq. If none of the conditions are met, the
- * interrupt request is cleared and the IRQ is deasserted.
+ * A bit of EDMA_HRS is set when the request line of the channel is asserted
+ * and hardware requests are enabled for the channel (CH_CSR.ERQ).
  *
- * @note Error interrupt (EEI) is not supported.
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel to update.
  */
-static void nxps32k358_edma_tcd_update_irq(NXPS32K358EDMAState *s, int tcd_no) {
-    struct NXPS32K358EDMATCDState *ch = &s->tcd[tcd_no];
+static void nxps32k358_edma_update_hrs(NXPS32K358EDMAState *s, int c) {
+    if ((s->dma_req & (1U << c)) && (s->tcd[c].ch_csr & R_CH_CSR_ERQ_MASK)) {
+        s->edma_hrs |= 1U << c;
+    } else {
+        s->edma_hrs &= ~(1U << c);
+    }
+    nxps32k358_edma_update_pending(s, c);
+}
+
+/**
+ * @brief Computes the fixed arbitration priority of a channel.
+ *
+ * The channel group priority (CH_GRPRI) is the most significant part of the
+ * priority, the channel priority level (CH_PRI.APL) the least significant one.
+ * Higher values mean higher priority.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel.
+ * @return The priority of the channel.
+ */
+static uint32_t nxps32k358_edma_priority(NXPS32K358EDMAState *s, int c) {
+    return (s->edma_chn_grpri[c] << R_CH_PRI_APL_LENGTH) |
+           FIELD_EX32(s->tcd[c].ch_pri, CH_PRI, APL);
+}
 
-    if (FIELD_EX32(ch->tcd_csr, TCD_CSR, INTHALF) &&
-        FIELD_EX16(ch->tcd_citer, TCD_CITER, CITER) >=
-            FIELD_EX16(ch->tcd_biter, TCD_BITER, BITER) / 2) {
-        ch->ch_int |= R_CH_INT_INT_MASK;
+/**
+ * @brief Recomputes the priority order of the channels.
+ *
+ * Called whenever CH_PRI or CH_GRPRI changes. The channels are sorted by
+ * decreasing priority, ties being broken in favour of the lower channel
+ * number, so that rank 0 is the channel that wins fixed-priority
+ * arbitration. The priority-ordered pending bitmap is rebuilt accordingly.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_update_priorities(NXPS32K358EDMAState *s) {
+    // Insertion sort, the array is small and priorities change rarely
+    for (int i = 0; i < EDMA_CHANNELS; i++) {
+        int j = i;
+        uint32_t prio = nxps32k358_edma_priority(s, i);
+
+        while (j > 0 &&
+               nxps32k358_edma_priority(s, s->prio_order[j - 1]) < prio) {
+            s->prio_order[j] = s->prio_order[j - 1];
+            j--;
+        }
+        s->prio_order[j] = i;
     }
 
-    if (FIELD_EX32(ch->tcd_csr, TCD_CSR, INTMAJOR) &&
-        FIELD_EX16(ch->tcd_citer, TCD_CITER, CITER) == 0) {
-        ch->ch_int |= R_CH_INT_INT_MASK;
+    s->pending_rank = 0;
+    for (int r = 0; r < EDMA_CHANNELS; r++) {
+        s->rank[s->prio_order[r]] = r;
+        if (s->pending & (1U << s->prio_order[r])) {
+            s->pending_rank |= 1U << r;
+        }
     }
+}
 
-    if (ch->ch_int & R_CH_INT_INT_MASK) {
-        s->edma_int |= 1 << tcd_no;
-        qemu_set_irq(ch->irq, 1);
+/**
+ * @brief Checks whether a guest physical range is plain RAM.
+ *
+ * The range must be backed by a single RAM (or ROM, when reading) memory
+ * region, so that it can be accessed through a host pointer instead of going
+ * through the memory dispatch for every beat.
+ *
+ * @param addr Guest physical start address of the range.
+ * @param len Length of the range in bytes.
+ * @param is_write true if the range is going to be written.
+ * @return true if the whole range can be accessed directly, false otherwise.
+ */
+static bool nxps32k358_edma_is_direct(hwaddr addr, hwaddr len,
+                                      bool is_write) {
+    MemoryRegion *mr;
+    hwaddr xlat;
+    hwaddr l = len;
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(&address_space_memory, addr, &xlat, &l,
+                                 is_write, MEMTXATTRS_UNSPECIFIED);
+    return l == len && memory_access_is_direct(mr, is_write);
+}
+
+/**
+ * @brief Advances an address, honouring the address modulo of the channel.
+ *
+ * When a modulo is set (SMOD or DMOD not zero), only the lower mod bits of the
+ * address change, so that the address wraps inside a circular buffer of
+ * 2^mod bytes aligned to its size.
+ *
+ * @param addr The current address.
+ * @param off The signed offset to be added.
+ * @param mod The address modulo (SMOD or DMOD field).
+ * @return The next address.
+ */
+static uint32_t nxps32k358_edma_mod_add(uint32_t addr, int32_t off,
+                                        unsigned mod) {
+    uint32_t mask;
+
+    if (mod == 0) {
+        return addr + off;
+    }
+    mask = (1U << mod) - 1;
+    return (addr & ~mask) | ((addr + off) & mask);
+}
+
+/**
+ * @brief Computes the number of bytes before an address wraps.
+ *
+ * @param addr The current address.
+ * @param mod The address modulo (SMOD or DMOD field), 0 if disabled.
+ * @param len The number of bytes to be accessed.
+ * @return The number of bytes, at most len, that can be accessed from addr
+ * without wrapping.
+ */
+static uint32_t nxps32k358_edma_mod_run(uint32_t addr, unsigned mod,
+                                        uint32_t len) {
+    if (mod == 0) {
+        return len;
+    }
+    return MIN(len, (1U << mod) - (addr & ((1U << mod) - 1)));
+}
+
+/**
+ * @brief Checks whether a circular range can be accessed directly.
+ *
+ * The range may wrap once: both the part before and the part after the wrap
+ * must be plain RAM.
+ *
+ * @param addr Guest physical start address of the range.
+ * @param mod The address modulo (SMOD or DMOD field), 0 if disabled.
+ * @param len Length of the range in bytes.
+ * @param is_write true if the range is going to be written.
+ * @return true if the whole range can be accessed directly, false otherwise.
+ */
+static bool nxps32k358_edma_ring_is_direct(uint32_t addr, unsigned mod,
+                                           uint32_t len, bool is_write) {
+    uint32_t first = nxps32k358_edma_mod_run(addr, mod, len);
+
+    if (!nxps32k358_edma_is_direct(addr, first, is_write)) {
+        return false;
+    }
+    return first == len ||
+           nxps32k358_edma_is_direct(nxps32k358_edma_mod_add(addr, first, mod),
+                                     len - first, is_write);
+}
+
+/**
+ * @brief A run of a bulk copy, mapped in host memory.
+ *
+ * @var NXPS32K358EDMARun::src
+ * Host pointer to the source.
+ *
+ * @var NXPS32K358EDMARun::dst
+ * Host pointer to the destination.
+ *
+ * @var NXPS32K358EDMARun::len
+ * Number of bytes of the run.
+ */
+struct NXPS32K358EDMARun {
+    void *src;
+    void *dst;
+    hwaddr len;
+};
+
+/**
+ * @brief Maps a run of a bulk copy in host memory.
+ *
+ * Both ranges are mapped with address_space_map(); if either cannot be mapped
+ * whole, nothing is left mapped.
+ *
+ * @param run The run to be filled in.
+ * @param saddr Source address.
+ * @param daddr Destination address.
+ * @param len Number of bytes to be copied.
+ * @return true if the run was mapped, false if a range could not be mapped.
+ */
+static bool nxps32k358_edma_map_run(struct NXPS32K358EDMARun *run,
+                                    hwaddr saddr, hwaddr daddr, hwaddr len) {
+    hwaddr slen = len;
+    hwaddr dlen = len;
+
+    run->src = address_space_map(&address_space_memory, saddr, &slen, false,
+                                 MEMTXATTRS_UNSPECIFIED);
+    if (!run->src) {
+        return false;
+    }
+    run->dst = address_space_map(&address_space_memory, daddr, &dlen, true,
+                                 MEMTXATTRS_UNSPECIFIED);
+    if (!run->dst) {
+        address_space_unmap(&address_space_memory, run->src, slen, false, 0);
+        return false;
+    }
+
+    if (slen != len || dlen != len) {
+        address_space_unmap(&address_space_memory, run->dst, dlen, true, 0);
+        address_space_unmap(&address_space_memory, run->src, slen, false, 0);
+        return false;
+    }
+    run->len = len;
+    return true;
+}
+
+/**
+ * @brief Unmaps a run of a bulk copy.
+ *
+ * @param run The run, mapped by nxps32k358_edma_map_run().
+ * @param access_len Number of bytes copied, 0 if the run was not copied.
+ */
+static void nxps32k358_edma_unmap_run(struct NXPS32K358EDMARun *run,
+                                      hwaddr access_len) {
+    // Unmapping the destination marks the pages as dirty and invalidates any
+    // translated code living there
+    address_space_unmap(&address_space_memory, run->dst, run->len, true,
+                        access_len);
+    address_space_unmap(&address_space_memory, run->src, run->len, false,
+                        access_len);
+}
+
+/**
+ * @brief Performs a contiguous minor loop with host memory copies.
+ *
+ * This is the fast path of nxps32k358_edma_transmit(): when both the source
+ * and the destination advance by exactly one element per beat, the minor loop
+ * is equivalent to a memmove of the whole block. With address modulo enabled,
+ * the block is split where the source or the destination wraps, so a circular
+ * buffer wrapping once costs two copies instead of a fallback to the per-beat
+ * path. All the runs are mapped before copying any of them, so that a failure
+ * leaves the memory untouched for the per-beat path.
+ *
+ * @param saddr Source address of the minor loop.
+ * @param smod Source address modulo (SMOD field), 0 if disabled.
+ * @param daddr Destination address of the minor loop.
+ * @param dmod Destination address modulo (DMOD field), 0 if disabled.
+ * @param len Number of bytes moved by the minor loop.
+ * @return true if the copy was performed, false if either range is not RAM
+ * (e.g. a peripheral register) and the caller must use the per-beat path.
+ */
+static bool nxps32k358_edma_bulk_copy(uint32_t saddr, unsigned smod,
+                                      uint32_t daddr, unsigned dmod,
+                                      uint32_t len) {
+    // A buffer smaller than the minor loop would be walked more than once
+    if (len == 0 || (smod && len > (1U << smod)) ||
+        (dmod && len > (1U << dmod))) {
+        return false;
+    }
+
+    if (!nxps32k358_edma_ring_is_direct(saddr, smod, len, false) ||
+        !nxps32k358_edma_ring_is_direct(daddr, dmod, len, true)) {
+        return false;
+    }
+
+    struct NXPS32K358EDMARun runs[EDMA_BULK_MAX_RUNS];
+    int count = 0;
+
+    while (len > 0) {
+        uint32_t n = MIN(nxps32k358_edma_mod_run(saddr, smod, len),
+                         nxps32k358_edma_mod_run(daddr, dmod, len));
+
+        assert(count < EDMA_BULK_MAX_RUNS);
+        if (!nxps32k358_edma_map_run(&runs[count], saddr, daddr, n)) {
+            while (count > 0) {
+                nxps32k358_edma_unmap_run(&runs[--count], 0);
+            }
+            return false;
+        }
+        count++;
+        saddr = nxps32k358_edma_mod_add(saddr, n, smod);
+        daddr = nxps32k358_edma_mod_add(daddr, n, dmod);
+        len -= n;
+    }
+
+    for (int i = 0; i < count; i++) {
+        memmove(runs[i].dst, runs[i].src, runs[i].len);
+        nxps32k358_edma_unmap_run(&runs[i], runs[i].len);
+    }
+    return true;
+}
+
+/**
+ * @brief Accounts for a new service request of a channel.
+ *
+ * A request arriving while the channel already has one pending is merged with
+ * it, so it is counted as dropped.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel.
+ */
+static void nxps32k358_edma_count_request(NXPS32K358EDMAState *s, int c) {
+    if (s->pending & (1U << c)) {
+        s->stats[c].dropped_requests++;
+        trace_nxps32k358_edma_req_dropped(c);
+    }
+}
+
+/**
+ * @brief Starts a channel linked to the one being serviced.
+ *
+ * Channel linking is handled entirely inside the device: the START bit of the
+ * linked channel is set as if the guest had written it, and the channel is
+ * added to the pending bitmaps. The engine does not need to be kicked, as
+ * arbitration always follows the completion of a minor loop; in instant mode
+ * a whole link chain is therefore drained by the same bottom half run.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The linked channel.
+ */
+static void nxps32k358_edma_link(NXPS32K358EDMAState *s, int c) {
+    nxps32k358_edma_count_request(s, c);
+    s->tcd[c].tcd_csr |= R_TCD_CSR_START_MASK;
+    nxps32k358_edma_update_pending(s, c);
+}
+
+/**
+ * @brief Records an error of a channel.
+ *
+ * The error bits are set in CH_ES together with ERR, and copied to EDMA_ES
+ * with the channel number, so that EDMA_ES always describes the last error.
+ * The channel is retired: START and ERQ are cleared, otherwise a hardware
+ * request that stays asserted would repeat the same error forever. Then the
+ * error interrupt is raised if enabled (CH_CSR.EEI) and, if EDMA_CSR.HAE is
+ * set, the engine is halted.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel.
+ * @param err The CH_ES error bits to record.
+ */
+static void nxps32k358_edma_error(NXPS32K358EDMAState *s, int c,
+                                  uint32_t err) {
+    struct NXPS32K358EDMATCDState *ch = &s->tcd[c];
+
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: channel %d error 0x%02" PRIx32 "\n",
+                  __func__, c, err);
+    trace_nxps32k358_edma_error(c, err);
+
+    ch->ch_es |= err | R_CH_ES_ERR_MASK;
+    s->edma_es = err | R_EDMA_ES_VLD_MASK;
+    s->edma_es = FIELD_DP32(s->edma_es, EDMA_ES, ERRCHN, c);
+
+    ch->ch_csr &= ~(R_CH_CSR_ACTIVE_MASK | R_CH_CSR_ERQ_MASK);
+    ch->tcd_csr &= ~R_TCD_CSR_START_MASK;
+    nxps32k358_edma_update_hrs(s, c);
+    nxps32k358_edma_update_pending(s, c);
+
+    nxps32k358_edma_tcd_update_irq(s, c);
+
+    if (s->edma_csr & R_EDMA_CSR_HAE_MASK) {
+        s->edma_csr |= R_EDMA_CSR_HALT_MASK;
+    }
+}
+
+/**
+ * @brief Checks the TCD of a channel before a minor loop is executed.
+ *
+ * These are the configuration errors detected by the hardware when a channel
+ * is activated, in which case the TCD is not executed at all:
+ * - SAE/DAE: the address is not aligned on the transfer size, or the size is
+ * the reserved value 0b111;
+ * - SOE/DOE: the offset is not a multiple of the transfer size;
+ * - NCE: NBYTES is not a multiple of the larger transfer size, CITER is zero
+ * or the ELINK bits of CITER and BITER differ;
+ * - SGE: scatter-gather is enabled and DLAST_SGA is not aligned on 32 bytes.
+ *
+ * @param ch Pointer to the NXPS32K358EDMATCDState structure.
+ * @return The CH_ES error bits, 0 if the TCD is valid.
+ */
+static uint32_t
+nxps32k358_edma_check_tcd(const struct NXPS32K358EDMATCDState *ch) {
+    uint32_t ssize = FIELD_EX16(ch->tcd_attr, TCD_ATTR, SSIZE);
+    uint32_t dsize = FIELD_EX16(ch->tcd_attr, TCD_ATTR, DSIZE);
+    uint32_t err = 0;
+
+    if (ssize == 0b111 || ch->tcd_saddr % (1 << ssize)) {
+        err |= R_CH_ES_SAE_MASK;
+    } else if (ch->tcd_soff % (1 << ssize)) {
+        err |= R_CH_ES_SOE_MASK;
+    }
+    if (dsize == 0b111 || ch->tcd_daddr % (1 << dsize)) {
+        err |= R_CH_ES_DAE_MASK;
+    } else if (ch->tcd_doff % (1 << dsize)) {
+        err |= R_CH_ES_DOE_MASK;
+    }
+
+    uint32_t max_size = 1 << MAX(ssize, dsize);
+    if ((ssize != 0b111 && dsize != 0b111 &&
+         nxps32k358_edma_nbytes(ch) % max_size) ||
+        nxps32k358_edma_iter_count(ch->tcd_citer) == 0 ||
+        ((ch->tcd_citer ^ ch->tcd_biter) & R_TCD_CITER_ELINK_MASK)) {
+        err |= R_CH_ES_NCE_MASK;
+    }
+
+    if (FIELD_EX16(ch->tcd_csr, TCD_CSR, ESG) &&
+        ch->tcd_dlast_sga % SGA_ALIGN) {
+        err |= R_CH_ES_SGE_MASK;
+    }
+
+    return err;
+}
+
+/**
+ * @brief Updates EDMA_ES after the error of a channel is cleared.
+ *
+ * The VLD bit of EDMA_ES is the logical OR of the ERR bits of all the
+ * channels, while the other fields keep describing the last error.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_update_es(NXPS32K358EDMAState *s) {
+    for (int c = 0; c < EDMA_CHANNELS; c++) {
+        if (s->tcd[c].ch_es & R_CH_ES_ERR_MASK) {
+            return;
+        }
+    }
+    s->edma_es &= ~R_EDMA_ES_VLD_MASK;
+}
+
+/**
+ * @brief Loads the next scatter-gather descriptor of a channel.
+ *
+ * The TCD image at addr is decoded into the TCD registers of the channel. If
+ * it was prefetched during the current engine pass it is taken from the
+ * descriptor cache, otherwise it is read from memory. When the new descriptor
+ * enables scatter-gather too, the following one is prefetched right away, so
+ * that a chain serviced in a single pass (instant mode) reads every
+ * descriptor ahead of its use.
+ *
+ * The cache is only trusted within the pass that filled it: the guest may
+ * rewrite a descriptor as soon as it runs again.
+ *
+ * A bus error while reading the descriptor leaves the TCD untouched, while a
+ * failed prefetch only leaves the cache empty: the error is reported if and
+ * when the descriptor is actually loaded.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel.
+ * @param addr Address of the TCD image (TCD_DLAST_SGA).
+ * @return MEMTX_OK, or the result of the failed descriptor read.
+ */
+static MemTxResult nxps32k358_edma_sg_load(NXPS32K358EDMAState *s, int c,
+                                           uint32_t addr) {
+    struct NXPS32K358EDMASGCache *cache = &s->sg_cache[c];
+    struct NXPS32K358EDMATCDState *ch = &s->tcd[c];
+    uint8_t image[NXPS32K358_TCD_IMAGE_SIZE];
+    bool cached = cache->pass == s->pass && cache->addr == addr;
+    MemTxResult res;
+
+    trace_nxps32k358_edma_sg_load(c, addr, cached);
+
+    if (cached) {
+        nxps32k358_tcd_decode(ch, cache->image);
     } else {
-        s->edma_int &= ~(1 << tcd_no);
-        qemu_set_irq(ch->irq, 0);
+        res = address_space_read(&address_space_memory, addr,
+                                 MEMTXATTRS_UNSPECIFIED, image, sizeof(image));
+        if (res != MEMTX_OK) {
+            return res;
+        }
+        nxps32k358_tcd_decode(ch, image);
     }
+    s->stats[c].sg_loads++;
+
+    // Prefetch the next descriptor of the chain
+    cache->pass = s->pass - 1;
+    if (FIELD_EX16(ch->tcd_csr, TCD_CSR, ESG)) {
+        res = address_space_read(&address_space_memory, ch->tcd_dlast_sga,
+                                 MEMTXATTRS_UNSPECIFIED, cache->image,
+                                 sizeof(cache->image));
+        if (res == MEMTX_OK) {
+            cache->addr = ch->tcd_dlast_sga;
+            cache->pass = s->pass;
+        }
+    }
+
+    return MEMTX_OK;
 }
 
 /**
@@ -114,21 +659,32 @@ static void nxps32k358_edma_tcd_update_irq(NXPS32K358EDMAState *s, int tcd_no) {
  * This function handles the transmission of data using the eDMA controller
  * for the specified Transfer Control Descriptor (TCD). It performs the
  * following steps:
+ * - Checks the TCD with nxps32k358_edma_check_tcd(), reporting the
+ *   configuration errors without executing it.
  * - Reads the source and destination addresses and sizes.
- * - Asserts that the source and destination sizes are valid.
  * - Calculates the number of bytes to transfer.
  * - Performs the major loop, which includes:
- *   - Reading data from the source address.
- *   - Writing data to the destination address.
- *   - Updating the source and destination addresses.
- *   - Decrementing the current iteration counter.
+ *   - Copying the whole minor loop with nxps32k358_edma_bulk_copy() if both
+ *     the source and the destination are contiguous and RAM-backed.
+ *   - Otherwise, reading data from the source address and writing data to the
+ *     destination address one beat at a time. A bus error ends the minor loop
+ *     and is reported as SBE or DBE, leaving the TCD unchanged.
+ *   - Updating the source and destination addresses, wrapping them inside
+ *     the SMOD/DMOD circular buffers and adding the minor loop offset if
+ *     SMLOE/DMLOE are set.
+ *   - Decrementing the current iteration counter and, if minor loop linking
+ *     is enabled and the major loop is not over, starting the linked channel.
  *   - Disabling the ACTIVE flag after the first minor loop is completed.
- *   - Updating the interrupt request.
+ *   - Raising the interrupt request when half (INTHALF) or all (INTMAJOR) of
+ *     the major loop is completed.
  * - Handles the completion of the major loop, which includes:
- *   - Writing the source last address adjustment if ESDA is set.
- *   - Writing the destination last address adjustment if ESG is set.
- *   - Resetting the current iteration counter to the beginning iteration count.
- *   - Setting the DONE flag and the interrupt flag.
+ *   - Storing the final destination address at SLAST_SDA if ESDA is set,
+ *     otherwise adding the source last address adjustment.
+ *   - Loading the next TCD with nxps32k358_edma_sg_load() if ESG is set,
+ *     otherwise writing the destination last address adjustment and resetting
+ *     the current iteration counter to the beginning iteration count.
+ *   - Setting the DONE flag.
+ *   - Starting the major loop linked channel, if MAJORELINK is set.
  *
  * @param s Pointer to the eDMA state structure.
  * @param tcd_no The TCD number to be processed.
@@ -139,124 +695,507 @@ static void nxps32k358_edma_transmit(NXPS32K358EDMAState *s, int tcd_no) {
 
     uint32_t saddr = 0;
     uint32_t daddr = 0;
+    MemTxResult res;
+
+    uint32_t err = nxps32k358_edma_check_tcd(ch);
+    if (err) {
+        nxps32k358_edma_error(s, tcd_no, err);
+        return;
+    }
 
     uint32_t ssize = FIELD_EX16(ch->tcd_attr, TCD_ATTR, SSIZE);
     uint32_t dsize = FIELD_EX16(ch->tcd_attr, TCD_ATTR, DSIZE);
 
-    // These values are reserved
-    assert(ssize != 0b111);
-    assert(dsize != 0b111);
-
     ssize = 1 << ssize;
     dsize = 1 << dsize;
 
-    uint32_t nbytes =
-        FIELD_EX32(ch->tcd_nbytes_mloff, TCD_NBYTES_MLOFF, NBYTES);
+    unsigned smod = FIELD_EX16(ch->tcd_attr, TCD_ATTR, SMOD);
+    unsigned dmod = FIELD_EX16(ch->tcd_attr, TCD_ATTR, DMOD);
+
+    bool smloe = FIELD_EX32(ch->tcd_nbytes_mloff, TCD_NBYTES_MLOFF, SMLOE);
+    bool dmloe = FIELD_EX32(ch->tcd_nbytes_mloff, TCD_NBYTES_MLOFF, DMLOE);
+    uint32_t nbytes = nxps32k358_edma_nbytes(ch);
+    int32_t mloff = 0;
+
+    if (smloe || dmloe) {
+        mloff = sextract32(ch->tcd_nbytes_mloff, R_TCD_NBYTES_MLOFF_MLOFF_SHIFT,
+                           R_TCD_NBYTES_MLOFF_MLOFF_LENGTH);
+    }
 
     uint32_t max_size = ssize > dsize ? ssize : dsize;
 
     // Major Loop, a new request is needed every time we want to advance
-    if (FIELD_EX16(ch->tcd_citer, TCD_CITER, CITER) > 0) {
+    if (nxps32k358_edma_iter_count(ch->tcd_citer) > 0) {
+        uint16_t citer = ch->tcd_citer;
+
         saddr = ch->tcd_saddr;
         daddr = ch->tcd_daddr;
 
+        // Only whole elements are moved, as in the per-beat loop below
+        uint32_t len = nbytes / max_size * max_size;
+        bool contiguous = ch->tcd_soff == ssize && ch->tcd_doff == dsize;
+
+        trace_nxps32k358_edma_service(tcd_no, saddr, daddr, len,
+                                      nxps32k358_edma_iter_count(citer));
+
         // Minor Loop
-        for (int i = 0; i < nbytes / max_size; i++) {
-            // Read from source
-            for (int j = 0; j < max_size / ssize; j++) {
-                cpu_physical_memory_read(saddr, buf, ssize);
-                saddr += ch->tcd_soff;
-            }
+        if (contiguous &&
+            nxps32k358_edma_bulk_copy(saddr, smod, daddr, dmod, len)) {
+            saddr = nxps32k358_edma_mod_add(saddr, len, smod);
+            daddr = nxps32k358_edma_mod_add(daddr, len, dmod);
+        } else {
+            for (int i = 0; i < nbytes / max_size; i++) {
+                // Read from source
+                for (int j = 0; j < max_size / ssize; j++) {
+                    res = address_space_read(&address_space_memory, saddr,
+                                             MEMTXATTRS_UNSPECIFIED,
+                                             buf + j * ssize, ssize);
+                    if (res != MEMTX_OK) {
+                        nxps32k358_edma_error(s, tcd_no, R_CH_ES_SBE_MASK);
+                        return;
+                    }
+                    saddr = nxps32k358_edma_mod_add(saddr, ch->tcd_soff, smod);
+                }
 
-            // Write to destination
-            for (int j = 0; j < max_size / dsize; j++) {
-                cpu_physical_memory_write(daddr, buf, dsize);
-                daddr += ch->tcd_doff;
+                // Write to destination
+                for (int j = 0; j < max_size / dsize; j++) {
+                    res = address_space_write(&address_space_memory, daddr,
+                                              MEMTXATTRS_UNSPECIFIED,
+                                              buf + j * dsize, dsize);
+                    if (res != MEMTX_OK) {
+                        nxps32k358_edma_error(s, tcd_no, R_CH_ES_DBE_MASK);
+                        return;
+                    }
+                    daddr = nxps32k358_edma_mod_add(daddr, ch->tcd_doff, dmod);
+                }
             }
         }
 
-        // In theory it should be incremented by mloff if smloe/dmloe
-        // are active. We write in the registers at the end of the minor loop as
-        // stated by the documentation
+        s->stats[tcd_no].bytes += len;
+        s->stats[tcd_no].minor_loops++;
+
+        // Minor loop offsets
+        if (smloe) {
+            saddr = nxps32k358_edma_mod_add(saddr, mloff, smod);
+        }
+        if (dmloe) {
+            daddr = nxps32k358_edma_mod_add(daddr, mloff, dmod);
+        }
+
+        // We write in the registers at the end of the minor loop as stated by
+        // the documentation
         ch->tcd_saddr = saddr;
         ch->tcd_daddr = daddr;
 
-        // Decrement current iteration counter
-        uint32_t next_citer = FIELD_EX16(ch->tcd_citer, TCD_CITER, CITER) - 1;
-        ch->tcd_citer = FIELD_DP16(ch->tcd_citer, TCD_CITER, CITER, next_citer);
+        // Decrement current iteration counter, the link fields are preserved
+        uint32_t next_citer = nxps32k358_edma_iter_count(ch->tcd_citer) - 1;
+        if (FIELD_EX16(ch->tcd_citer, TCD_CITER, ELINK)) {
+            ch->tcd_citer = FIELD_DP16(ch->tcd_citer, TCD_CITER, CITER_ELINK,
+                                       next_citer);
+            // Minor loop link, not performed on the last minor loop
+            if (next_citer > 0) {
+                int linkch = FIELD_EX16(ch->tcd_citer, TCD_CITER, LINKCH);
+                trace_nxps32k358_edma_link(tcd_no, linkch);
+                nxps32k358_edma_link(s, linkch);
+            }
+        } else {
+            ch->tcd_citer =
+                FIELD_DP16(ch->tcd_citer, TCD_CITER, CITER, next_citer);
+        }
 
         // Disable ACTIVE after first minor loop is completed
         ch->ch_csr &= ~R_CH_CSR_ACTIVE_MASK;
 
+        // Half and end of major loop interrupts
+        uint32_t biter = nxps32k358_edma_iter_count(ch->tcd_biter);
+        if ((FIELD_EX16(ch->tcd_csr, TCD_CSR, INTHALF) &&
+             next_citer == biter / 2) ||
+            (FIELD_EX16(ch->tcd_csr, TCD_CSR, INTMAJOR) && next_citer == 0)) {
+            ch->ch_int |= R_CH_INT_INT_MASK;
+        }
         nxps32k358_edma_tcd_update_irq(s, tcd_no);
     }
 
     // Major loop completed
-    if (FIELD_EX16(ch->tcd_citer, TCD_CITER, CITER) == 0) {
-        uint8_t esda = FIELD_EX32(ch->tcd_csr, TCD_CSR, ESDA);
+    if (nxps32k358_edma_iter_count(ch->tcd_citer) == 0) {
+        // A scatter-gather load replaces the TCD, keep the completed one's CSR
+        uint16_t csr = ch->tcd_csr;
+
+        s->stats[tcd_no].major_loops++;
+        trace_nxps32k358_edma_major_loop(tcd_no);
+
+        uint8_t esda = FIELD_EX32(csr, TCD_CSR, ESDA);
         if (esda) {
             uint32_t slast_sda =
                 FIELD_EX32(ch->tcd_slast_sda, TCD_SLAST_SDA, SLAST_SDA);
-            cpu_physical_memory_write(
-                slast_sda, (void *)(uintptr_t)ch->tcd_daddr, sizeof(slast_sda));
+            address_space_stl_le(&address_space_memory, slast_sda,
+                                 ch->tcd_daddr, MEMTXATTRS_UNSPECIFIED, &res);
+            if (res != MEMTX_OK) {
+                nxps32k358_edma_error(s, tcd_no, R_CH_ES_DBE_MASK);
+                return;
+            }
         } else {
             ch->tcd_saddr =
                 ch->tcd_saddr +
                 FIELD_EX32(ch->tcd_slast_sda, TCD_SLAST_SDA, SLAST_SDA);
         }
 
-        uint8_t esg = FIELD_EX32(ch->tcd_csr, TCD_CSR, ESG);
+        uint8_t esg = FIELD_EX32(csr, TCD_CSR, ESG);
         if (esg) {
             uint32_t dlast_sga =
                 FIELD_EX32(ch->tcd_dlast_sga, TCD_DLAST_SGA, DLAST_SGA);
-            uint8_t next_tcd_data[32];
-            cpu_physical_memory_read(dlast_sga, next_tcd_data, 32);
-
-            memcpy(&ch->tcd_saddr, next_tcd_data, 32);
+            if (nxps32k358_edma_sg_load(s, tcd_no, dlast_sga) != MEMTX_OK) {
+                nxps32k358_edma_error(s, tcd_no, R_CH_ES_SBE_MASK);
+                return;
+            }
+            // The new descriptor may come with START set
+            nxps32k358_edma_update_pending(s, tcd_no);
         } else {
             ch->tcd_daddr =
                 ch->tcd_daddr +
                 FIELD_EX32(ch->tcd_dlast_sga, TCD_DLAST_SGA, DLAST_SGA);
+            // CITER is reloaded from BITER, including the minor link fields
+            ch->tcd_citer = ch->tcd_biter;
         }
 
-        ch->tcd_citer = FIELD_DP16(ch->tcd_citer, TCD_CITER, CITER,
-                                   FIELD_EX16(ch->tcd_biter, TCD_BITER, BITER));
-
         ch->ch_csr |= R_CH_CSR_DONE_MASK;
-        ch->ch_int |= R_CH_INT_INT_MASK;
+
+        // Disable hardware requests at the end of the major loop
+        if (FIELD_EX16(csr, TCD_CSR, DREQ)) {
+            ch->ch_csr &= ~R_CH_CSR_ERQ_MASK;
+            nxps32k358_edma_update_hrs(s, tcd_no);
+        }
+
+        // Major loop link
+        if (FIELD_EX16(csr, TCD_CSR, MAJORELINK)) {
+            int linkch = FIELD_EX16(csr, TCD_CSR, MAJORLINKCH);
+            trace_nxps32k358_edma_link(tcd_no, linkch);
+            nxps32k358_edma_link(s, linkch);
+        }
     }
 }
 
 /**
- * @brief Perform round-robin arbitration for the eDMA channels.
+ * @brief Selects the next channel to be serviced.
  *
- * This function implements a basic round-robin arbitration mechanism for the
- * eDMA channels. It iterates through the channels starting from the last
- * offset and checks if the channel's TCD (Transfer Control Descriptor) has
- * the START bit set in its CSR (Control and Status Register). If a channel
- * is found with the START bit set, it clears the DONE bit, clears the START
- * bit, sets the ACTIVE bit, and initiates the transmission for that channel.
- * The offset is then updated to the next channel.
+ * Only the pending channels that are not already in progress (active or
+ * preempted) are considered. Two arbitration modes are supported, both
+ * running in constant time on the pending bitmaps:
+ * - fixed priority (EDMA_CSR.ERCA = 0): the highest priority channel wins,
+ * found with a single find-first-set on the priority-ordered bitmap;
+ * - round-robin (EDMA_CSR.ERCA = 1): priorities are ignored and the first
+ * pending channel after the last serviced one wins.
  *
  * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @return The selected channel, or -1 if no channel has a pending request.
+ */
+static int nxps32k358_edma_select(NXPS32K358EDMAState *s) {
+    uint32_t busy = 0;
+
+    if (s->active_ch >= 0) {
+        busy |= 1U << s->active_ch;
+    }
+    if (s->preempted_ch >= 0) {
+        busy |= 1U << s->preempted_ch;
+    }
+
+    if (s->edma_csr & R_EDMA_CSR_ERCA_MASK) {
+        uint32_t ready = s->pending & ~busy;
+        // Channels after the last one served; rr_next is 0 after reset and
+        // after channel 31, when every channel comes after it
+        uint32_t after =
+            s->rr_next ? ready & ~MAKE_64BIT_MASK(0, s->rr_next) : ready;
+
+        if (!ready) {
+            return -1;
+        }
+        return ctz32(after ? after : ready);
+    } else {
+        uint32_t busy_rank = 0;
+
+        for (int c = 0; busy; c++, busy >>= 1) {
+            if (busy & 1) {
+                busy_rank |= 1U << s->rank[c];
+            }
+        }
+
+        uint32_t ready = s->pending_rank & ~busy_rank;
+        if (!ready) {
+            return -1;
+        }
+        return s->prio_order[ctz32(ready)];
+    }
+}
+
+/**
+ * @brief Makes a channel the one being serviced by the engine.
+ *
+ * The software START request of the channel is consumed, the DONE bit is
+ * cleared and the ACTIVE bit is set, both in the channel and in the global
+ * CSR.
  *
- * @note There is no support for priorities in this implementation.
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel.
  */
-static void nxps32k358_edma_arbitrate(NXPS32K358EDMAState *s) {
-    static int offset = 0;
+static void nxps32k358_edma_activate(NXPS32K358EDMAState *s, int c) {
+    s->tcd[c].ch_csr &= ~R_CH_CSR_DONE_MASK;
+    s->tcd[c].tcd_csr &= ~R_TCD_CSR_START_MASK;
+    s->tcd[c].ch_csr |= R_CH_CSR_ACTIVE_MASK;
+    s->edma_csr = FIELD_DP32(s->edma_csr, EDMA_CSR, ACTIVE_ID, c);
+    s->edma_csr |= R_EDMA_CSR_ACTIVE_MASK;
+    nxps32k358_edma_update_pending(s, c);
+}
 
-    // Since there is no support for priorities, we implement a basic
-    // round-robin arbitration
-    for (int i = 0; i < EDMA_CHANNELS; i++) {
-        int j = (i + offset) % EDMA_CHANNELS;
-        if (s->tcd[j].tcd_csr & R_TCD_CSR_START_MASK) {
-            s->tcd[j].ch_csr &= ~R_CH_CSR_DONE_MASK;
-            s->tcd[j].tcd_csr &= ~R_TCD_CSR_START_MASK;
-            s->tcd[j].ch_csr |= R_CH_CSR_ACTIVE_MASK;
-            nxps32k358_edma_transmit(s, j);
-            offset = (j + 1) % EDMA_CHANNELS;
+/**
+ * @brief Perform arbitration for the eDMA channels.
+ *
+ * This function selects the next channel with nxps32k358_edma_select() and
+ * activates it. In round-robin mode, the arbitration restarts from the channel
+ * following the selected one.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @return The number of the selected channel, or -1 if no channel has a
+ * pending request.
+ */
+static int nxps32k358_edma_arbitrate(NXPS32K358EDMAState *s) {
+    int c = nxps32k358_edma_select(s);
+
+    if (c >= 0) {
+        nxps32k358_edma_activate(s, c);
+        s->rr_next = (c + 1) % EDMA_CHANNELS;
+    }
+
+    return c;
+}
+
+/**
+ * @brief Checks whether a channel may preempt the active one.
+ *
+ * Preemption only happens with fixed-priority arbitration, when the active
+ * channel allows it (CH_PRI.ECP), the candidate is able to preempt
+ * (CH_PRI.DPA clear) and has a strictly higher priority. Only one level of
+ * preemption is supported, as on the real hardware.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The candidate channel.
+ * @return true if the active channel must be suspended in favour of c.
+ */
+static bool nxps32k358_edma_can_preempt(NXPS32K358EDMAState *s, int c) {
+    int a = s->active_ch;
+
+    return !(s->edma_csr & R_EDMA_CSR_ERCA_MASK) && s->preempted_ch < 0 &&
+           FIELD_EX32(s->tcd[a].ch_pri, CH_PRI, ECP) &&
+           !FIELD_EX32(s->tcd[c].ch_pri, CH_PRI, DPA) &&
+           nxps32k358_edma_priority(s, c) > nxps32k358_edma_priority(s, a);
+}
+
+/**
+ * @brief Completes the minor loop of the channel selected by the arbiter.
+ *
+ * The data is moved by nxps32k358_edma_transmit(), which also clears the
+ * channel ACTIVE flag and raises the completion interrupts. The engine is then
+ * marked as idle in the global CSR. The host time spent is accounted to the
+ * channel.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel to be serviced.
+ */
+static void nxps32k358_edma_service(NXPS32K358EDMAState *s, int c) {
+    int64_t start = get_clock();
+
+    nxps32k358_edma_transmit(s, c);
+    s->edma_csr &= ~R_EDMA_CSR_ACTIVE_MASK;
+
+    s->stats[c].host_ns += get_clock() - start;
+}
+
+/**
+ * @brief Computes the emulated duration of a minor loop.
+ *
+ * The duration is derived from the minor loop byte count and the bandwidth
+ * property of the controller, expressed in bytes per microsecond (MB/s).
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param c The channel about to be serviced.
+ * @return The duration of the minor loop in nanoseconds (at least 1).
+ */
+static int64_t nxps32k358_edma_minor_loop_ns(NXPS32K358EDMAState *s, int c) {
+    uint32_t nbytes = nxps32k358_edma_nbytes(&s->tcd[c]);
+
+    return MAX(muldiv64(nbytes, 1000, s->bandwidth), 1);
+}
+
+/**
+ * @brief Starts the next minor loop when the engine runs in timed mode.
+ *
+ * If the engine is not halted and a channel has a pending request, the
+ * channel is made active and the engine timer is armed to fire when the
+ * modelled transfer ends.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_start_next(NXPS32K358EDMAState *s) {
+    if (s->edma_csr & R_EDMA_CSR_HALT_MASK) {
+        return;
+    }
+
+    int c = nxps32k358_edma_arbitrate(s);
+    if (c < 0) {
+        return;
+    }
+
+    s->active_ch = c;
+    s->active_end = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                    nxps32k358_edma_minor_loop_ns(s, c);
+    timer_mod(s->engine_timer, s->active_end);
+}
+
+/**
+ * @brief Suspends the active minor loop in favour of a higher priority one.
+ *
+ * The remaining time of the active minor loop is saved, and the preempting
+ * channel is started. The suspended channel resumes as soon as the preempting
+ * minor loop completes.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_preempt(NXPS32K358EDMAState *s) {
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    s->preempted_ch = s->active_ch;
+    s->preempted_left = MAX(s->active_end - now, 0);
+    s->active_ch = -1;
+
+    nxps32k358_edma_start_next(s);
+}
+
+/**
+ * @brief Resumes the minor loop suspended by nxps32k358_edma_preempt().
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_resume(NXPS32K358EDMAState *s) {
+    int c = s->preempted_ch;
+
+    s->preempted_ch = -1;
+    s->active_ch = c;
+    s->active_end =
+        qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + s->preempted_left;
+    s->edma_csr = FIELD_DP32(s->edma_csr, EDMA_CSR, ACTIVE_ID, c);
+    s->edma_csr |= R_EDMA_CSR_ACTIVE_MASK;
+    timer_mod(s->engine_timer, s->active_end);
+}
+
+/**
+ * @brief Engine timer callback, called when the active minor loop ends.
+ *
+ * After the minor loop is completed, a preempted channel (if any) is resumed,
+ * otherwise the next channel is selected by the arbiter.
+ *
+ * @param opaque Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_timer_cb(void *opaque) {
+    NXPS32K358EDMAState *s = opaque;
+    int c = s->active_ch;
+
+    s->pass++;
+    s->active_ch = -1;
+    if (c >= 0) {
+        nxps32k358_edma_service(s, c);
+    }
+
+    if (s->preempted_ch >= 0) {
+        nxps32k358_edma_resume(s);
+    } else {
+        nxps32k358_edma_start_next(s);
+    }
+}
+
+/**
+ * @brief Engine bottom half, used when the engine runs in instant mode.
+ *
+ * All the channels with a pending request are serviced in a single pass,
+ * without modelling the transfer time. A hardware request that is never
+ * deasserted would keep the loop running forever, so after
+ * EDMA_BH_MAX_SERVICES minor loops the bottom half yields to the main loop and
+ * reschedules itself.
+ *
+ * @param opaque Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_bh(void *opaque) {
+    NXPS32K358EDMAState *s = opaque;
+    int c;
+
+    s->pass++;
+    for (int n = 0; n < EDMA_BH_MAX_SERVICES; n++) {
+        if (s->edma_csr & R_EDMA_CSR_HALT_MASK) {
+            return;
+        }
+        c = nxps32k358_edma_arbitrate(s);
+        if (c < 0) {
             return;
         }
+        nxps32k358_edma_service(s, c);
+    }
+
+    qemu_bh_schedule(s->engine_bh);
+}
+
+/**
+ * @brief Notifies the engine that a channel may have a pending request.
+ *
+ * Channels are never serviced from the MMIO handler: in instant mode the
+ * engine bottom half is scheduled, otherwise the next minor loop is started
+ * if the engine is idle, or the active one is preempted if a higher priority
+ * channel is now pending.
+ *
+ * @note In instant mode minor loops take no time, so they are never
+ * preempted; priorities only decide the service order.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ */
+static void nxps32k358_edma_kick(NXPS32K358EDMAState *s) {
+    if (s->instant) {
+        qemu_bh_schedule(s->engine_bh);
+    } else if (s->active_ch < 0) {
+        if (s->preempted_ch < 0) {
+            nxps32k358_edma_start_next(s);
+        }
+    } else if (!(s->edma_csr & R_EDMA_CSR_HALT_MASK)) {
+        int c = nxps32k358_edma_select(s);
+        if (c >= 0 && nxps32k358_edma_can_preempt(s, c)) {
+            nxps32k358_edma_preempt(s);
+        }
+    }
+}
+
+/**
+ * @brief GPIO handler for the hardware service request lines.
+ *
+ * The request lines are driven by the DMAMUX. While a line is asserted and
+ * hardware requests are enabled for the channel, the channel is serviced one
+ * minor loop at a time.
+ *
+ * @param opaque Pointer to the NXPS32K358EDMAState structure.
+ * @param n The channel number.
+ * @param level The new level of the request line.
+ */
+static void nxps32k358_edma_dma_req(void *opaque, int n, int level) {
+    NXPS32K358EDMAState *s = opaque;
+
+    if (level && !(s->dma_req & (1U << n))) {
+        nxps32k358_edma_count_request(s, n);
+    }
+
+    if (level) {
+        s->dma_req |= 1U << n;
+    } else {
+        s->dma_req &= ~(1U << n);
+    }
+    nxps32k358_edma_update_hrs(s, n);
+
+    if (s->edma_hrs & (1U << n)) {
+        nxps32k358_edma_kick(s);
     }
 }
 
@@ -353,19 +1292,13 @@ static uint64_t nxps32k358_edma_tcd_read(NXPS32K358EDMAState *s, hwaddr offset,
  * @param size Size of the value being written.
  * @param c Channel number to which the TCD belongs.
  *
- * The function supports writing to all the fields of the TCD, excluding:
- * - A_CH_SBR
- * - A_CH_PRI
- *
- * The function also performs various checks and assertions to ensure the
- * correctness of the written values, such as ensuring that certain bits are
- * not set and that specific fields match expected values, as stated in the
- * documentation.
+ * The function supports writing to all the fields of the TCD, excluding
+ * A_CH_SBR.
  *
  * If an unsupported offset is provided, an error message is logged.
  *
- * @note The function does not support channel linking, SMLOE, DMLOE, BWC, the
- * last 4 bits of CH_CSR and probably other features.
+ * @note The function does not support BWC and probably other features.
+ * CH_CSR.EARQ and CH_CSR.EBW are stored but have no effect.
  */
 static void nxps32k358_edma_tcd_write(NXPS32K358EDMAState *s, hwaddr offset,
                                       uint64_t value, unsigned size,
@@ -376,14 +1309,25 @@ static void nxps32k358_edma_tcd_write(NXPS32K358EDMAState *s, hwaddr offset,
 
     switch (offset) {
         case A_CH_CSR:
-            ch->ch_csr &= ~R_CH_CSR_DONE_MASK;
-            ch->ch_csr |= value & R_CH_CSR_DONE_MASK;
-            // The last 4 bits should be writable too but there is no support
+            // DONE is write 1 to clear
+            if (value & R_CH_CSR_DONE_MASK) {
+                ch->ch_csr &= ~R_CH_CSR_DONE_MASK;
+            }
+            ch->ch_csr &= ~CH_CSR_WR_MASK;
+            ch->ch_csr |= value & CH_CSR_WR_MASK;
+            // EEI may have just enabled the error interrupt
+            nxps32k358_edma_tcd_update_irq(s, c);
+            // ERQ may have just enabled an already asserted request
+            nxps32k358_edma_update_hrs(s, c);
+            nxps32k358_edma_kick(s);
             break;
         case A_CH_ES:
-            // SW must be able to clear the error status (first bit)
-            ch->ch_es &= ~R_CH_ES_ERR_MASK;
-            ch->ch_es |= value & R_CH_ES_ERR_MASK;
+            // ERR is write 1 to clear, together with the error bits
+            if (value & R_CH_ES_ERR_MASK) {
+                ch->ch_es = 0;
+                nxps32k358_edma_update_es(s);
+                nxps32k358_edma_tcd_update_irq(s, c);
+            }
             break;
         case A_CH_INT:
             // Write 1 to clear (i.e. disable the interrupt request)
@@ -391,7 +1335,10 @@ static void nxps32k358_edma_tcd_write(NXPS32K358EDMAState *s, hwaddr offset,
             nxps32k358_edma_tcd_update_irq(s, c);
             break;
         case NO_SUPPORT A_CH_SBR:
-        case NO_SUPPORT A_CH_PRI:
+            break;
+        case A_CH_PRI:
+            ch->ch_pri = value & CH_PRI_WR_MASK;
+            nxps32k358_edma_update_priorities(s);
             break;
         case A_TCD_SADDR:
             ch->tcd_saddr = value;
@@ -403,9 +1350,6 @@ static void nxps32k358_edma_tcd_write(NXPS32K358EDMAState *s, hwaddr offset,
             ch->tcd_attr = value;
             break;
         case A_TCD_NBYTES_MLOFF:
-            // No support for SMLOE and DMLOE, we implement MLOFF only
-            assert((value & R_TCD_NBYTES_MLOFF_SMLOE_MASK) == 0);
-            assert((value & R_TCD_NBYTES_MLOFF_DMLOE_MASK) == 0);
             ch->tcd_nbytes_mloff = value;
             break;
         case A_TCD_SLAST_SDA:
@@ -418,11 +1362,6 @@ static void nxps32k358_edma_tcd_write(NXPS32K358EDMAState *s, hwaddr offset,
             ch->tcd_doff = value;
             break;
         case A_TCD_CITER:
-            // No support for channel linking
-            assert((value & R_TCD_CITER_ELINK_MASK) == 0);
-            // The documentation states that when CITER is written, its value
-            // must be equal to BITER
-            assert(value == FIELD_EX32(ch->tcd_biter, TCD_BITER, BITER));
             ch->tcd_citer = value;
             break;
         case A_TCD_DLAST_SGA:
@@ -430,17 +1369,18 @@ static void nxps32k358_edma_tcd_write(NXPS32K358EDMAState *s, hwaddr offset,
             break;
         case A_TCD_CSR:
             // No support for bwc (it would make little sense in an emulated
-            // context), don't care. Also, no support for channel linking
-            assert((value & R_TCD_CSR_MAJORELINK_MASK) == 0);
+            // context), don't care
+            if (value & R_TCD_CSR_START_MASK) {
+                nxps32k358_edma_count_request(s, c);
+            }
             ch->tcd_csr = value;
+            nxps32k358_edma_update_pending(s, c);
             // Start request
             if (value & R_TCD_CSR_START_MASK) {
-                nxps32k358_edma_arbitrate(s);
+                nxps32k358_edma_kick(s);
             }
             break;
         case A_TCD_BITER:
-            // No support for channel linking
-            assert((value & R_TCD_BITER_ELINK_MASK) == 0);
             ch->tcd_biter = value;
             break;
         default:
@@ -494,8 +1434,6 @@ static void nxps32k358_edma_tcd_reset(struct NXPS32K358EDMATCDState *s) {
  *
  * @return The value read from the specified register.
  *
- * @note There is no real support for group priorities, we just return the value
- * saved in the field.
  */
 static uint64_t nxps32k358_edma_global_read(NXPS32K358EDMAState *s,
                                             hwaddr offset, unsigned size) {
@@ -546,8 +1484,8 @@ static uint64_t nxps32k358_edma_global_read(NXPS32K358EDMAState *s,
  *
  * If an invalid offset is provided, an error message is logged.
  *
- * @note There is no real support for group priorities, we just write the value
- * to the field.
+ * Changing a group priority reorders the channels for fixed-priority
+ * arbitration.
  */
 static void nxps32k358_edma_global_write(NXPS32K358EDMAState *s, hwaddr offset,
                                          uint64_t value, unsigned size) {
@@ -557,6 +1495,8 @@ static void nxps32k358_edma_global_write(NXPS32K358EDMAState *s, hwaddr offset,
         case A_EDMA_CSR:
             s->edma_csr &= ~CSR_WR_MASK;
             s->edma_csr |= value & CSR_WR_MASK;
+            // Requests left pending while halted can now be serviced
+            nxps32k358_edma_kick(s);
             break;
         case A_EDMA_ES:
         case A_EDMA_INT:
@@ -568,6 +1508,7 @@ static void nxps32k358_edma_global_write(NXPS32K358EDMAState *s, hwaddr offset,
                 int n = (offset - A_EDMA_CHN_GRPRI(0)) / 4;
                 s->edma_chn_grpri[n] &= ~GRPRI_WR_MASK;
                 s->edma_chn_grpri[n] |= value & GRPRI_WR_MASK;
+                nxps32k358_edma_update_priorities(s);
                 break;
             }
             qemu_log_mask(LOG_GUEST_ERROR,
@@ -698,7 +1639,8 @@ static const MemoryRegionOps nxps32k358_edma12_ops = {
  * (TCD0-TCD11)
  * - mmio12: Memory region for the remaining TCDs (TCD12-TCD31)
  *
- * IRQs initialized for each eDMA channel.
+ * IRQs initialized for each eDMA channel, together with one hardware service
+ * request input (NXPS32K358_EDMA_REQ) per channel.
  */
 static void nxps32k358_edma_init(Object *obj) {
     NXPS32K358EDMAState *s = NXPS32K358_EDMA(obj);
@@ -714,6 +1656,9 @@ static void nxps32k358_edma_init(Object *obj) {
     for (int i = 0; i < EDMA_CHANNELS; i++) {
         sysbus_init_irq(SYS_BUS_DEVICE(s), &s->tcd[i].irq);
     }
+
+    qdev_init_gpio_in_named(DEVICE(s), nxps32k358_edma_dma_req,
+                            NXPS32K358_EDMA_REQ, EDMA_CHANNELS);
 }
 
 /**
@@ -728,6 +1673,16 @@ static void nxps32k358_edma_init(Object *obj) {
 static void nxps32k358_edma_reset(DeviceState *dev) {
     NXPS32K358EDMAState *s = NXPS32K358_EDMA(dev);
 
+    timer_del(s->engine_timer);
+    qemu_bh_cancel(s->engine_bh);
+    s->active_ch = -1;
+    s->preempted_ch = -1;
+    s->rr_next = 0;
+    s->pending = 0;
+    // Pass 0 is never current, so all the cache entries are invalid
+    memset(s->sg_cache, 0, sizeof(s->sg_cache));
+    s->pass = 1;
+
     s->edma_csr = EDMA_CSR_RESET;
     s->edma_es = EDMA_ES_RESET;
     s->edma_int = EDMA_INT_RESET;
@@ -737,17 +1692,249 @@ static void nxps32k358_edma_reset(DeviceState *dev) {
         nxps32k358_edma_tcd_reset(&s->tcd[i]);
         nxps32k358_edma_tcd_update_irq(s, i);
     }
+    nxps32k358_edma_update_priorities(s);
 }
 
+/**
+ * @brief Realize the NXPS32K358 eDMA controller.
+ *
+ * This function validates the engine properties and creates the engine timer
+ * (timed mode) and bottom half (instant mode) before resetting the device.
+ *
+ * @param dev The device state.
+ * @param errp Pointer to an error object.
+ */
 static void nxps32k358_edma_realize(DeviceState *dev, Error **errp) {
+    NXPS32K358EDMAState *s = NXPS32K358_EDMA(dev);
+
+    if (!s->instant && s->bandwidth == 0) {
+        error_setg(errp, "eDMA bandwidth must be greater than zero");
+        return;
+    }
+
+    s->engine_timer =
+        timer_new_ns(QEMU_CLOCK_VIRTUAL, nxps32k358_edma_timer_cb, s);
+    s->engine_bh =
+        qemu_bh_new_guarded(nxps32k358_edma_bh, s, &dev->mem_reentrancy_guard);
+
     nxps32k358_edma_reset(dev);
 }
 
+/**
+ * @struct NXPS32K358EDMACounter
+ * @brief Describes a per-channel performance counter.
+ *
+ * @var NXPS32K358EDMACounter::name
+ * Name of the counter in query-stats. The read-only QOM property has the same
+ * name with a "stats-" prefix.
+ *
+ * @var NXPS32K358EDMACounter::offset
+ * Offset of the counter in NXPS32K358EDMAChannelStats.
+ *
+ * @var NXPS32K358EDMACounter::unit
+ * Unit of measure of the counter.
+ *
+ * @var NXPS32K358EDMACounter::has_unit
+ * false if the counter is a plain number of events.
+ *
+ * @var NXPS32K358EDMACounter::exponent
+ * Power of ten the unit is multiplied by.
+ */
+struct NXPS32K358EDMACounter {
+    const char *name;
+    size_t offset;
+    StatsUnit unit;
+    bool has_unit;
+    int16_t exponent;
+};
+
+static const struct NXPS32K358EDMACounter nxps32k358_edma_counters[] = {
+    { "bytes", offsetof(struct NXPS32K358EDMAChannelStats, bytes),
+      STATS_UNIT_BYTES, true, 0 },
+    { "minor-loops", offsetof(struct NXPS32K358EDMAChannelStats, minor_loops) },
+    { "major-loops", offsetof(struct NXPS32K358EDMAChannelStats, major_loops) },
+    { "sg-loads", offsetof(struct NXPS32K358EDMAChannelStats, sg_loads) },
+    { "dropped-requests",
+      offsetof(struct NXPS32K358EDMAChannelStats, dropped_requests) },
+    { "host-time", offsetof(struct NXPS32K358EDMAChannelStats, host_ns),
+      STATS_UNIT_SECONDS, true, -9 },
+};
+
+/**
+ * @brief Collects a counter of all the channels into a list.
+ *
+ * @param s Pointer to the NXPS32K358EDMAState structure.
+ * @param counter The counter to be collected.
+ * @return A newly allocated list with one value per channel, channel 0 first.
+ */
+static uint64List *
+nxps32k358_edma_counter_list(NXPS32K358EDMAState *s,
+                             const struct NXPS32K358EDMACounter *counter) {
+    uint64List *list = NULL;
+
+    for (int c = EDMA_CHANNELS - 1; c >= 0; c--) {
+        QAPI_LIST_PREPEND(list, *(uint64_t *)((uint8_t *)&s->stats[c] +
+                                              counter->offset));
+    }
+
+    return list;
+}
+
+/**
+ * @brief Getter of the read-only "stats-*" QOM properties.
+ *
+ * @param obj The eDMA object.
+ * @param v The visitor.
+ * @param name Name of the property.
+ * @param opaque The NXPS32K358EDMACounter of the property.
+ * @param errp Pointer to an error object.
+ */
+static void nxps32k358_edma_get_counter(Object *obj, Visitor *v,
+                                        const char *name, void *opaque,
+                                        Error **errp) {
+    NXPS32K358EDMAState *s = NXPS32K358_EDMA(obj);
+    uint64List *list = nxps32k358_edma_counter_list(s, opaque);
+
+    visit_type_uint64List(v, name, &list, errp);
+    qapi_free_uint64List(list);
+}
+
+/**
+ * @struct NXPS32K358EDMAStatsArgs
+ * @brief Arguments of a query-stats walk over the QOM tree.
+ *
+ * @var NXPS32K358EDMAStatsArgs::result
+ * The results being built.
+ *
+ * @var NXPS32K358EDMAStatsArgs::names
+ * The counters requested, NULL for all of them.
+ */
+struct NXPS32K358EDMAStatsArgs {
+    StatsResultList **result;
+    strList *names;
+};
+
+/**
+ * @brief Adds the counters of an eDMA controller to the query-stats results.
+ *
+ * @param obj The object being visited.
+ * @param opaque Pointer to the NXPS32K358EDMAStatsArgs of the query.
+ * @return Always 0, to visit every object.
+ */
+static int nxps32k358_edma_stats_query(Object *obj, void *opaque) {
+    struct NXPS32K358EDMAStatsArgs *args = opaque;
+    StatsList *stats_list = NULL;
+    g_autofree char *path = NULL;
+    NXPS32K358EDMAState *s;
+
+    if (!object_dynamic_cast(obj, TYPE_NXPS32K358_EDMA)) {
+        return 0;
+    }
+    s = NXPS32K358_EDMA(obj);
+
+    for (int i = ARRAY_SIZE(nxps32k358_edma_counters) - 1; i >= 0; i--) {
+        Stats *stats;
+
+        if (!apply_str_list_filter(nxps32k358_edma_counters[i].name,
+                                   args->names)) {
+            continue;
+        }
+
+        stats = g_new0(Stats, 1);
+
+        stats->name = g_strdup(nxps32k358_edma_counters[i].name);
+        stats->value = g_new0(StatsValue, 1);
+        stats->value->type = QTYPE_QLIST;
+        stats->value->u.list =
+            nxps32k358_edma_counter_list(s, &nxps32k358_edma_counters[i]);
+        QAPI_LIST_PREPEND(stats_list, stats);
+    }
+
+    path = object_get_canonical_path(obj);
+    add_stats_entry(args->result, STATS_PROVIDER_NXPS32K358_EDMA, path,
+                    stats_list);
+
+    return 0;
+}
+
+/**
+ * @brief query-stats callback of the eDMA statistics provider.
+ *
+ * Every eDMA controller in the machine reports one list per counter, with one
+ * value per channel.
+ *
+ * @param result The results being built.
+ * @param target The kind of object queried.
+ * @param names The counters requested, NULL for all of them.
+ * @param targets The objects requested (unused for devices).
+ * @param errp Pointer to an error object.
+ */
+static void nxps32k358_edma_stats_cb(StatsResultList **result,
+                                     StatsTarget target, strList *names,
+                                     strList *targets, Error **errp) {
+    struct NXPS32K358EDMAStatsArgs args = { result, names };
+
+    if (target == STATS_TARGET_DEVICE) {
+        object_child_foreach_recursive(object_get_root(),
+                                       nxps32k358_edma_stats_query, &args);
+    }
+}
+
+/**
+ * @brief query-stats-schemas callback of the eDMA statistics provider.
+ *
+ * @param result The schemas being built.
+ * @param errp Pointer to an error object.
+ */
+static void nxps32k358_edma_schemas_cb(StatsSchemaList **result,
+                                       Error **errp) {
+    StatsSchemaValueList *list = NULL;
+
+    for (int i = ARRAY_SIZE(nxps32k358_edma_counters) - 1; i >= 0; i--) {
+        const struct NXPS32K358EDMACounter *counter =
+            &nxps32k358_edma_counters[i];
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(counter->name);
+        value->type = STATS_TYPE_CUMULATIVE;
+        value->has_unit = counter->has_unit;
+        value->unit = counter->unit;
+        value->exponent = counter->exponent;
+        if (counter->exponent) {
+            value->has_base = true;
+            value->base = 10;
+        }
+        QAPI_LIST_PREPEND(list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_NXPS32K358_EDMA,
+                     STATS_TARGET_DEVICE, list);
+}
+
+static Property nxps32k358_edma_properties[] = {
+    DEFINE_PROP_BOOL("instant", NXPS32K358EDMAState, instant, false),
+    DEFINE_PROP_UINT32("bandwidth", NXPS32K358EDMAState, bandwidth,
+                       EDMA_DEFAULT_BANDWIDTH),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void nxps32k358_edma_class_init(ObjectClass *klass, void *data) {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = nxps32k358_edma_realize;
     device_class_set_legacy_reset(dc, nxps32k358_edma_reset);
+    device_class_set_props(dc, nxps32k358_edma_properties);
+
+    for (int i = 0; i < ARRAY_SIZE(nxps32k358_edma_counters); i++) {
+        g_autofree char *name =
+            g_strdup_printf("stats-%s", nxps32k358_edma_counters[i].name);
+        object_class_property_add(klass, name, "uint64List",
+                                  nxps32k358_edma_get_counter, NULL, NULL,
+                                  (void *)&nxps32k358_edma_counters[i]);
+    }
+
+    add_stats_callbacks(STATS_PROVIDER_NXPS32K358_EDMA,
+                        nxps32k358_edma_stats_cb, nxps32k358_edma_schemas_cb);
 }
 
 static const TypeInfo nxps32k358_edma_info = {
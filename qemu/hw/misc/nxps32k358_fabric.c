@@ -0,0 +1,449 @@
+/*
+ * NXPS32K358 peripheral fabric
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_fabric.c
+ * @brief Implementation of the NXPS32K358 peripheral fabric.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/misc/nxps32k358_fabric.h"
+#include "hw/qdev-properties.h"
+#include "qemu/bitops.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+// Peripherals of the address map, sorted by address. The peripherals spanning
+// two pages, or listed twice in the reference manual, have a "_1" suffix on
+// the second page. Modelled devices are listed too: they are mapped above the
+// fabric, which only sees the accesses outside of their registers.
+static const NXPS32K358FabricRegion nxps32k358_fabric_regions[] = {
+    { "hse_xbic", 0x008000, 0x4000 },
+    { "erm1", 0x00c000, 0x4000 },
+    { "pfc1", 0x068000, 0x4000 },
+    { "pfc1_alt", 0x06c000, 0x4000 },
+    { "swt_3", 0x070000, 0x4000 },
+    { "trgmux", 0x080000, 0x4000 },
+    { "bctu", 0x084000, 0x4000 },
+    { "emios0", 0x088000, 0x4000 },
+    { "emios1", 0x08c000, 0x4000 },
+    { "emios2", 0x090000, 0x4000 },
+    { "lcu0", 0x098000, 0x4000 },
+    { "lcu1", 0x09c000, 0x4000 },
+    { "adc_0", 0x0a0000, 0x4000 },
+    { "adc_1", 0x0a4000, 0x4000 },
+    { "adc_2", 0x0a8000, 0x4000 },
+    { "pit0", 0x0b0000, 0x4000 },
+    { "pit1", 0x0b4000, 0x4000 },
+    { "mu_2", 0x0b8000, 0x4000 },
+    { "mu_2_1", 0x0bc000, 0x4000 },
+    { "mu_3", 0x0c4000, 0x4000 },
+    { "mu_3_1", 0x0c8000, 0x4000 },
+    { "mu_4", 0x0cc000, 0x4000 },
+    { "mu_4_1", 0x0d0000, 0x4000 },
+    { "axbs", 0x200000, 0x4000 },
+    { "system_xbic", 0x204000, 0x4000 },
+    { "periph_xbic", 0x208000, 0x4000 },
+    { "edma", 0x20c000, 0x4000 },
+    { "edma_tcd_0", 0x210000, 0x4000 },
+    { "edma_tcd_1", 0x214000, 0x4000 },
+    { "edma_tcd_2", 0x218000, 0x4000 },
+    { "edma_tcd_3", 0x21c000, 0x4000 },
+    { "edma_tcd_4", 0x220000, 0x4000 },
+    { "edma_tcd_5", 0x224000, 0x4000 },
+    { "edma_tcd_6", 0x228000, 0x4000 },
+    { "edma_tcd_7", 0x22c000, 0x4000 },
+    { "edma_tcd_8", 0x230000, 0x4000 },
+    { "edma_tcd_9", 0x234000, 0x4000 },
+    { "edma_tcd_10", 0x238000, 0x4000 },
+    { "edma_tcd_11", 0x23c000, 0x4000 },
+    { "debug_apb_page0", 0x240000, 0x4000 },
+    { "debug_apb_page1", 0x244000, 0x4000 },
+    { "debug_apb_page2", 0x248000, 0x4000 },
+    { "debug_apb_page3", 0x24c000, 0x4000 },
+    { "debug_apb_paged_area", 0x250000, 0x4000 },
+    { "sda-ap", 0x254000, 0x4000 },
+    { "eim0", 0x258000, 0x4000 },
+    { "erm0", 0x25c000, 0x4000 },
+    { "mscm", 0x260000, 0x4000 },
+    { "pram_0", 0x264000, 0x4000 },
+    { "pfc", 0x268000, 0x4000 },
+    { "pfc_alt", 0x26c000, 0x4000 },
+    { "swt_0", 0x270000, 0x4000 },
+    { "stm_0", 0x274000, 0x4000 },
+    { "xrdc", 0x278000, 0x4000 },
+    { "intm", 0x27c000, 0x4000 },
+    { "dmamux_0", 0x280000, 0x4000 },
+    { "dmamux_1", 0x284000, 0x4000 },
+    { "rtc", 0x288000, 0x4000 },
+    { "mc_rgm", 0x28c000, 0x4000 },
+    { "siul_virtwrapper_pdac0_hse", 0x290000, 0x4000 },
+    { "siul_virtwrapper_pdac0_hse_1", 0x294000, 0x4000 },
+    { "siul_virtwrapper_pdac1_m7_0", 0x298000, 0x4000 },
+    { "siul_virtwrapper_pdac1_m7_0_1", 0x29c000, 0x4000 },
+    { "siul_virtwrapper_pdac2_m7_1", 0x2a0000, 0x4000 },
+    { "siul_virtwrapper_pdac2_m7_1_1", 0x2a4000, 0x4000 },
+    { "siul_virtwrapper_pdac3", 0x2a8000, 0x4000 },
+    { "dcm", 0x2ac000, 0x4000 },
+    { "wkpu", 0x2b4000, 0x4000 },
+    { "cmu", 0x2bc000, 0x4000 },
+    { "tspc", 0x2c4000, 0x4000 },
+    { "sirc", 0x2c8000, 0x4000 },
+    { "sxosc", 0x2cc000, 0x4000 },
+    { "firc", 0x2d0000, 0x4000 },
+    { "fxosc", 0x2d4000, 0x4000 },
+    { "mc_cgm", 0x2d8000, 0x4000 },
+    { "mc_me", 0x2dc000, 0x4000 },
+    { "pll", 0x2e0000, 0x4000 },
+    { "pll2", 0x2e4000, 0x4000 },
+    { "pmc", 0x2e8000, 0x4000 },
+    { "fmu", 0x2ec000, 0x4000 },
+    { "fmu_alt", 0x2f0000, 0x4000 },
+    { "siul_virtwrapper_pdac4_m7_2", 0x2f4000, 0x4000 },
+    { "siul_virtwrapper_pdac4_m7_2_1", 0x2f8000, 0x4000 },
+    { "pit2", 0x2fc000, 0x4000 },
+    { "pit3", 0x300000, 0x4000 },
+    { "flexcan_0", 0x304000, 0x4000 },
+    { "flexcan_1", 0x308000, 0x4000 },
+    { "flexcan_2", 0x30c000, 0x4000 },
+    { "flexcan_3", 0x310000, 0x4000 },
+    { "flexcan_4", 0x314000, 0x4000 },
+    { "flexcan_5", 0x318000, 0x4000 },
+    { "flexcan_6", 0x31c000, 0x4000 },
+    { "flexcan_7", 0x320000, 0x4000 },
+    { "flexio", 0x324000, 0x4000 },
+    { "lpuart_0", 0x328000, 0x4000 },
+    { "lpuart_1", 0x32c000, 0x4000 },
+    { "lpuart_2", 0x330000, 0x4000 },
+    { "lpuart_3", 0x334000, 0x4000 },
+    { "lpuart_4", 0x338000, 0x4000 },
+    { "lpuart_5", 0x33c000, 0x4000 },
+    { "lpuart_6", 0x340000, 0x4000 },
+    { "lpuart_7", 0x344000, 0x4000 },
+    { "siul_virtwrapper_pdac5_m7_3", 0x348000, 0x4000 },
+    { "siul_virtwrapper_pdac5_m7_3_1", 0x34c000, 0x4000 },
+    { "lpi2c_0", 0x350000, 0x4000 },
+    { "lpi2c_1", 0x354000, 0x4000 },
+    { "lpspi_0", 0x358000, 0x4000 },
+    { "lpspi_1", 0x35c000, 0x4000 },
+    { "lpspi_2", 0x360000, 0x4000 },
+    { "lpspi_3", 0x364000, 0x4000 },
+    { "sai0", 0x36c000, 0x4000 },
+    { "lpcmp_0", 0x370000, 0x4000 },
+    { "lpcmp_1", 0x374000, 0x4000 },
+    { "tmu", 0x37c000, 0x4000 },
+    { "crc", 0x380000, 0x4000 },
+    { "fccu", 0x384000, 0x4000 },
+    { "mu_0", 0x38c000, 0x4000 },
+    { "mu_1", 0x390000, 0x4000 },
+    { "jdc", 0x394000, 0x4000 },
+    { "configuration_gpr", 0x39c000, 0x4000 },
+    { "stcu", 0x3a0000, 0x4000 },
+    { "selftest_gpr", 0x3b0000, 0x4000 },
+    { "aes_accel", 0x3c0000, 0x10000 },
+    { "aes_app0", 0x3d0000, 0x10000 },
+    { "aes_app1", 0x3e0000, 0x10000 },
+    { "aes_app2", 0x3f0000, 0x10000 },
+    { "tcm_xbic", 0x400000, 0x4000 },
+    { "edma_xbic", 0x404000, 0x4000 },
+    { "pram2_tcm_xbic", 0x408000, 0x4000 },
+    { "aes_mux_xbic", 0x40c000, 0x4000 },
+    { "edma_tcd_12", 0x410000, 0x4000 },
+    { "edma_tcd_13", 0x414000, 0x4000 },
+    { "edma_tcd_14", 0x418000, 0x4000 },
+    { "edma_tcd_15", 0x41c000, 0x4000 },
+    { "edma_tcd_16", 0x420000, 0x4000 },
+    { "edma_tcd_17", 0x424000, 0x4000 },
+    { "edma_tcd_18", 0x428000, 0x4000 },
+    { "edma_tcd_19", 0x42c000, 0x4000 },
+    { "edma_tcd_20", 0x430000, 0x4000 },
+    { "edma_tcd_21", 0x434000, 0x4000 },
+    { "edma_tcd_22", 0x438000, 0x4000 },
+    { "edma_tcd_23", 0x43c000, 0x4000 },
+    { "edma_tcd_24", 0x440000, 0x4000 },
+    { "edma_tcd_25", 0x444000, 0x4000 },
+    { "edma_tcd_26", 0x448000, 0x4000 },
+    { "edma_tcd_27", 0x44c000, 0x4000 },
+    { "edma_tcd_28", 0x450000, 0x4000 },
+    { "edma_tcd_29", 0x454000, 0x4000 },
+    { "edma_tcd_30", 0x458000, 0x4000 },
+    { "edma_tcd_31", 0x45c000, 0x4000 },
+    { "sema42", 0x460000, 0x4000 },
+    { "pram_1", 0x464000, 0x4000 },
+    { "pram_2", 0x468000, 0x4000 },
+    { "swt_1", 0x46c000, 0x4000 },
+    { "swt_2", 0x470000, 0x4000 },
+    { "stm_1", 0x474000, 0x4000 },
+    { "stm_2", 0x478000, 0x4000 },
+    { "stm_3", 0x47c000, 0x4000 },
+    { "emac", 0x480000, 0x4000 },
+    { "gmac0", 0x484000, 0x4000 },
+    { "gmac1", 0x488000, 0x4000 },
+    { "lpuart_8", 0x48c000, 0x4000 },
+    { "lpuart_9", 0x490000, 0x4000 },
+    { "lpuart_10", 0x494000, 0x4000 },
+    { "lpuart_11", 0x498000, 0x4000 },
+    { "lpuart_12", 0x49c000, 0x4000 },
+    { "lpuart_13", 0x4a0000, 0x4000 },
+    { "lpuart_14", 0x4a4000, 0x4000 },
+    { "lpuart_15", 0x4a8000, 0x4000 },
+    { "lpspi_4", 0x4bc000, 0x4000 },
+    { "lpspi_5", 0x4c0000, 0x4000 },
+    { "quadspi", 0x4cc000, 0x4000 },
+    { "sai1", 0x4dc000, 0x4000 },
+    { "usdhc", 0x4e4000, 0x4000 },
+    { "lpcmp_2", 0x4e8000, 0x4000 },
+    { "mu_1_1", 0x4ec000, 0x4000 },
+    { "eim0_1", 0x50c000, 0x4000 },
+    { "eim1", 0x510000, 0x4000 },
+    { "eim2", 0x514000, 0x4000 },
+    { "eim3", 0x518000, 0x4000 },
+    { "aes_app3", 0x520000, 0x10000 },
+    { "aes_app4", 0x530000, 0x10000 },
+    { "aes_app5", 0x540000, 0x10000 },
+    { "aes_app6", 0x550000, 0x10000 },
+    { "aes_app7", 0x560000, 0x10000 },
+    { "flexcan_8", 0x570000, 0x4000 },
+    { "flexcan_9", 0x574000, 0x4000 },
+    { "flexcan_10", 0x578000, 0x4000 },
+    { "flexcan_11", 0x57c000, 0x4000 },
+    { "fmu1", 0x580000, 0x4000 },
+    { "fmu1_alt", 0x584000, 0x4000 },
+    { "pram_3", 0x588000, 0x4000 },
+};
+
+/**
+ * @brief Find the peripheral containing an offset of the fabric window.
+ *
+ * @param offset Offset in the fabric window.
+ * @return Index of the peripheral in nxps32k358_fabric_regions, -1 if the
+ * offset falls between two peripherals.
+ */
+static int nxps32k358_fabric_find(hwaddr offset) {
+    int lo = 0, hi = ARRAY_SIZE(nxps32k358_fabric_regions) - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const NXPS32K358FabricRegion *r = &nxps32k358_fabric_regions[mid];
+
+        if (offset < r->base) {
+            hi = mid - 1;
+        } else if (offset - r->base >= r->size) {
+            lo = mid + 1;
+        } else {
+            return mid;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Whether an access to a peripheral is to be logged.
+ *
+ * The first log_limit accesses of each peripheral are logged; the last one
+ * says that the following accesses are not.
+ *
+ * @param s Pointer to the NXPS32K358FabricState structure.
+ * @param n Index of the peripheral.
+ * @return true if the access is to be logged.
+ */
+static bool nxps32k358_fabric_log(NXPS32K358FabricState *s, int n) {
+    if (!qemu_loglevel_mask(LOG_UNIMP)) {
+        return false;
+    }
+    if (!s->log_limit) {
+        return true;
+    }
+    if (s->log_count[n] >= s->log_limit) {
+        return false;
+    }
+    if (++s->log_count[n] == s->log_limit) {
+        qemu_log("%s: unimplemented device, further accesses not logged\n",
+                 nxps32k358_fabric_regions[n].name);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads an unimplemented peripheral.
+ *
+ * @param opaque Pointer to the NXPS32K358FabricState structure.
+ * @param offset Offset in the fabric window.
+ * @param data Set to the value read: the remembered value, or 0.
+ * @param size Size of the read operation.
+ * @param attrs Memory transaction attributes.
+ * @return MEMTX_OK, or MEMTX_DECODE_ERROR outside of the peripherals.
+ */
+static MemTxResult nxps32k358_fabric_read(void *opaque, hwaddr offset,
+                                          uint64_t *data, unsigned size,
+                                          MemTxAttrs attrs) {
+    NXPS32K358FabricState *s = opaque;
+    int n = nxps32k358_fabric_find(offset);
+    const NXPS32K358FabricRegion *r;
+
+    if (n < 0) {
+        return MEMTX_DECODE_ERROR;
+    }
+    r = &nxps32k358_fabric_regions[n];
+
+    *data = 0;
+    if (s->remember_writes) {
+        uint32_t word = GPOINTER_TO_UINT(
+            g_hash_table_lookup(s->regs, GUINT_TO_POINTER(offset & ~3)));
+
+        *data = extract32(word, (offset & 3) * 8, size * 8);
+    }
+
+    trace_nxps32k358_fabric_read(r->name, offset - r->base, size, *data);
+    if (nxps32k358_fabric_log(s, n)) {
+        qemu_log("%s: unimplemented device read  (size %u, offset 0x%04"
+                 HWADDR_PRIx ")\n", r->name, size, offset - r->base);
+    }
+    return MEMTX_OK;
+}
+
+/**
+ * @brief Writes an unimplemented peripheral.
+ *
+ * @param opaque Pointer to the NXPS32K358FabricState structure.
+ * @param offset Offset in the fabric window.
+ * @param value Value to write, remembered if remember_writes is set.
+ * @param size Size of the write operation.
+ * @param attrs Memory transaction attributes.
+ * @return MEMTX_OK, or MEMTX_DECODE_ERROR outside of the peripherals.
+ */
+static MemTxResult nxps32k358_fabric_write(void *opaque, hwaddr offset,
+                                           uint64_t value, unsigned size,
+                                           MemTxAttrs attrs) {
+    NXPS32K358FabricState *s = opaque;
+    int n = nxps32k358_fabric_find(offset);
+    const NXPS32K358FabricRegion *r;
+
+    if (n < 0) {
+        return MEMTX_DECODE_ERROR;
+    }
+    r = &nxps32k358_fabric_regions[n];
+
+    if (s->remember_writes) {
+        gpointer key = GUINT_TO_POINTER(offset & ~3);
+        uint32_t word = GPOINTER_TO_UINT(g_hash_table_lookup(s->regs, key));
+
+        word = deposit32(word, (offset & 3) * 8, size * 8, value);
+        g_hash_table_insert(s->regs, key, GUINT_TO_POINTER(word));
+    }
+
+    trace_nxps32k358_fabric_write(r->name, offset - r->base, size, value);
+    if (nxps32k358_fabric_log(s, n)) {
+        qemu_log("%s: unimplemented device write (size %u, offset 0x%04"
+                 HWADDR_PRIx ", value 0x%0*" PRIx64 ")\n", r->name, size,
+                 offset - r->base, size << 1, value);
+    }
+    return MEMTX_OK;
+}
+
+static const MemoryRegionOps nxps32k358_fabric_ops = {
+    .read_with_attrs = nxps32k358_fabric_read,
+    .write_with_attrs = nxps32k358_fabric_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl.min_access_size = 1,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 1,
+    .valid.max_access_size = 4,
+    .valid.unaligned = false,
+};
+
+/**
+ * @brief Initialize the NXP S32K358 peripheral fabric.
+ *
+ * This function sets up the memory-mapped I/O region covering the fabric
+ * window, the table of the remembered words and the log counters.
+ *
+ * @param obj Pointer to the Object structure.
+ */
+static void nxps32k358_fabric_init(Object *obj) {
+    NXPS32K358FabricState *s = NXPS32K358_FABRIC(obj);
+
+    memory_region_init_io(&s->mmio, obj, &nxps32k358_fabric_ops, s,
+                          TYPE_NXPS32K358_FABRIC, FABRIC_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmio);
+
+    s->regs = g_hash_table_new(NULL, NULL);
+    s->log_count = g_new0(uint32_t, ARRAY_SIZE(nxps32k358_fabric_regions));
+}
+
+/**
+ * @brief Finalize the NXP S32K358 peripheral fabric, freeing its tables.
+ *
+ * @param obj Pointer to the Object structure.
+ */
+static void nxps32k358_fabric_finalize(Object *obj) {
+    NXPS32K358FabricState *s = NXPS32K358_FABRIC(obj);
+
+    g_hash_table_destroy(s->regs);
+    g_free(s->log_count);
+}
+
+/**
+ * @brief Reset the NXP S32K358 peripheral fabric.
+ *
+ * The remembered words are forgotten, so that every peripheral reads as 0
+ * again. The log counters are kept, so that resets do not flood the log.
+ *
+ * @param dev Pointer to the DeviceState structure.
+ */
+static void nxps32k358_fabric_reset(DeviceState *dev) {
+    NXPS32K358FabricState *s = NXPS32K358_FABRIC(dev);
+
+    g_hash_table_remove_all(s->regs);
+}
+
+static Property nxps32k358_fabric_properties[] = {
+    DEFINE_PROP_BOOL("remember-writes", NXPS32K358FabricState,
+                     remember_writes, false),
+    DEFINE_PROP_UINT32("log-limit", NXPS32K358FabricState, log_limit, 16),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void nxps32k358_fabric_class_init(ObjectClass *klass, void *data) {
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    device_class_set_legacy_reset(dc, nxps32k358_fabric_reset);
+    device_class_set_props(dc, nxps32k358_fabric_properties);
+}
+
+static const TypeInfo nxps32k358_fabric_info = {
+    .name = TYPE_NXPS32K358_FABRIC,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(NXPS32K358FabricState),
+    .class_init = nxps32k358_fabric_class_init,
+    .instance_init = nxps32k358_fabric_init,
+    .instance_finalize = nxps32k358_fabric_finalize,
+};
+
+static void nxps32k358_fabric_register_types(void) {
+    type_register_static(&nxps32k358_fabric_info);
+}
+
+type_init(nxps32k358_fabric_register_types)
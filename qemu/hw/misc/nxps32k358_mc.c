@@ -0,0 +1,793 @@
+/*
+ * NXPS32K358 clock generation and mode entry
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_mc.c
+ * @brief Implementation of the NXPS32K358 clock generation and mode entry.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/misc/nxps32k358_mc.h"
+#include "hw/qdev-clock.h"
+#include "qemu/host-utils.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+// Access rights of the MC_ME registers
+enum {
+    ME_ACCESS_NONE,
+    ME_ACCESS_RO,
+    ME_ACCESS_RW,
+};
+
+/**
+ * @brief Get the registers of an MC_ME partition.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @param n The partition.
+ * @return The PRTNn registers, to be indexed with R_ME_PRTN_*.
+ */
+static uint32_t *nxps32k358_mc_prtn(NXPS32K358MCState *s, int n) {
+    return &s->me[MC_ME_PRTN_ADDR(n) / 4];
+}
+
+/**
+ * @brief Check whether the clock of a peripheral is running.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @param prtn The partition of the peripheral.
+ * @param req The clock request input of the peripheral in its partition.
+ * @return true if the partition clock and the peripheral clock are enabled.
+ */
+static bool nxps32k358_mc_clock_running(NXPS32K358MCState *s, int prtn,
+                                        int req) {
+    uint32_t *p = nxps32k358_mc_prtn(s, prtn);
+
+    return (p[R_ME_PRTN_STAT] & R_ME_PRTN_STAT_PCS_MASK) &&
+           (p[R_ME_PRTN_COFB0_STAT + req / 32] & (1U << (req % 32)));
+}
+
+/**
+ * @brief Compute the frequency of FXOSC.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @return The frequency of the crystal if the oscillator is on, 0 otherwise.
+ */
+static uint32_t nxps32k358_mc_fxosc_hz(NXPS32K358MCState *s) {
+    if (!FIELD_EX32(s->fxosc_ctrl, FXOSC_CTRL, OSCON)) {
+        return 0;
+    }
+    return clock_get_hz(s->fxosc);
+}
+
+/**
+ * @brief Compute the output frequency of the PLL, before the PHI dividers.
+ *
+ * The reference clock is divided by PLLDV[RDIV], multiplied by the loop
+ * divider, PLLDV[MFI] plus PLLFD[MFN] / 18432 if the fractional mode is
+ * enabled, and divided by PLLDV[ODIV2]. The PLL locks as soon as it is
+ * powered up with a running reference clock.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @return The output frequency, 0 if the PLL is not locked.
+ */
+static uint32_t nxps32k358_mc_pll_hz(NXPS32K358MCState *s) {
+    uint32_t dv = s->pll[R_PLL_PLLDV];
+    uint32_t rdiv = MAX(FIELD_EX32(dv, PLL_PLLDV, RDIV), 1);
+    uint32_t odiv2 = MAX(FIELD_EX32(dv, PLL_PLLDV, ODIV2), 1);
+    uint32_t mf = FIELD_EX32(dv, PLL_PLLDV, MFI) * PLL_MFN_DEN;
+    uint32_t ref = FIRC_FRQ;
+
+    if (FIELD_EX32(s->pll[R_PLL_PLLCLKMUX], PLL_PLLCLKMUX, REFCLKSEL)) {
+        ref = nxps32k358_mc_fxosc_hz(s);
+    }
+
+    if (FIELD_EX32(s->pll[R_PLL_PLLCR], PLL_PLLCR, PLLPD) || !ref) {
+        s->pll[R_PLL_PLLSR] &= ~R_PLL_PLLSR_LOCK_MASK;
+        return 0;
+    }
+    s->pll[R_PLL_PLLSR] |= R_PLL_PLLSR_LOCK_MASK;
+
+    if (FIELD_EX32(s->pll[R_PLL_PLLFD], PLL_PLLFD, SDMEN)) {
+        mf += FIELD_EX32(s->pll[R_PLL_PLLFD], PLL_PLLFD, MFN);
+    }
+    return muldiv64(ref, mf, PLL_MFN_DEN * rdiv * odiv2);
+}
+
+/**
+ * @brief Compute the frequency of a source of the clock multiplexers.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @param pll_hz The output frequency of the PLL.
+ * @param sel The source, one of the MC_CGM_SEL_* values.
+ * @return The frequency of the source, 0 if it is not running.
+ */
+static uint32_t nxps32k358_mc_source_hz(NXPS32K358MCState *s, uint32_t pll_hz,
+                                        uint32_t sel) {
+    uint32_t odiv;
+
+    switch (sel) {
+    case MC_CGM_SEL_FIRC:
+        return FIRC_FRQ;
+    case MC_CGM_SEL_SIRC:
+        return SIRC_FRQ;
+    case MC_CGM_SEL_FXOSC:
+        return nxps32k358_mc_fxosc_hz(s);
+    case MC_CGM_SEL_PLL_PHI0:
+    case MC_CGM_SEL_PLL_PHI1:
+        odiv = s->pll[R_PLL_PLLODIV_0 + sel - MC_CGM_SEL_PLL_PHI0];
+        if (!FIELD_EX32(odiv, PLL_PLLODIV, DE)) {
+            return 0;
+        }
+        return pll_hz / (FIELD_EX32(odiv, PLL_PLLODIV, DIV) + 1);
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Compute the frequency of a divider of a clock multiplexer.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @param pll_hz The output frequency of the PLL.
+ * @param mux The clock multiplexer.
+ * @param dc The divider.
+ * @return The output frequency of the divider, 0 if it is disabled.
+ */
+static uint32_t nxps32k358_mc_div_hz(NXPS32K358MCState *s, uint32_t pll_hz,
+                                     int mux, int dc) {
+    uint32_t sel = FIELD_EX32(s->cgm_mux[mux][R_CGM_MUX_CSS], CGM_MUX_CSS,
+                              SELSTAT);
+    uint32_t div = s->cgm_div[mux][dc];
+
+    if (!FIELD_EX32(div, CGM_MUX_DC, DE)) {
+        return 0;
+    }
+    return nxps32k358_mc_source_hz(s, pll_hz, sel) /
+           (FIELD_EX32(div, CGM_MUX_DC, DIV) + 1);
+}
+
+/**
+ * @brief Compute the frequencies of the clock tree and update the output
+ * clocks.
+ *
+ * Only the clocks whose frequency changes are propagated, so that the
+ * peripherals only hear about the changes that concern them.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ */
+static void nxps32k358_mc_update(NXPS32K358MCState *s) {
+    uint32_t pll_hz = nxps32k358_mc_pll_hz(s);
+    uint32_t core = nxps32k358_mc_div_hz(s, pll_hz, 0, MC_CGM_DC_CORE);
+    uint32_t plat = nxps32k358_mc_div_hz(s, pll_hz, 0, MC_CGM_DC_AIPS_PLAT);
+    uint32_t slow = nxps32k358_mc_div_hz(s, pll_hz, 0, MC_CGM_DC_AIPS_SLOW);
+
+    trace_nxps32k358_mc_update(core, plat, slow);
+    clock_update_hz(s->core_clk, core);
+    clock_update_hz(s->aips_plat_clk, plat);
+    clock_update_hz(s->aips_slow_clk, slow);
+
+    for (int i = 0; i < MC_NUM_LPUART_CLKS; i++) {
+        // LPUART 0, 1 and 8 are on AIPS_PLAT_CLK, the others on
+        // AIPS_SLOW_CLK. LPUART 0-7 are clock requests 74-81 of partition 1,
+        // LPUART 8-15 are clock requests 35-42 of partition 2
+        uint32_t hz = (i < 2 || i == 8) ? plat : slow;
+        bool running = i < 8 ? nxps32k358_mc_clock_running(s, 1, 74 + i)
+                             : nxps32k358_mc_clock_running(s, 2, 27 + i);
+
+        clock_update_hz(s->lpuart_clk[i], running ? hz : 0);
+    }
+}
+
+/**
+ * @brief Input clock callback, called when the crystal frequency changes.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param event The clock event (always ClockUpdate).
+ */
+static void nxps32k358_mc_fxosc_update(void *opaque, ClockEvent event) {
+    nxps32k358_mc_update(opaque);
+}
+
+/**
+ * @brief Reads a register of FXOSC.
+ *
+ * The oscillator is stable as soon as it is switched on.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to read.
+ * @param size Size of the read operation (always 4).
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_mc_fxosc_read(void *opaque, hwaddr offset,
+                                         unsigned size) {
+    NXPS32K358MCState *s = opaque;
+    uint64_t value;
+
+    switch (offset) {
+    case A_FXOSC_CTRL:
+        value = s->fxosc_ctrl;
+        break;
+    case A_FXOSC_STAT:
+        value = FIELD_DP32(0, FXOSC_STAT, OSC_STAT,
+                           FIELD_EX32(s->fxosc_ctrl, FXOSC_CTRL, OSCON));
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+
+    trace_nxps32k358_mc_read("fxosc", offset, value);
+    return value;
+}
+
+/**
+ * @brief Writes a register of FXOSC.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to write.
+ * @param value Value to write.
+ * @param size Size of the write operation (always 4).
+ */
+static void nxps32k358_mc_fxosc_write(void *opaque, hwaddr offset,
+                                      uint64_t value, unsigned size) {
+    NXPS32K358MCState *s = opaque;
+
+    trace_nxps32k358_mc_write("fxosc", offset, value);
+
+    switch (offset) {
+    case A_FXOSC_CTRL:
+        s->fxosc_ctrl = value;
+        nxps32k358_mc_update(s);
+        return;
+    case A_FXOSC_STAT:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Read-only offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+    }
+}
+
+static const MemoryRegionOps nxps32k358_mc_fxosc_ops = {
+    .read = nxps32k358_mc_fxosc_read,
+    .write = nxps32k358_mc_fxosc_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl.min_access_size = 4,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+/**
+ * @brief Writes the CSC register of a clock multiplexer.
+ *
+ * A clock switch (CSC[CLK_SW], or CSC[SAFE_SW] to FIRC) completes at once:
+ * CSS reports the new source, or the failure of the switch if the source is
+ * not running, in which case the multiplexer keeps its source.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @param n The clock multiplexer.
+ * @param value Value to write.
+ */
+static void nxps32k358_mc_write_csc(NXPS32K358MCState *s, int n,
+                                    uint32_t value) {
+    uint32_t *mux = s->cgm_mux[n];
+    uint32_t sel = FIELD_EX32(value, CGM_MUX_CSC, SELCTL);
+    uint32_t swtrg = MC_CGM_SWTRG_SUCCEEDED;
+
+    // The switch requests clear themselves
+    mux[R_CGM_MUX_CSC] = value & ~(R_CGM_MUX_CSC_RAMPUP_MASK |
+                                   R_CGM_MUX_CSC_RAMPDOWN_MASK |
+                                   R_CGM_MUX_CSC_CLK_SW_MASK |
+                                   R_CGM_MUX_CSC_SAFE_SW_MASK);
+
+    if (value & R_CGM_MUX_CSC_SAFE_SW_MASK) {
+        sel = MC_CGM_SEL_FIRC;
+    } else if (!(value & R_CGM_MUX_CSC_CLK_SW_MASK)) {
+        return;
+    }
+
+    if (!nxps32k358_mc_source_hz(s, nxps32k358_mc_pll_hz(s), sel)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: MUX_%d source %" PRIu32
+                      " is not running\n", __func__, n, sel);
+        swtrg = MC_CGM_SWTRG_INACTIVE;
+        sel = FIELD_EX32(mux[R_CGM_MUX_CSS], CGM_MUX_CSS, SELSTAT);
+    }
+
+    mux[R_CGM_MUX_CSS] = FIELD_DP32(0, CGM_MUX_CSS, SELSTAT, sel);
+    mux[R_CGM_MUX_CSS] = FIELD_DP32(mux[R_CGM_MUX_CSS], CGM_MUX_CSS, SWTRG,
+                                    swtrg);
+    mux[R_CGM_MUX_CSS] |= R_CGM_MUX_CSS_CLK_SW_MASK;
+    nxps32k358_mc_update(s);
+}
+
+/**
+ * @brief Apply the dividers of a clock multiplexer.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ * @param n The clock multiplexer.
+ */
+static void nxps32k358_mc_apply_dividers(NXPS32K358MCState *s, int n) {
+    memcpy(s->cgm_div[n], &s->cgm_mux[n][R_CGM_MUX_DC_0],
+           sizeof(s->cgm_div[n]));
+    nxps32k358_mc_update(s);
+}
+
+/**
+ * @brief Reads a register of MC_CGM.
+ *
+ * The divider updates complete at once, DIV_UPD_STAT always reads 0.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to read.
+ * @param size Size of the read operation (always 4).
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_mc_cgm_read(void *opaque, hwaddr offset,
+                                       unsigned size) {
+    NXPS32K358MCState *s = opaque;
+    uint64_t value;
+
+    if (offset < MC_CGM_MUX_BASE_ADDR) {
+        value = s->cgm_pcfs[offset / 4];
+    } else if (offset < MC_CGM_MUX_ADDR(MC_CGM_NUM_MUX)) {
+        hwaddr reg = (offset - MC_CGM_MUX_BASE_ADDR) % MC_CGM_MUX_STRIDE;
+        int n = (offset - MC_CGM_MUX_BASE_ADDR) / MC_CGM_MUX_STRIDE;
+
+        value = s->cgm_mux[n][reg / 4];
+    } else {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+
+    trace_nxps32k358_mc_read("mc_cgm", offset, value);
+    return value;
+}
+
+/**
+ * @brief Writes a register of MC_CGM.
+ *
+ * Divider changes apply at once, unless DIV_TRIG_CTRL[TCTL] holds them until
+ * DIV_TRIG is written.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to write.
+ * @param value Value to write.
+ * @param size Size of the write operation (always 4).
+ */
+static void nxps32k358_mc_cgm_write(void *opaque, hwaddr offset,
+                                    uint64_t value, unsigned size) {
+    NXPS32K358MCState *s = opaque;
+    hwaddr reg;
+    int n;
+
+    trace_nxps32k358_mc_write("mc_cgm", offset, value);
+
+    if (offset < MC_CGM_MUX_BASE_ADDR) {
+        s->cgm_pcfs[offset / 4] = value;
+        return;
+    }
+    if (offset >= MC_CGM_MUX_ADDR(MC_CGM_NUM_MUX)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+
+    reg = (offset - MC_CGM_MUX_BASE_ADDR) % MC_CGM_MUX_STRIDE;
+    n = (offset - MC_CGM_MUX_BASE_ADDR) / MC_CGM_MUX_STRIDE;
+    switch (reg) {
+    case A_CGM_MUX_CSC:
+        nxps32k358_mc_write_csc(s, n, value);
+        return;
+    case A_CGM_MUX_CSS:
+    case A_CGM_MUX_DIV_UPD_STAT:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Read-only offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return;
+    case A_CGM_MUX_DC_0 ... A_CGM_MUX_DIV_TRIG_CTRL - 1:
+        s->cgm_mux[n][reg / 4] = value;
+        if (!FIELD_EX32(s->cgm_mux[n][R_CGM_MUX_DIV_TRIG_CTRL],
+                        CGM_MUX_DIV_TRIG_CTRL, TCTL)) {
+            nxps32k358_mc_apply_dividers(s, n);
+        }
+        return;
+    case A_CGM_MUX_DIV_TRIG_CTRL:
+        s->cgm_mux[n][reg / 4] = value;
+        return;
+    case A_CGM_MUX_DIV_TRIG:
+        s->cgm_mux[n][reg / 4] = value;
+        nxps32k358_mc_apply_dividers(s, n);
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+}
+
+static const MemoryRegionOps nxps32k358_mc_cgm_ops = {
+    .read = nxps32k358_mc_cgm_read,
+    .write = nxps32k358_mc_cgm_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl.min_access_size = 4,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+/**
+ * @brief Find the access rights of an MC_ME register.
+ *
+ * @param offset Offset of the register.
+ * @return One of the ME_ACCESS_* values, ME_ACCESS_NONE if there is no
+ * register at offset.
+ */
+static int nxps32k358_mc_me_access(hwaddr offset) {
+    hwaddr reg;
+
+    if (offset < MC_ME_PRTN_BASE_ADDR) {
+        switch (offset) {
+        case A_MC_ME_CTL_KEY:
+        case A_MC_ME_MODE_CONF:
+        case A_MC_ME_MODE_UPD:
+            return ME_ACCESS_RW;
+        case A_MC_ME_MODE_STAT:
+        case A_MC_ME_MAIN_COREID:
+            return ME_ACCESS_RO;
+        default:
+            return ME_ACCESS_NONE;
+        }
+    }
+    if (offset >= MC_ME_PRTN_ADDR(MC_ME_NUM_PRTN)) {
+        return ME_ACCESS_NONE;
+    }
+
+    reg = (offset - MC_ME_PRTN_BASE_ADDR) % MC_ME_PRTN_STRIDE;
+    if (reg >= MC_ME_CORE_OFFSET(0) &&
+        reg < MC_ME_CORE_OFFSET(MC_ME_NUM_CORE)) {
+        switch ((reg - MC_ME_CORE_BASE_OFFSET) % MC_ME_CORE_STRIDE) {
+        case A_ME_CORE_PCONF:
+        case A_ME_CORE_PUPD:
+        case A_ME_CORE_ADDR:
+            return ME_ACCESS_RW;
+        case A_ME_CORE_STAT:
+            return ME_ACCESS_RO;
+        default:
+            return ME_ACCESS_NONE;
+        }
+    }
+
+    switch (reg) {
+    case A_ME_PRTN_PCONF:
+    case A_ME_PRTN_PUPD:
+    case A_ME_PRTN_COFB0_CLKEN ... A_ME_PRTN_COFB0_CLKEN + MC_ME_COFB_SIZE - 1:
+        return ME_ACCESS_RW;
+    case A_ME_PRTN_STAT:
+    case A_ME_PRTN_COFB0_STAT ... A_ME_PRTN_COFB0_STAT + MC_ME_COFB_SIZE - 1:
+        return ME_ACCESS_RO;
+    default:
+        return ME_ACCESS_NONE;
+    }
+}
+
+/**
+ * @brief Apply the updates requested in the PUPD registers of the
+ * partitions and of the cores.
+ *
+ * Called when the key sequence is written to CTL_KEY. The partition and core
+ * clocks follow their PCONF register, the peripheral clocks their
+ * COFBk_CLKEN register.
+ *
+ * @param s Pointer to the NXPS32K358MCState structure.
+ */
+static void nxps32k358_mc_me_update(NXPS32K358MCState *s) {
+    for (int n = 0; n < MC_ME_NUM_PRTN; n++) {
+        uint32_t *p = nxps32k358_mc_prtn(s, n);
+
+        if (p[R_ME_PRTN_PUPD] & R_ME_PRTN_PUPD_PCUD_MASK) {
+            p[R_ME_PRTN_STAT] = FIELD_DP32(
+                p[R_ME_PRTN_STAT], ME_PRTN_STAT, PCS,
+                FIELD_EX32(p[R_ME_PRTN_PCONF], ME_PRTN_PCONF, PCE));
+            memcpy(&p[R_ME_PRTN_COFB0_STAT], &p[R_ME_PRTN_COFB0_CLKEN],
+                   MC_ME_NUM_COFB * sizeof(uint32_t));
+        }
+        p[R_ME_PRTN_PUPD] = 0;
+
+        for (int c = 0; c < MC_ME_NUM_CORE; c++) {
+            uint32_t *core = &p[MC_ME_CORE_OFFSET(c) / 4];
+
+            if (core[R_ME_CORE_PUPD] & R_ME_CORE_PUPD_CCUPD_MASK) {
+                core[R_ME_CORE_STAT] = FIELD_DP32(
+                    core[R_ME_CORE_STAT], ME_CORE_STAT, CCS,
+                    FIELD_EX32(core[R_ME_CORE_PCONF], ME_CORE_PCONF, CCE));
+            }
+            core[R_ME_CORE_PUPD] = 0;
+        }
+    }
+    s->me[R_MC_ME_MODE_UPD] = 0;
+
+    nxps32k358_mc_update(s);
+}
+
+/**
+ * @brief Reads a register of MC_ME.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to read.
+ * @param size Size of the read operation (always 4).
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_mc_me_read(void *opaque, hwaddr offset,
+                                      unsigned size) {
+    NXPS32K358MCState *s = opaque;
+    uint64_t value;
+
+    if (nxps32k358_mc_me_access(offset) == ME_ACCESS_NONE) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+    value = s->me[offset / 4];
+
+    trace_nxps32k358_mc_read("mc_me", offset, value);
+    return value;
+}
+
+/**
+ * @brief Writes a register of MC_ME.
+ *
+ * The configuration registers only take effect with the key sequence, the
+ * key followed by the inverted key, written to CTL_KEY.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to write.
+ * @param value Value to write.
+ * @param size Size of the write operation (always 4).
+ */
+static void nxps32k358_mc_me_write(void *opaque, hwaddr offset,
+                                   uint64_t value, unsigned size) {
+    NXPS32K358MCState *s = opaque;
+    uint32_t key = s->me[R_MC_ME_CTL_KEY];
+
+    trace_nxps32k358_mc_write("mc_me", offset, value);
+
+    switch (nxps32k358_mc_me_access(offset)) {
+    case ME_ACCESS_RW:
+        s->me[offset / 4] = value;
+        if (offset == A_MC_ME_CTL_KEY && key == MC_ME_KEY &&
+            value == MC_ME_INVERTED_KEY) {
+            nxps32k358_mc_me_update(s);
+        }
+        return;
+    case ME_ACCESS_RO:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Read-only offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+    }
+}
+
+static const MemoryRegionOps nxps32k358_mc_me_ops = {
+    .read = nxps32k358_mc_me_read,
+    .write = nxps32k358_mc_me_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl.min_access_size = 4,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+/**
+ * @brief Reads a register of the PLL.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to read.
+ * @param size Size of the read operation (always 4).
+ * @return The value of the register.
+ */
+static uint64_t nxps32k358_mc_pll_read(void *opaque, hwaddr offset,
+                                       unsigned size) {
+    NXPS32K358MCState *s = opaque;
+    uint64_t value;
+
+    switch (offset) {
+    case A_PLL_PLLCR:
+    case A_PLL_PLLSR:
+    case A_PLL_PLLDV:
+    case A_PLL_PLLFM:
+    case A_PLL_PLLFD:
+    case A_PLL_PLLCAL2:
+    case A_PLL_PLLCLKMUX:
+    case A_PLL_PLLODIV_0:
+    case A_PLL_PLLODIV_1:
+        value = s->pll[offset / 4];
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+
+    trace_nxps32k358_mc_read("pll", offset, value);
+    return value;
+}
+
+/**
+ * @brief Writes a register of the PLL.
+ *
+ * @param opaque Pointer to the NXPS32K358MCState structure.
+ * @param offset Offset of the register to write.
+ * @param value Value to write.
+ * @param size Size of the write operation (always 4).
+ */
+static void nxps32k358_mc_pll_write(void *opaque, hwaddr offset,
+                                    uint64_t value, unsigned size) {
+    NXPS32K358MCState *s = opaque;
+
+    trace_nxps32k358_mc_write("pll", offset, value);
+
+    switch (offset) {
+    case A_PLL_PLLCR:
+    case A_PLL_PLLDV:
+    case A_PLL_PLLFM:
+    case A_PLL_PLLFD:
+    case A_PLL_PLLCAL2:
+    case A_PLL_PLLCLKMUX:
+    case A_PLL_PLLODIV_0:
+    case A_PLL_PLLODIV_1:
+        s->pll[offset / 4] = value;
+        nxps32k358_mc_update(s);
+        return;
+    case A_PLL_PLLSR:
+        // The lock flags are computed, the loss of lock never happens
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+    }
+}
+
+static const MemoryRegionOps nxps32k358_mc_pll_ops = {
+    .read = nxps32k358_mc_pll_read,
+    .write = nxps32k358_mc_pll_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .impl.min_access_size = 4,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+/**
+ * @brief Initialize the NXP S32K358 clock generation and mode entry.
+ *
+ * This function sets up the memory-mapped I/O regions of FXOSC, MC_CGM,
+ * MC_ME and the PLL (in this order), the crystal input clock and the output
+ * clocks.
+ *
+ * @param obj Pointer to the Object structure.
+ */
+static void nxps32k358_mc_init(Object *obj) {
+    NXPS32K358MCState *s = NXPS32K358_MC(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->fxosc_mmio, obj, &nxps32k358_mc_fxosc_ops, s,
+                          TYPE_NXPS32K358_MC ".fxosc", MC_BLOCK_SIZE);
+    memory_region_init_io(&s->cgm_mmio, obj, &nxps32k358_mc_cgm_ops, s,
+                          TYPE_NXPS32K358_MC ".mc_cgm", MC_BLOCK_SIZE);
+    memory_region_init_io(&s->me_mmio, obj, &nxps32k358_mc_me_ops, s,
+                          TYPE_NXPS32K358_MC ".mc_me", MC_BLOCK_SIZE);
+    memory_region_init_io(&s->pll_mmio, obj, &nxps32k358_mc_pll_ops, s,
+                          TYPE_NXPS32K358_MC ".pll", MC_BLOCK_SIZE);
+    sysbus_init_mmio(sbd, &s->fxosc_mmio);
+    sysbus_init_mmio(sbd, &s->cgm_mmio);
+    sysbus_init_mmio(sbd, &s->me_mmio);
+    sysbus_init_mmio(sbd, &s->pll_mmio);
+
+    s->fxosc = qdev_init_clock_in(DEVICE(s), "fxosc",
+                                  nxps32k358_mc_fxosc_update, s, ClockUpdate);
+    s->core_clk = qdev_init_clock_out(DEVICE(s), "core_clk");
+    s->aips_plat_clk = qdev_init_clock_out(DEVICE(s), "aips_plat_clk");
+    s->aips_slow_clk = qdev_init_clock_out(DEVICE(s), "aips_slow_clk");
+    for (int i = 0; i < MC_NUM_LPUART_CLKS; i++) {
+        g_autofree char *name = g_strdup_printf("lpuart%d_clk", i);
+
+        s->lpuart_clk[i] = qdev_init_clock_out(DEVICE(s), name);
+    }
+}
+
+/**
+ * @brief Reset the NXP S32K358 clock generation and mode entry.
+ *
+ * The clock tree runs from FIRC, with the core at 48MHz, AIPS_PLAT_CLK at
+ * 24MHz and AIPS_SLOW_CLK at 12MHz; FXOSC is off and the PLL powered down.
+ * Every partition, core 0 and every peripheral clock are enabled.
+ *
+ * @param dev Pointer to the DeviceState structure.
+ */
+static void nxps32k358_mc_reset(DeviceState *dev) {
+    NXPS32K358MCState *s = NXPS32K358_MC(dev);
+    uint32_t *mux0 = s->cgm_mux[0];
+
+    s->fxosc_ctrl = 0;
+
+    memset(s->cgm_pcfs, 0, sizeof(s->cgm_pcfs));
+    memset(s->cgm_mux, 0, sizeof(s->cgm_mux));
+    mux0[R_CGM_MUX_DC_0 + MC_CGM_DC_CORE] = R_CGM_MUX_DC_DE_MASK;
+    mux0[R_CGM_MUX_DC_0 + MC_CGM_DC_AIPS_PLAT] =
+        FIELD_DP32(R_CGM_MUX_DC_DE_MASK, CGM_MUX_DC, DIV, 1);
+    mux0[R_CGM_MUX_DC_0 + MC_CGM_DC_AIPS_SLOW] =
+        FIELD_DP32(R_CGM_MUX_DC_DE_MASK, CGM_MUX_DC, DIV, 3);
+    for (int n = 0; n < MC_CGM_NUM_MUX; n++) {
+        memcpy(s->cgm_div[n], &s->cgm_mux[n][R_CGM_MUX_DC_0],
+               sizeof(s->cgm_div[n]));
+    }
+
+    memset(s->me, 0, sizeof(s->me));
+    for (int n = 0; n < MC_ME_NUM_PRTN; n++) {
+        uint32_t *p = nxps32k358_mc_prtn(s, n);
+
+        p[R_ME_PRTN_PCONF] = R_ME_PRTN_PCONF_PCE_MASK;
+        p[R_ME_PRTN_STAT] = R_ME_PRTN_STAT_PCS_MASK;
+        for (int k = 0; k < MC_ME_NUM_COFB; k++) {
+            p[R_ME_PRTN_COFB0_STAT + k] = UINT32_MAX;
+            p[R_ME_PRTN_COFB0_CLKEN + k] = UINT32_MAX;
+        }
+    }
+    s->me[(MC_ME_PRTN_ADDR(0) + MC_ME_CORE_OFFSET(0)) / 4 + R_ME_CORE_PCONF] =
+        R_ME_CORE_PCONF_CCE_MASK;
+    s->me[(MC_ME_PRTN_ADDR(0) + MC_ME_CORE_OFFSET(0)) / 4 + R_ME_CORE_STAT] =
+        R_ME_CORE_STAT_CCS_MASK;
+
+    memset(s->pll, 0, sizeof(s->pll));
+    s->pll[R_PLL_PLLCR] = PLL_PLLCR_RESET;
+
+    nxps32k358_mc_update(s);
+}
+
+static void nxps32k358_mc_class_init(ObjectClass *klass, void *data) {
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    device_class_set_legacy_reset(dc, nxps32k358_mc_reset);
+}
+
+static const TypeInfo nxps32k358_mc_info = {
+    .name = TYPE_NXPS32K358_MC,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(NXPS32K358MCState),
+    .class_init = nxps32k358_mc_class_init,
+    .instance_init = nxps32k358_mc_init,
+};
+
+static void nxps32k358_mc_register_types(void) {
+    type_register_static(&nxps32k358_mc_info);
+}
+
+type_init(nxps32k358_mc_register_types)
@@ -234,6 +234,7 @@ OBJECT_DECLARE_TYPE(Chardev, ChardevClass, CHARDEV)
 #define TYPE_CHARDEV_MUX "chardev-mux"
 #define TYPE_CHARDEV_RINGBUF "chardev-ringbuf"
 #define TYPE_CHARDEV_PTY "chardev-pty"
+#define TYPE_CHARDEV_SHMRING "chardev-shmring"
 #define TYPE_CHARDEV_CONSOLE "chardev-console"
 #define TYPE_CHARDEV_STDIO "chardev-stdio"
 #define TYPE_CHARDEV_PIPE "chardev-pipe"
@@ -32,15 +32,23 @@
 
 #include "hw/arm/armv7m.h"
 #include "hw/clock.h"
+#include "hw/core/split-irq.h"
+#include "hw/cpu/cluster.h"
+#include "sysemu/hostmem.h"
 #include "qom/object.h"
 #include "hw/char/nxps32k358_lpuart.h"
 #include "hw/dma/nxps32k358_edma.h"
+#include "hw/dma/nxps32k358_dmamux.h"
+#include "hw/block/nxps32k358_fmu.h"
+#include "hw/misc/nxps32k358_fabric.h"
+#include "hw/misc/nxps32k358_mc.h"
 
 #define TYPE_NXPS32K358_SOC "nxps32k358-soc"
 OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358State, NXPS32K358_SOC)
 
 #define CODE_FLASH_BASE_ADDRESS 0x00400000
 #define CODE_FLASH_BLOCK_SIZE (2 * 1024 * 1024)
+#define CODE_FLASH_NUM_BLOCKS 4
 #define DATA_FLASH_BASE_ADDRESS 0x10000000
 #define DATA_FLASH_SIZE (128 * 1024)
 #define SRAM_BASE_ADDRESS 0x20400000
@@ -49,17 +57,46 @@ OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358State, NXPS32K358_SOC)
 #define DTCM_SIZE (128 * 1024) + 1
 #define ITCM_BASE_ADDRESS 0x00000000
 #define ITCM_SIZE (64 * 1024)
+
+// Clock generation and mode entry, each block of MC_BLOCK_SIZE bytes
+#define FXOSC_BASE_ADDRESS 0x402D4000
+#define MC_CGM_BASE_ADDRESS 0x402D8000
 #define MC_ME_BASE_ADDRESS 0x402DC000
-#define MC_ME_SIZE 1340
+#define PLL_BASE_ADDRESS 0x402E0000
+
+// Cortex-M7 cores of the SoC, and interrupts of the NVIC of each core
+#define NXPS32K358_MAX_CPUS 2
+#define NXPS32K358_NUM_IRQ 240
+
+// Processor identification registers of MSCM (CPXTYPE, CPXNUM, ...), which
+// read differently from each core
+#define MSCM_BASE_ADDRESS 0x40260000
+#define MSCM_CPX_SIZE 0x20
 
 static inline uint32_t LPUART_ADDR(int n) { return 0x40328000 + 0x4000 * n; }
 static inline uint32_t LPUART_IRQ(int n) { return 141 + n; }
 #define NUM_LPUARTS 16
 
 #define EDMA_BASE_ADDRESS 0x4020C000
+#define EDMA_TCD12_BASE_ADDRESS 0x40410000
 static inline uint32_t EDMA_IRQ(int n) { return 4 + n; }
 #define NUM_EDMA_CHANNELS 32
 
+// DMAMUX_0 feeds eDMA channels 0-15, DMAMUX_1 feeds channels 16-31
+static inline uint32_t DMAMUX_ADDR(int n) { return 0x40280000 + 0x4000 * n; }
+#define NUM_DMAMUX 2
+
+// DMAMUX request sources of the LPUARTs: LPUART0-7 are routed by DMAMUX_0 and
+// LPUART8-15 by DMAMUX_1, each port with a receive and a transmit source
+static inline uint32_t LPUART_DMAMUX(int n) { return n / 8; }
+static inline uint32_t LPUART_DMA_RX_SOURCE(int n) { return 37 + 2 * (n % 8); }
+static inline uint32_t LPUART_DMA_TX_SOURCE(int n) { return 38 + 2 * (n % 8); }
+
+// The FMU registers are also mapped at FMU_ALT_BASE_ADDRESS
+#define FMU_BASE_ADDRESS 0x402EC000
+#define FMU_ALT_BASE_ADDRESS 0x402F0000
+#define FMU_SIZE 0x4000
+
 /**
  * @struct NXPS32K358State
  * @brief Represents the state of the NXP S32K358 SoC.
@@ -67,23 +104,54 @@ static inline uint32_t EDMA_IRQ(int n) { return 4 + n; }
  * @var NXPS32K358State::parent_obj
  * The parent system bus device.
  *
+ * @var NXPS32K358State::num_cpus
+ * Property "num-cpus": number of Cortex-M7 cores, from 1 to
+ * NXPS32K358_MAX_CPUS.
+ *
+ * @var NXPS32K358State::init_vtor
+ * Properties "cpu0-vtor", "cpu1-vtor": initial vector table address of each
+ * core.
+ *
+ * @var NXPS32K358State::cluster
+ * CPU clusters, one per core: the cores have different views of the memory
+ * (their own TCMs), so TCG must not share translated code among them. Only the
+ * first num_cpus are realized.
+ *
  * @var NXPS32K358State::armv7m
- * The ARMv7-M CPU state.
+ * The ARMv7-M CPU state of each core, each with its own NVIC and SysTick.
  *
- * @var NXPS32K358State::code_flash_0
- * Memory region for the first code flash.
+ * @var NXPS32K358State::cpu_container
+ * Memory seen by each core: the system memory, overlaid with the TCMs of the
+ * core and its view of the MSCM identification registers.
  *
- * @var NXPS32K358State::code_flash_1
- * Memory region for the second code flash.
+ * @var NXPS32K358State::sysmem_alias
+ * Alias of the system memory in the memory seen by each core.
  *
- * @var NXPS32K358State::code_flash_2
- * Memory region for the third code flash.
+ * @var NXPS32K358State::mscm_cpx
+ * MSCM processor identification registers, as seen by each core.
  *
- * @var NXPS32K358State::code_flash_3
- * Memory region for the fourth code flash.
+ * @var NXPS32K358State::irq_splitter
+ * Splitters feeding each interrupt of the peripherals to the NVICs of all the
+ * cores, only realized with more than one core; the firmware enables each
+ * interrupt in the NVIC of the core that handles it.
+ *
+ * @var NXPS32K358State::code_flash
+ * Memory regions for the code flash blocks: ROM, or aliases of
+ * code_flash_memdev.
  *
  * @var NXPS32K358State::data_flash
- * Memory region for the data flash.
+ * Memory region for the data flash: an alias of the array of the FMU, or of
+ * data_flash_memdev.
+ *
+ * @var NXPS32K358State::code_flash_memdev
+ * Property "code-flash-memdev": optional memory backend holding the contents
+ * of the code flash (CODE_FLASH_NUM_BLOCKS * CODE_FLASH_BLOCK_SIZE bytes).
+ * A memory-backend-file with share=off maps a prebuilt flash image
+ * copy-on-write, so that instances running the same image share its pages.
+ *
+ * @var NXPS32K358State::data_flash_memdev
+ * Property "data-flash-memdev": optional memory backend holding the contents
+ * of the data flash (DATA_FLASH_SIZE bytes), instead of the FMU.
  *
  * @var NXPS32K358State::sram_0
  * Memory region for the first SRAM.
@@ -95,15 +163,16 @@ static inline uint32_t EDMA_IRQ(int n) { return 4 + n; }
  * Memory region for the third SRAM.
  *
  * @var NXPS32K358State::dtcm
- * Memory region for the Data Tightly Coupled Memory.
+ * Memory regions for the Data Tightly Coupled Memory of each core. The TCMs of
+ * core 0 are also mapped in the system memory, where bus masters such as the
+ * eDMA can reach them.
  *
  * @var NXPS32K358State::itcm
- * Memory region for the Instruction Tightly Coupled Memory.
+ * Memory regions for the Instruction Tightly Coupled Memory of each core.
  *
- * @var NXPS32K358State::mc_me
- * Memory region for the Mode Entry module.
- * @note This module is not really implemented, it just returns a magic value
- * when reading at offset 0x310.
+ * @var NXPS32K358State::mc
+ * The clock generation and mode entry, deriving the clocks of the cores and
+ * of the peripherals from FXOSC and the internal oscillators.
  *
  * @var NXPS32K358State::lpuart
  * Array of LPUART states.
@@ -111,47 +180,60 @@ static inline uint32_t EDMA_IRQ(int n) { return 4 + n; }
  * @var NXPS32K358State::edma
  * The eDMA state.
  *
- * @var NXPS32K358State::sysclk
- * System clock.
+ * @var NXPS32K358State::dmamux
+ * Array of DMAMUX states, routing peripheral requests to the eDMA channels.
  *
- * @var NXPS32K358State::refclk
- * Reference clock.
+ * @var NXPS32K358State::fmu
+ * The FMU state, programming and erasing the code and the data flash.
  *
- * @var NXPS32K358State::aips_plat_clk
- * Clock used by LPUART channels 0, 1, and 8 (80MHz).
+ * @var NXPS32K358State::fmu_alt
+ * Alias of the FMU registers at FMU_ALT_BASE_ADDRESS.
  *
- * @var NXPS32K358State::aips_slow_clk
- * Clock used by other LPUART channels (40MHz).
+ * @var NXPS32K358State::fabric
+ * The peripheral fabric, answering for the peripherals that are not modelled.
+ *
+ * @var NXPS32K358State::fxosc
+ * Crystal of the external oscillator (FXOSC), wired up by the board.
+ *
+ * @var NXPS32K358State::refclk
+ * SysTick reference clock, CORE_CLK / 8.
  */
 struct NXPS32K358State {
     SysBusDevice parent_obj;
 
-    ARMv7MState armv7m;
+    uint32_t num_cpus;
+    uint32_t init_vtor[NXPS32K358_MAX_CPUS];
 
-    MemoryRegion code_flash_0;
-    MemoryRegion code_flash_1;
-    MemoryRegion code_flash_2;
-    MemoryRegion code_flash_3;
+    CPUClusterState cluster[NXPS32K358_MAX_CPUS];
+    ARMv7MState armv7m[NXPS32K358_MAX_CPUS];
+    MemoryRegion cpu_container[NXPS32K358_MAX_CPUS];
+    MemoryRegion sysmem_alias[NXPS32K358_MAX_CPUS];
+    MemoryRegion mscm_cpx[NXPS32K358_MAX_CPUS];
+    SplitIRQ irq_splitter[NXPS32K358_NUM_IRQ];
 
+    MemoryRegion code_flash[CODE_FLASH_NUM_BLOCKS];
     MemoryRegion data_flash;
+    HostMemoryBackend *code_flash_memdev;
+    HostMemoryBackend *data_flash_memdev;
 
     MemoryRegion sram_0;
     MemoryRegion sram_1;
     MemoryRegion sram_2;
 
-    MemoryRegion dtcm;
-    MemoryRegion itcm;
+    MemoryRegion dtcm[NXPS32K358_MAX_CPUS];
+    MemoryRegion itcm[NXPS32K358_MAX_CPUS];
 
-    MemoryRegion mc_me;
+    NXPS32K358MCState mc;
 
     NXPS32K358LPUartState lpuart[NUM_LPUARTS];
     NXPS32K358EDMAState edma;
+    NXPS32K358DMAMUXState dmamux[NUM_DMAMUX];
+    NXPS32K358FMUState fmu;
+    MemoryRegion fmu_alt;
+    NXPS32K358FabricState fabric;
 
-    Clock *sysclk;
+    Clock *fxosc;
     Clock *refclk;
-
-    Clock *aips_plat_clk;
-    Clock *aips_slow_clk;
 };
 
 typedef struct NXPS32K358State NXPS32K358State;
@@ -35,7 +35,8 @@
 #include "hw/arm/nxps32k358_soc.h"
 #include "hw/qdev-clock.h"
 
-#define SYSCLK_FRQ 160000000ULL
+// Crystal of the external oscillator (FXOSC) of the board
+#define FXOSC_FRQ 16000000ULL
 
 /**
  * @struct NXPS32K3X8EVBMachineState
@@ -47,14 +48,28 @@
  * @var NXPS32K3X8EVBMachineState::s32k
  * The state specific to the NXPS32K358.
  *
- * @var NXPS32K3X8EVBMachineState::sysclk
- * Pointer to the system clock.
+ * @var NXPS32K3X8EVBMachineState::fxosc
+ * Pointer to the clock of the FXOSC crystal.
+ *
+ * @var NXPS32K3X8EVBMachineState::lpuart_links
+ * Property "lpuart-links": LPUART ports wired directly to each other, as a
+ * colon separated list of A-B pairs (e.g. "2-3:5-5").
+ *
+ * @var NXPS32K3X8EVBMachineState::code_flash
+ * Property "code-flash": id of the memory backend holding the code flash.
+ *
+ * @var NXPS32K3X8EVBMachineState::data_flash
+ * Property "data-flash": id of the memory backend holding the data flash.
  */
 struct NXPS32K3X8EVBMachineState {
     MachineState parent_obj;
     NXPS32K358State s32k;
 
-    Clock *sysclk;
+    Clock *fxosc;
+
+    char *lpuart_links;
+    char *code_flash;
+    char *data_flash;
 };
 typedef struct NXPS32K3X8EVBMachineState NXPS32K3X8EVBMachineState;
 
@@ -0,0 +1,200 @@
+/*
+ * NXPS32K358 FMU
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_fmu.h
+ * @brief Definition of the NXPS32K358 FMU (Flash Management Unit).
+ */
+
+#ifndef HW_NXPS32K358_FMU_H
+#define HW_NXPS32K358_FMU_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+#include "hw/registerfields.h"
+#include "qemu/timer.h"
+#include "sysemu/block-backend.h"
+
+// Module Configuration Register
+REG32(FMU_MCR, 0x000)
+// EHV = 1 to start the program or erase operation selected by PGM/ERS
+FIELD(FMU_MCR, EHV, 0, 1)
+// ERS = 1 to select an erase operation
+FIELD(FMU_MCR, ERS, 4, 1)
+// ESS = 0 to erase a sector, ESS = 1 to erase a whole block
+FIELD(FMU_MCR, ESS, 5, 1)
+// PGM = 1 to select a program operation
+FIELD(FMU_MCR, PGM, 8, 1)
+
+// Module Configuration Status Register
+REG32(FMU_MCRS, 0x004)
+// PEG = 1 if the last program or erase operation succeeded
+FIELD(FMU_MCRS, PEG, 14, 1)
+// DONE = 0 while a program or erase operation is running
+FIELD(FMU_MCRS, DONE, 15, 1)
+
+REG32(FMU_MCRE, 0x008)
+REG32(FMU_CTL, 0x00C)
+REG32(FMU_ADR, 0x010)
+// Program and Erase Address: flash address of the operation
+REG32(FMU_PEADR, 0x014)
+
+// Program data registers, one quad-page (128 bytes) of data
+#define FMU_DATA_BASE_ADDR 0x100
+#define FMU_DATA_NUM 32
+static inline uint32_t A_FMU_DATA(int n) {
+    return FMU_DATA_BASE_ADDR + 4 * n;
+}
+
+#define FMU_MCR_RESET 0x00000000
+#define FMU_MCRS_RESET 0x00008000
+
+// Flash geometry: a program operation writes up to one quad-page, an erase
+// operation clears a sector or a whole block
+#define FMU_PAGE_SIZE (4 * FMU_DATA_NUM)
+#define FMU_SECTOR_SIZE (8 * 1024)
+
+// Approximate duration of the operations, when they are modelled
+#define FMU_PROGRAM_NS (100 * SCALE_US)
+#define FMU_SECTOR_ERASE_NS (8 * SCALE_MS)
+
+#define TYPE_NXPS32K358_FMU "nxps32k358-fmu"
+OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358FMUState, NXPS32K358_FMU)
+
+/**
+ * @struct NXPS32K358FMUState
+ * @brief Represents the state of the NXP S32K358 FMU.
+ *
+ * The FMU programs and erases the code flash and the data flash. Program and
+ * erase operations follow the C40 sequence: select PGM or ERS in MCR, write
+ * the flash address to PEADR (and the data to the DATA registers), then set
+ * MCR[EHV] and wait for MCRS[DONE].
+ *
+ * The FMU also owns the data flash array, a ROM device: reads run on the RAM
+ * fast path, while the contents only change through the FMU. With a block
+ * backend, the data flash is loaded from it and every operation on the data
+ * flash is written through, so that the contents survive across runs.
+ *
+ * @note Sector locking (PFCBLKn_SPELOCK) and error correction are not
+ * modelled: every sector is unlocked.
+ *
+ * @var NXPS32K358FMUState::parent_obj
+ * The parent system bus device.
+ *
+ * @var NXPS32K358FMUState::mmio
+ * Memory-mapped I/O region for the FMU registers.
+ *
+ * @var NXPS32K358FMUState::data_flash
+ * ROM device region of the data flash array.
+ *
+ * @var NXPS32K358FMUState::storage
+ * Host memory of the data flash array.
+ *
+ * @var NXPS32K358FMUState::blk
+ * Property "drive": block backend holding the data flash, NULL if the data
+ * flash is volatile.
+ *
+ * @var NXPS32K358FMUState::blk_ro
+ * Whether the block backend is read-only: the data flash is then loaded from
+ * it but not written through.
+ *
+ * @var NXPS32K358FMUState::mcr
+ * Module Configuration Register.
+ *
+ * @var NXPS32K358FMUState::mcrs
+ * Module Configuration Status Register.
+ *
+ * @var NXPS32K358FMUState::ctl
+ * Control Register (stored only).
+ *
+ * @var NXPS32K358FMUState::peadr
+ * Program and Erase Address register.
+ *
+ * @var NXPS32K358FMUState::data
+ * Program data registers.
+ *
+ * @var NXPS32K358FMUState::data_written
+ * DATA registers written since PGM was set, one bit per register: only those
+ * words are programmed.
+ *
+ * @var NXPS32K358FMUState::timer
+ * Virtual clock timer ending the running operation, when timed.
+ *
+ * @var NXPS32K358FMUState::timed
+ * Property "timed": if true, program and erase operations take
+ * FMU_PROGRAM_NS per quad-page and FMU_SECTOR_ERASE_NS per sector; otherwise
+ * they complete as soon as they are started.
+ *
+ * @var NXPS32K358FMUState::code_flash_base
+ * Property "code-flash-base": address of the code flash.
+ *
+ * @var NXPS32K358FMUState::code_flash_size
+ * Property "code-flash-size": size of the code flash.
+ *
+ * @var NXPS32K358FMUState::code_flash_block_size
+ * Property "code-flash-block-size": size of a code flash block, the unit of
+ * the block erase.
+ *
+ * @var NXPS32K358FMUState::data_flash_base
+ * Property "data-flash-base": address of the data flash, a single block.
+ *
+ * @var NXPS32K358FMUState::data_flash_size
+ * Property "data-flash-size": size of the data flash.
+ *
+ * @var NXPS32K358FMUState::code_flash_readonly
+ * Property "code-flash-readonly": the code flash is mapped from read-only
+ * host memory, every program or erase operation on it fails.
+ *
+ * @var NXPS32K358FMUState::data_flash_readonly
+ * Property "data-flash-readonly": the data flash is mapped from read-only
+ * host memory, every program or erase operation on it fails.
+ */
+struct NXPS32K358FMUState {
+    SysBusDevice parent_obj;
+    MemoryRegion mmio;
+    MemoryRegion data_flash;
+    uint8_t *storage;
+    BlockBackend *blk;
+    bool blk_ro;
+
+    uint32_t mcr;
+    uint32_t mcrs;
+    uint32_t ctl;
+    uint32_t peadr;
+    uint32_t data[FMU_DATA_NUM];
+    uint32_t data_written;
+
+    QEMUTimer *timer;
+    bool timed;
+
+    uint32_t code_flash_base;
+    uint32_t code_flash_size;
+    uint32_t code_flash_block_size;
+    uint32_t data_flash_base;
+    uint32_t data_flash_size;
+    bool code_flash_readonly;
+    bool data_flash_readonly;
+};
+
+#endif
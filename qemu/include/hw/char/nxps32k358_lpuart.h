@@ -34,12 +34,17 @@
 #include "chardev/char-fe.h"
 #include "qom/object.h"
 #include "hw/registerfields.h"
+#include "hw/register.h"
 #include "hw/qdev-clock.h"
-
-#define READONLY
+#include "qemu/fifo8.h"
+#include "qemu/timer.h"
 
 REG32(VERID, 0x00)
 REG32(PARAM, 0x04)
+// Log2 of the number of words in the transmit FIFO
+FIELD(PARAM, TXFIFO, 0, 8)
+// Log2 of the number of words in the receive FIFO
+FIELD(PARAM, RXFIFO, 8, 8)
 
 REG32(GLOBAL, 0x08)
 FIELD(GLOBAL, RST, 1, 1)
@@ -48,39 +53,157 @@ REG32(PINCFG, 0x0C)
 
 REG32(BAUD, 0x10)
 FIELD(BAUD, SBR, 0, 13)
+// SBNS = 1 for two stop bits, SBNS = 0 for one stop bit
+FIELD(BAUD, SBNS, 13, 1)
+// Match configuration, 0 for address match wakeup
+FIELD(BAUD, MATCFG, 18, 2)
+// RDMAE = 1 to generate a DMA request if STAT[RDRF] is 1
+FIELD(BAUD, RDMAE, 21, 1)
+// TDMAE = 1 to generate a DMA request if STAT[TDRE] is 1
+FIELD(BAUD, TDMAE, 23, 1)
 FIELD(BAUD, OSR, 24, 5)
+// M10 = 1 for 10-bit data format
+FIELD(BAUD, M10, 29, 1)
+// MAEN2/MAEN1 = 1 to compare the received addresses with MATCH[MA2/MA1]
+FIELD(BAUD, MAEN2, 30, 1)
+FIELD(BAUD, MAEN1, 31, 1)
 
 REG32(STAT, 0x14)
+// Match 2 and Match 1 Flags
+FIELD(STAT, MA2F, 14, 1)
+FIELD(STAT, MA1F, 15, 1)
+// Framing Error Flag
+FIELD(STAT, FE, 17, 1)
+// Idle Line Flag
+FIELD(STAT, IDLE, 20, 1)
+// Receiver Overrun Flag
+FIELD(STAT, OR, 19, 1)
 // Receiver Data Register Full Flag
 FIELD(STAT, RDRF, 21, 1)
+// Transmission Complete Flag
+FIELD(STAT, TC, 22, 1)
+// Transmit Data Register Empty Flag
+FIELD(STAT, TDRE, 23, 1)
 
 REG32(CONTROL, 0x18)
+// PE = 1 to enable parity, sent as the most significant data bit
+FIELD(CONTROL, PE, 1, 1)
+// Idle Line Type Select
+FIELD(CONTROL, ILT, 2, 1)
+// WAKE = 1 for address mark wakeup, WAKE = 0 for idle line wakeup
+FIELD(CONTROL, WAKE, 3, 1)
 // M = 0 for 8-bit data format, M = 1 for 9-bit data format
 FIELD(CONTROL, M, 4, 1)
+// STAT[IDLE] is set after 2^IDLECFG idle characters
+FIELD(CONTROL, IDLECFG, 8, 3)
 // M7 = 1 for 7-bit data format, M7 = 0 for other data formats
 FIELD(CONTROL, M7, 11, 1)
+// MA2IE/MA1IE = 1 to generate an IRQ if STAT[MA2F/MA1F] is 1
+FIELD(CONTROL, MA2IE, 14, 1)
+FIELD(CONTROL, MA1IE, 15, 1)
+// RWU = 1 to put the receiver in standby until a wakeup condition
+FIELD(CONTROL, RWU, 17, 1)
 // RE = 1 to enable the receiver
 FIELD(CONTROL, RE, 18, 1)
+// ILIE = 1 to generate an IRQ if STAT[IDLE] is 1
+FIELD(CONTROL, ILIE, 20, 1)
 // RIE = 1 to generate an IRQ if STAT[RDRF] is 1
 FIELD(CONTROL, RIE, 21, 1)
 // TCIE = 1 to generate an IRQ if STAT[TC] is 1
 FIELD(CONTROL, TCIE, 22, 1)
 // TIE = 1 to generate an IRQ if STAT[TDRE] is 1
 FIELD(CONTROL, TIE, 23, 1)
+// FEIE = 1 to generate an IRQ if STAT[FE] is 1
+FIELD(CONTROL, FEIE, 25, 1)
 
 REG32(DATA, 0x1C)
+// RXEMPT = 1 if the receive buffer is empty
+FIELD(DATA, RXEMPT, 12, 1)
+
 REG32(MATCH, 0x20)
+// Addresses compared with the received address characters
+FIELD(MATCH, MA1, 0, 10)
+FIELD(MATCH, MA2, 16, 10)
+
 REG32(MODIR, 0x24)
+// TXCTSE = 1 to transmit only while CTS is asserted
+FIELD(MODIR, TXCTSE, 0, 1)
+// RXRTSE = 1 to deassert RTS when the receive buffer reaches RTSWATER
+FIELD(MODIR, RXRTSE, 3, 1)
+// CTS source: 0 for the CTS pin, 1 for the receiver match result
+FIELD(MODIR, TXCTSSRC, 5, 1)
+// RTS is deasserted while the receive FIFO holds RTSWATER words or more
+FIELD(MODIR, RTSWATER, 8, 4)
+
 REG32(FIFO, 0x28)
+// Receive FIFO depth (read-only)
+FIELD(FIFO, RXFIFOSIZE, 0, 3)
+// RXFE = 1 to enable the receive FIFO
+FIELD(FIFO, RXFE, 3, 1)
+// Transmit FIFO depth (read-only)
+FIELD(FIFO, TXFIFOSIZE, 4, 3)
+// TXFE = 1 to enable the transmit FIFO
+FIELD(FIFO, TXFE, 7, 1)
+// RXUFE = 1 to generate an IRQ if FIFO[RXUF] is 1
+FIELD(FIFO, RXUFE, 8, 1)
+// TXOFE = 1 to generate an IRQ if FIFO[TXOF] is 1
+FIELD(FIFO, TXOFE, 9, 1)
+// Receiver Idle Empty Enable
+FIELD(FIFO, RXIDEN, 10, 3)
+// Write 1 to flush the receive FIFO
+FIELD(FIFO, RXFLUSH, 14, 1)
+// Write 1 to flush the transmit FIFO
+FIELD(FIFO, TXFLUSH, 15, 1)
+// Receiver Buffer Underflow Flag
+FIELD(FIFO, RXUF, 16, 1)
+// Transmitter Buffer Overflow Flag
+FIELD(FIFO, TXOF, 17, 1)
+// Receive Buffer/FIFO Empty (read-only)
+FIELD(FIFO, RXEMPT, 22, 1)
+// Transmit Buffer/FIFO Empty (read-only)
+FIELD(FIFO, TXEMPT, 23, 1)
+
 REG32(WATER, 0x2C)
+// TDRE is set while the transmit FIFO holds at most TXWATER words
+FIELD(WATER, TXWATER, 0, 4)
+// Number of words in the transmit FIFO (read-only)
+FIELD(WATER, TXCOUNT, 8, 5)
+// RDRF is set while the receive FIFO holds more than RXWATER words
+FIELD(WATER, RXWATER, 16, 4)
+// Number of words in the receive FIFO (read-only)
+FIELD(WATER, RXCOUNT, 24, 5)
+
 REG32(DATARO, 0x30)
 REG32(MCR, 0x40)
+// DTR and RTS output pins (RTS only while MODIR[RXRTSE] = 0)
+FIELD(MCR, DTR, 8, 1)
+FIELD(MCR, RTS, 9, 1)
+
 REG32(MSR, 0x44)
+// State of the CTS, DSR, RIN and DCD input pins
+FIELD(MSR, CTS, 4, 1)
+FIELD(MSR, DSR, 5, 1)
+FIELD(MSR, RIN, 6, 1)
+FIELD(MSR, DCD, 7, 1)
 REG32(REIR, 0x48)
 REG32(TEIR, 0x4C)
 REG32(HDCR, 0x50)
+
 REG32(TOCR, 0x58)
+// TOEN[n] = 1 to enable the timeout n
+FIELD(TOCR, TOEN, 0, 4)
+// TOIE[n] = 1 to generate an IRQ if TOSR[TOF[n]] is 1
+FIELD(TOCR, TOIE, 8, 4)
+
 REG32(TOSR, 0x5C)
+// TOZ[n] is set while the counter of the timeout n is zero (read-only)
+FIELD(TOSR, TOZ, 0, 4)
+// TOF[n] is set when the timeout n expires (write 1 to clear)
+FIELD(TOSR, TOF, 8, 4)
+
+// Timeout value, in bit periods of idle receiver
+FIELD(TIMEOUT, VALUE, 0, 14)
+FIELD(TIMEOUT, CFG, 30, 2)
 
 #define LPUART_TIMEOUT_BASE_ADDR 0x60
 #define LPUART_TIMEOUT_NUM 4
@@ -100,6 +223,12 @@ static inline uint32_t LPUART_TDBR(int n) {
     return LPUART_TDBR_BASE_ADDR + 4 * n;
 }
 
+// Index of the TIMEOUT[n] register in NXPS32K358LPUartState::regs
+#define R_TIMEOUT(n) (LPUART_TIMEOUT(n) / 4)
+
+// Number of 32-bit words of the register map, up to the last TDBR register
+#define LPUART_R_MAX (LPUART_TDBR_BASE_ADDR / 4 + LPUART_TDBR_NUM)
+
 /*
 The reset value for the LPUART_VERID register is 0x04040007 for
  * the first two LPUART devices, 0x04040003 otherwise */
@@ -111,7 +240,7 @@ static inline uint32_t LPUART_VERID_RESET(int n) {
 static inline uint32_t LPUART_PARAM_RESET(int n) {
     return n < 2 ? 0x00000404 : 0x00000202;
 }
-#define LPUART_GLOBAL_RESET 0x00000002
+#define LPUART_GLOBAL_RESET 0x00000000
 #define LPUART_PINCFG_RESET 0x00000000
 #define LPUART_BAUD_RESET 0x0F000004
 #define LPUART_STAT_RESET 0x00C00000
@@ -137,6 +266,49 @@ static inline uint32_t LPUART_FIFO_RESET(int n) {
 #define LPUART_TCB_RESET 0x00000000
 #define LPUART_TDB_RESET 0x00000000
 
+// Named GPIO outputs: DMA requests of the receiver and of the transmitter
+#define NXPS32K358_LPUART_DMA_RX "dma-rx-req"
+#define NXPS32K358_LPUART_DMA_TX "dma-tx-req"
+
+/**
+ * @struct NXPS32K358LPUartStats
+ * @brief Traffic and stall counters of an LPUART port.
+ *
+ * The counters are cumulative and survive device resets.
+ *
+ * @var NXPS32K358LPUartStats::tx_bytes
+ * Characters handed to the character backend or to the peer.
+ *
+ * @var NXPS32K358LPUartStats::rx_bytes
+ * Characters stored in the receive buffer.
+ *
+ * @var NXPS32K358LPUartStats::rx_overruns
+ * Characters lost because the receive buffer was full (STAT[OR]).
+ *
+ * @var NXPS32K358LPUartStats::rx_drops
+ * Characters discarded because the receiver was disabled, in standby or
+ * addressed to another node.
+ *
+ * @var NXPS32K358LPUartStats::tx_drops
+ * Characters discarded because the port had nowhere to send them.
+ *
+ * @var NXPS32K358LPUartStats::tx_stall_ns
+ * Virtual time the transmitter held data it could not send (backend not
+ * writable, peer full or CTS deasserted), in nanoseconds.
+ *
+ * @var NXPS32K358LPUartStats::irqs
+ * Assertions of the interrupt line.
+ */
+struct NXPS32K358LPUartStats {
+    uint64_t tx_bytes;
+    uint64_t rx_bytes;
+    uint64_t rx_overruns;
+    uint64_t rx_drops;
+    uint64_t tx_drops;
+    uint64_t tx_stall_ns;
+    uint64_t irqs;
+};
+
 #define TYPE_NXPS32K358_LPUART "nxps32k358-lpuart"
 OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358LPUartState, NXPS32K358_LPUART)
 
@@ -147,127 +319,155 @@ OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358LPUartState, NXPS32K358_LPUART)
  * @var NXPS32K358LPUartState::parent_obj
  * The parent system bus device object.
  *
- * @var NXPS32K358LPUartState::mmio
- * Memory-mapped I/O region for the LPUART device.
- *
  * @var NXPS32K358LPUartState::lpuart_port
- * The LPUART port number, ranging from 0 to 15.
+ * The LPUART port number, ranging from 0 to 15 (property "port"). It selects
+ * the reset values of the registers describing the FIFOs.
  *
- * @var NXPS32K358LPUartState::lpuart_verid
- * Read-only register for the LPUART version ID.
+ * @var NXPS32K358LPUartState::regs
+ * The register file, indexed by the register offset divided by 4 (R_*
+ * constants). Registers computed on read (DATA, DATARO, MSR and the counters
+ * of WATER) hold only their stored bits; DATA holds the last word read from
+ * the receive buffer.
  *
- * @var NXPS32K358LPUartState::lpuart_param
- * Read-only register for the LPUART parameters.
+ * @var NXPS32K358LPUartState::regs_info
+ * Access descriptors of the registers, indexed like regs. Offsets that are
+ * not part of the register map have no access table.
  *
- * @var NXPS32K358LPUartState::lpuart_global
- * Global control register for the LPUART.
+ * @var NXPS32K358LPUartState::reg_array
+ * The register block created from the access tables; its memory region is
+ * the memory-mapped I/O region of the device.
  *
- * @var NXPS32K358LPUartState::lpuart_pincfg
- * Pin configuration register for the LPUART.
+ * @var NXPS32K358LPUartState::clk
+ * Clock associated with the LPUART device.
  *
- * @var NXPS32K358LPUartState::lpuart_baud
- * Baud rate configuration register for the LPUART.
+ * @var NXPS32K358LPUartState::chr
+ * Character backend for the LPUART device.
  *
- * @var NXPS32K358LPUartState::lpuart_stat
- * Status register for the LPUART.
+ * @var NXPS32K358LPUartState::irq
+ * Interrupt request line for the LPUART device.
  *
- * @var NXPS32K358LPUartState::lpuart_control
- * Control register for the LPUART.
+ * @var NXPS32K358LPUartState::dma_rx_req
+ * DMA request line of the receiver, towards the DMAMUX.
  *
- * @var NXPS32K358LPUartState::lpuart_data
- * Data register for the LPUART.
+ * @var NXPS32K358LPUartState::dma_tx_req
+ * DMA request line of the transmitter, towards the DMAMUX.
  *
- * @var NXPS32K358LPUartState::lpuart_match
- * Match address register for the LPUART.
+ * @var NXPS32K358LPUartState::rx_fifo
+ * Receive buffer, as deep as the receive FIFO reported by PARAM. Only one
+ * word of it is used while the FIFO is disabled (FIFO[RXFE] = 0).
  *
- * @var NXPS32K358LPUartState::lpuart_modir
- * Modem IR register for the LPUART.
+ * @var NXPS32K358LPUartState::tx_fifo
+ * Transmit buffer, as deep as the transmit FIFO reported by PARAM. Only one
+ * word of it is used while the FIFO is disabled (FIFO[TXFE] = 0).
  *
- * @var NXPS32K358LPUartState::lpuart_fifo
- * FIFO control register for the LPUART.
+ * @var NXPS32K358LPUartState::watch_tag
+ * Tag of the watch waiting for the character backend to become writable, 0
+ * if the transmit buffer is not waiting for the backend.
  *
- * @var NXPS32K358LPUartState::lpuart_water
- * Watermark register for the LPUART.
+ * @var NXPS32K358LPUartState::tx_timer
+ * Virtual clock timer running while a character is in the transmit shifter
+ * (paced mode).
  *
- * @var NXPS32K358LPUartState::lpuart_dataro
- * Read-only data register for the LPUART.
+ * @var NXPS32K358LPUartState::rx_timer
+ * Virtual clock timer running while a character is in the receive shifter
+ * (paced mode).
  *
- * @var NXPS32K358LPUartState::lpuart_mcr
- * Modem control register for the LPUART.
+ * @var NXPS32K358LPUartState::rx_shift
+ * The character in the receive shifter (paced mode).
  *
- * @var NXPS32K358LPUartState::lpuart_msr
- * Modem status register for the LPUART.
+ * @var NXPS32K358LPUartState::idle_timer
+ * Virtual clock timer firing at the next idle line or timeout event.
  *
- * @var NXPS32K358LPUartState::lpuart_reir
- * Receive error interrupt register for the LPUART.
+ * @var NXPS32K358LPUartState::last_rx_ns
+ * Virtual time at which the last character was received.
  *
- * @var NXPS32K358LPUartState::lpuart_teir
- * Transmit error interrupt register for the LPUART.
+ * @var NXPS32K358LPUartState::idle_pending
+ * Idle line and timeout events waiting for the receiver to be idle long
+ * enough, one bit per event (IDLE_EV_* in nxps32k358_lpuart.c).
  *
- * @var NXPS32K358LPUartState::lpuart_hdcr
- * Hardware debug control register for the LPUART.
+ * @var NXPS32K358LPUartState::rx_idle
+ * Whether the receiver has been idle for the time selected by FIFO[RXIDEN],
+ * which asserts STAT[RDRF] even below the receive watermark.
  *
- * @var NXPS32K358LPUartState::lpuart_tocr
- * Timeout control register for the LPUART.
+ * @var NXPS32K358LPUartState::tiocm
+ * Modem output lines (CHR_TIOCM_RTS, CHR_TIOCM_DTR) last propagated to the
+ * character backend, -1 if they have not been driven since reset.
  *
- * @var NXPS32K358LPUartState::lpuart_tosr
- * Timeout status register for the LPUART.
+ * @var NXPS32K358LPUartState::rx_match
+ * Whether the last address character matched MATCH[MA1] or MATCH[MA2]; it
+ * drives CTS when MODIR[TXCTSSRC] = 1.
  *
- * @var NXPS32K358LPUartState::lpuart_timeout
- * Array of timeout registers for the LPUART.
+ * @var NXPS32K358LPUartState::irq_level
+ * Current level of the interrupt line.
  *
- * @var NXPS32K358LPUartState::lpuart_tcb
- * Array of transmit control buffer registers for the LPUART.
+ * @var NXPS32K358LPUartState::tx_stalled
+ * Whether the transmitter is stalled, since tx_stall_start.
  *
- * @var NXPS32K358LPUartState::lpuart_tdb
- * Array of transmit data buffer registers for the LPUART.
+ * @var NXPS32K358LPUartState::tx_stall_start
+ * Virtual time at which the transmitter stalled.
  *
- * @var NXPS32K358LPUartState::clk
- * Clock associated with the LPUART device.
+ * @var NXPS32K358LPUartState::stats
+ * Traffic and stall counters, exposed as "stats-*" QOM properties and through
+ * query-stats.
  *
- * @var NXPS32K358LPUartState::chr
- * Character backend for the LPUART device.
+ * @var NXPS32K358LPUartState::peer
+ * Property: the LPUART instance this one is wired to. The transmitter of each
+ * port feeds the receiver of the other one directly, in place of the
+ * character backend; a port may also be wired to itself (loopback). The link
+ * is made symmetric at realize time.
  *
- * @var NXPS32K358LPUartState::irq
- * Interrupt request line for the LPUART device.
+ * @var NXPS32K358LPUartState::peer_blocked
+ * Whether the transmitter is waiting for room in the receive buffer of the
+ * peer.
+ *
+ * @var NXPS32K358LPUartState::paced
+ * Property: if true, characters take the frame time computed from the baud
+ * rate to be transmitted and received; otherwise they move with no emulated
+ * time cost (turbo mode).
  */
 struct NXPS32K358LPUartState {
     /* <private> */
     SysBusDevice parent_obj;
 
     /* <public> */
-    MemoryRegion mmio;
-
     // Will be an integer from 0 to 15
     uint32_t lpuart_port;
 
-    uint32_t READONLY lpuart_verid;
-    uint32_t READONLY lpuart_param;
-    uint32_t lpuart_global;
-    uint32_t lpuart_pincfg;
-    uint32_t lpuart_baud;
-    uint32_t lpuart_stat;
-    uint32_t lpuart_control;
-    uint32_t lpuart_data;
-    uint32_t lpuart_match;
-    uint32_t lpuart_modir;
-    uint32_t lpuart_fifo;
-    uint32_t lpuart_water;
-    uint32_t READONLY lpuart_dataro;
-    uint32_t lpuart_mcr;
-    uint32_t lpuart_msr;
-    uint32_t lpuart_reir;
-    uint32_t lpuart_teir;
-    uint32_t lpuart_hdcr;
-    uint32_t lpuart_tocr;
-    uint32_t lpuart_tosr;
-    uint32_t lpuart_timeout[LPUART_TIMEOUT_NUM];
-    uint32_t lpuart_tcb[LPUART_TCBR_NUM];
-    uint32_t lpuart_tdb[LPUART_TDBR_NUM];
+    uint32_t regs[LPUART_R_MAX];
+    RegisterInfo regs_info[LPUART_R_MAX];
+    RegisterInfoArray *reg_array;
 
     Clock *clk;
     CharBackend chr;
     qemu_irq irq;
+    qemu_irq dma_rx_req;
+    qemu_irq dma_tx_req;
+
+    Fifo8 rx_fifo;
+    Fifo8 tx_fifo;
+    guint watch_tag;
+
+    QEMUTimer *tx_timer;
+    QEMUTimer *rx_timer;
+    uint8_t rx_shift;
+
+    QEMUTimer *idle_timer;
+    int64_t last_rx_ns;
+    uint32_t idle_pending;
+    bool rx_idle;
+
+    int tiocm;
+    bool rx_match;
+
+    bool irq_level;
+    bool tx_stalled;
+    int64_t tx_stall_start;
+    struct NXPS32K358LPUartStats stats;
+
+    NXPS32K358LPUartState *peer;
+    bool peer_blocked;
+
+    bool paced;
 };
 
 /**
@@ -280,11 +480,15 @@ struct NXPS32K358LPUartState {
  *
  * @param s Pointer to the NXPS32K358LPUartState structure containing the LPUART
  * state.
- * @return The calculated baud rate.
+ * @return The calculated baud rate, 0 if the baud rate generator is off
+ * (SBR = 0).
  */
 static inline uint32_t LPUART_BAUD_RATE(NXPS32K358LPUartState *s) {
-    uint32_t sbr = FIELD_EX32(s->lpuart_baud, BAUD, SBR);
-    uint32_t osr = FIELD_EX32(s->lpuart_baud, BAUD, OSR);
+    uint32_t sbr = FIELD_EX32(s->regs[R_BAUD], BAUD, SBR);
+    uint32_t osr = FIELD_EX32(s->regs[R_BAUD], BAUD, OSR);
+    if (sbr == 0) {
+        return 0;
+    }
     return clock_get_hz(s->clk) / (sbr * (osr + 1));
 }
 
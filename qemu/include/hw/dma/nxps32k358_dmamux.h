@@ -0,0 +1,94 @@
+/*
+ * NXPS32K358 DMAMUX
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_dmamux.h
+ * @brief Definition of the NXPS32K358 DMAMUX module.
+ */
+
+#ifndef NXP_S32K358_DMAMUX_H
+#define NXP_S32K358_DMAMUX_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+#include "hw/registerfields.h"
+
+// Every CHCFG register is 8 bits wide, the channel number is not the offset:
+// the four registers of each 32-bit word are stored in reverse order
+static inline uint32_t A_DMAMUX_CHCFG(int n) {
+    return n ^ 3;
+}
+
+FIELD(DMAMUX_CHCFG, SOURCE, 0, 6)
+FIELD(DMAMUX_CHCFG, TRIG, 6, 1)
+FIELD(DMAMUX_CHCFG, ENBL, 7, 1)
+
+#define DMAMUX_CHCFG_RESET 0x00
+
+#define DMAMUX_CHANNELS 16
+#define DMAMUX_SOURCES 64
+
+// Named GPIO inputs (peripheral requests) and outputs (eDMA channel requests)
+#define NXPS32K358_DMAMUX_SOURCE "dma-source"
+#define NXPS32K358_DMAMUX_REQ "dma-req"
+
+#define TYPE_NXPS32K358_DMAMUX "nxps32k358-dmamux"
+OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358DMAMUXState, NXPS32K358_DMAMUX)
+
+/**
+ * @struct NXPS32K358DMAMUXState
+ * @brief Represents the state of an NXP S32K358 DMAMUX instance.
+ *
+ * Each instance routes up to 64 peripheral request sources to 16 eDMA
+ * channels. DMAMUX_0 feeds eDMA channels 0-15 and DMAMUX_1 feeds channels
+ * 16-31.
+ *
+ * @note Periodic triggering (TRIG) is not supported.
+ *
+ * @var NXPS32K358DMAMUXState::parent_obj
+ * The parent system bus device.
+ *
+ * @var NXPS32K358DMAMUXState::mmio
+ * Memory-mapped I/O region for the CHCFG registers.
+ *
+ * @var NXPS32K358DMAMUXState::chcfg
+ * Channel configuration registers.
+ *
+ * @var NXPS32K358DMAMUXState::source_level
+ * Current level of every peripheral request source, one bit per source.
+ *
+ * @var NXPS32K358DMAMUXState::req
+ * Request lines towards the eDMA channels.
+ */
+struct NXPS32K358DMAMUXState {
+    SysBusDevice parent_obj;
+    MemoryRegion mmio;
+
+    uint8_t chcfg[DMAMUX_CHANNELS];
+    uint64_t source_level;
+
+    qemu_irq req[DMAMUX_CHANNELS];
+};
+
+#endif
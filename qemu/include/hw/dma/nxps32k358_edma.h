@@ -32,6 +32,7 @@
 
 #include "hw/sysbus.h"
 #include "qom/object.h"
+#include "qemu/timer.h"
 #include "hw/registerfields.h"
 #include "hw/dma/nxps32k358_tcd.h"
 
@@ -40,6 +41,7 @@
 REG32(EDMA_CSR, 0x00)
 FIELD(EDMA_CSR, EDBG, 1, 1)
 FIELD(EDMA_CSR, ERCA, 2, 1)
+FIELD(EDMA_CSR, HAE, 4, 1)
 FIELD(EDMA_CSR, HALT, 5, 1)
 FIELD(EDMA_CSR, ECX, 8, 1)
 FIELD(EDMA_CSR, CX, 9, 1)
@@ -47,7 +49,16 @@ FIELD(EDMA_CSR, ACTIVE_ID, 24, 5)
 FIELD(EDMA_CSR, ACTIVE, 31, 1)
 
 REG32(EDMA_ES, 0x04)
+FIELD(EDMA_ES, DBE, 0, 1)
+FIELD(EDMA_ES, SBE, 1, 1)
+FIELD(EDMA_ES, SGE, 2, 1)
+FIELD(EDMA_ES, NCE, 3, 1)
+FIELD(EDMA_ES, DOE, 4, 1)
+FIELD(EDMA_ES, DAE, 5, 1)
+FIELD(EDMA_ES, SOE, 6, 1)
+FIELD(EDMA_ES, SAE, 7, 1)
 FIELD(EDMA_ES, ECX, 8, 1)
+FIELD(EDMA_ES, UCE, 9, 1)
 FIELD(EDMA_ES, ERRCHN, 24, 5)
 FIELD(EDMA_ES, VLD, 31, 1)
 
@@ -78,6 +89,67 @@ static inline uint32_t R_EDMA_CHN_GRPRI_GRPRI_MASK(int n) {
 
 #define EDMA_CHANNELS 32
 
+// Named GPIO inputs for the hardware service requests coming from the DMAMUX
+#define NXPS32K358_EDMA_REQ "dma-req"
+
+// Default engine bandwidth in bytes per microsecond (MB/s): one 32-bit read
+// and one 32-bit write every two cycles of the 160MHz system clock
+#define EDMA_DEFAULT_BANDWIDTH 320
+
+/**
+ * @struct NXPS32K358EDMASGCache
+ * @brief Scatter-gather descriptor prefetched for a channel.
+ *
+ * @var NXPS32K358EDMASGCache::addr
+ * Address of the prefetched TCD image.
+ *
+ * @var NXPS32K358EDMASGCache::pass
+ * Engine pass in which the image was read; the entry is only valid during
+ * that pass.
+ *
+ * @var NXPS32K358EDMASGCache::image
+ * The prefetched TCD image.
+ */
+struct NXPS32K358EDMASGCache {
+    uint32_t addr;
+    uint32_t pass;
+    uint8_t image[NXPS32K358_TCD_IMAGE_SIZE];
+};
+
+/**
+ * @struct NXPS32K358EDMAChannelStats
+ * @brief Performance counters of an eDMA channel.
+ *
+ * The counters are cumulative and survive device resets.
+ *
+ * @var NXPS32K358EDMAChannelStats::bytes
+ * Bytes moved by the channel.
+ *
+ * @var NXPS32K358EDMAChannelStats::minor_loops
+ * Minor loops completed.
+ *
+ * @var NXPS32K358EDMAChannelStats::major_loops
+ * Major loops completed.
+ *
+ * @var NXPS32K358EDMAChannelStats::sg_loads
+ * Scatter-gather descriptors loaded.
+ *
+ * @var NXPS32K358EDMAChannelStats::dropped_requests
+ * Service requests received while the channel already had one pending or in
+ * progress.
+ *
+ * @var NXPS32K358EDMAChannelStats::host_ns
+ * Host time spent moving data for the channel, in nanoseconds.
+ */
+struct NXPS32K358EDMAChannelStats {
+    uint64_t bytes;
+    uint64_t minor_loops;
+    uint64_t major_loops;
+    uint64_t sg_loads;
+    uint64_t dropped_requests;
+    uint64_t host_ns;
+};
+
 #define TYPE_NXPS32K358_EDMA "nxps32k358-edma"
 OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358EDMAState, NXPS32K358_EDMA)
 
@@ -109,13 +181,69 @@ OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358EDMAState, NXPS32K358_EDMA)
  * Interrupt status register (read-only).
  *
  * @var NXPS32K358EDMAState::edma_hrs
- * Hardware request status register (read-only).
+ * Hardware request status register (read-only): the asserted request lines of
+ * the channels with CH_CSR.ERQ set.
  *
  * @var NXPS32K358EDMAState::edma_chn_grpri
  * Channel group priority registers.
  *
  * @var NXPS32K358EDMAState::tcd
  * Transfer control descriptors for each eDMA channel.
+ *
+ * @var NXPS32K358EDMAState::dma_req
+ * Current level of the hardware service request lines, one bit per channel.
+ *
+ * @var NXPS32K358EDMAState::engine_timer
+ * Virtual clock timer that fires when the active minor loop ends (timed
+ * mode).
+ *
+ * @var NXPS32K358EDMAState::engine_bh
+ * Bottom half servicing all the pending channels at once (instant mode).
+ *
+ * @var NXPS32K358EDMAState::active_ch
+ * Channel whose minor loop is in progress in timed mode, -1 if idle.
+ *
+ * @var NXPS32K358EDMAState::active_end
+ * Virtual clock time at which the active minor loop ends.
+ *
+ * @var NXPS32K358EDMAState::preempted_ch
+ * Channel suspended by a higher priority one, -1 if none.
+ *
+ * @var NXPS32K358EDMAState::preempted_left
+ * Remaining time of the suspended minor loop, in nanoseconds.
+ *
+ * @var NXPS32K358EDMAState::pending
+ * Channels with a pending service request, indexed by channel number.
+ *
+ * @var NXPS32K358EDMAState::pending_rank
+ * Channels with a pending service request, indexed by priority rank (bit 0 is
+ * the highest priority channel).
+ *
+ * @var NXPS32K358EDMAState::prio_order
+ * Channel numbers sorted by decreasing arbitration priority.
+ *
+ * @var NXPS32K358EDMAState::rank
+ * Position of every channel in prio_order.
+ *
+ * @var NXPS32K358EDMAState::rr_next
+ * First channel considered by the next round-robin arbitration.
+ *
+ * @var NXPS32K358EDMAState::sg_cache
+ * Next scatter-gather descriptor of each channel, prefetched when the current
+ * one is loaded.
+ *
+ * @var NXPS32K358EDMAState::pass
+ * Engine pass counter, incremented every time the engine is entered from the
+ * main loop. Guest code may only run between passes.
+ *
+ * @var NXPS32K358EDMAState::stats
+ * Performance counters of each channel.
+ *
+ * @var NXPS32K358EDMAState::instant
+ * Property: if true, transfers take no emulated time.
+ *
+ * @var NXPS32K358EDMAState::bandwidth
+ * Property: modelled engine bandwidth in bytes per microsecond (MB/s).
  */
 struct NXPS32K358EDMAState {
     SysBusDevice parent_obj;
@@ -128,6 +256,28 @@ struct NXPS32K358EDMAState {
     uint32_t READONLY edma_hrs;
     uint32_t edma_chn_grpri[EDMA_CHANNELS];
     struct NXPS32K358EDMATCDState tcd[EDMA_CHANNELS];
+    uint32_t dma_req;
+
+    QEMUTimer *engine_timer;
+    QEMUBH *engine_bh;
+    int active_ch;
+    int64_t active_end;
+    int preempted_ch;
+    int64_t preempted_left;
+
+    uint32_t pending;
+    uint32_t pending_rank;
+    uint8_t prio_order[EDMA_CHANNELS];
+    uint8_t rank[EDMA_CHANNELS];
+    int rr_next;
+
+    struct NXPS32K358EDMASGCache sg_cache[EDMA_CHANNELS];
+    uint32_t pass;
+
+    struct NXPS32K358EDMAChannelStats stats[EDMA_CHANNELS];
+
+    bool instant;
+    uint32_t bandwidth;
 };
 
 #endif
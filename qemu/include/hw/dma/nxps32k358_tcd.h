@@ -30,14 +30,26 @@
 #ifndef NXP_S32K358_EDMA_TCD_H
 #define NXP_S32K358_EDMA_TCD_H
 
+#include "qemu/bswap.h"
 #include "hw/registerfields.h"
 
 REG32(CH_CSR, 0x0)
+FIELD(CH_CSR, ERQ, 0, 1)
+FIELD(CH_CSR, EARQ, 1, 1)
 FIELD(CH_CSR, EEI, 2, 1)
+FIELD(CH_CSR, EBW, 3, 1)
 FIELD(CH_CSR, DONE, 30, 1)
 FIELD(CH_CSR, ACTIVE, 31, 1)
 
 REG32(CH_ES, 0x4)
+FIELD(CH_ES, DBE, 0, 1)
+FIELD(CH_ES, SBE, 1, 1)
+FIELD(CH_ES, SGE, 2, 1)
+FIELD(CH_ES, NCE, 3, 1)
+FIELD(CH_ES, DOE, 4, 1)
+FIELD(CH_ES, DAE, 5, 1)
+FIELD(CH_ES, SOE, 6, 1)
+FIELD(CH_ES, SAE, 7, 1)
 FIELD(CH_ES, ERR, 31, 1)
 
 REG32(CH_INT, 0x8)
@@ -46,19 +58,26 @@ FIELD(CH_INT, INT, 0, 1)
 REG32(CH_SBR, 0xC)
 
 REG32(CH_PRI, 0x10)
+FIELD(CH_PRI, APL, 0, 3)
+FIELD(CH_PRI, DPA, 30, 1)
+FIELD(CH_PRI, ECP, 31, 1)
 
 REG32(TCD_SADDR, 0x20)
 REG16(TCD_SOFF, 0x24)
 
 REG16(TCD_ATTR, 0x26)
+FIELD(TCD_ATTR, SMOD, 11, 5)
 FIELD(TCD_ATTR, SSIZE, 8, 3)
+FIELD(TCD_ATTR, DMOD, 3, 5)
 FIELD(TCD_ATTR, DSIZE, 0, 3)
 
-// No support for minor loop offset enable
 REG32(TCD_NBYTES_MLOFF, 0x28)
 FIELD(TCD_NBYTES_MLOFF, NBYTES, 0, 30)
 FIELD(TCD_NBYTES_MLOFF, DMLOE, 30, 1)
 FIELD(TCD_NBYTES_MLOFF, SMLOE, 31, 1)
+// Layout of NBYTES when a minor loop offset is enabled (SMLOE or DMLOE = 1)
+FIELD(TCD_NBYTES_MLOFF, NBYTES_MLOFFYES, 0, 10)
+FIELD(TCD_NBYTES_MLOFF, MLOFF, 10, 20)
 
 REG32(TCD_SLAST_SDA, 0x2C)
 FIELD(TCD_SLAST_SDA, SLAST_SDA, 0, 32)
@@ -69,6 +88,9 @@ REG16(TCD_DOFF, 0x34)
 REG16(TCD_CITER, 0x36)
 FIELD(TCD_CITER, ELINK, 15, 1)
 FIELD(TCD_CITER, CITER, 0, 15)
+// Layout of CITER when minor loop channel linking is enabled (ELINK = 1)
+FIELD(TCD_CITER, LINKCH, 9, 5)
+FIELD(TCD_CITER, CITER_ELINK, 0, 9)
 
 REG32(TCD_DLAST_SGA, 0x38)
 FIELD(TCD_DLAST_SGA, DLAST_SGA, 0, 32)
@@ -77,22 +99,31 @@ REG16(TCD_CSR, 0x3C)
 FIELD(TCD_CSR, START, 0, 1)
 FIELD(TCD_CSR, INTMAJOR, 1, 1)
 FIELD(TCD_CSR, INTHALF, 2, 1)
+FIELD(TCD_CSR, DREQ, 3, 1)
 FIELD(TCD_CSR, ESG, 4, 1)
 FIELD(TCD_CSR, ESDA, 7, 1)
 FIELD(TCD_CSR, MAJORELINK, 5, 1)
+FIELD(TCD_CSR, MAJORLINKCH, 8, 5)
 
 REG16(TCD_BITER, 0x3E)
 FIELD(TCD_BITER, ELINK, 15, 1)
 FIELD(TCD_BITER, BITER, 0, 15)
+// Layout of BITER when minor loop channel linking is enabled (ELINK = 1)
+FIELD(TCD_BITER, LINKCH, 9, 5)
+FIELD(TCD_BITER, BITER_ELINK, 0, 9)
+
+// Size of the TCD image in memory, as loaded by scatter-gather: it spans the
+// registers from TCD_SADDR to TCD_BITER
+#define NXPS32K358_TCD_IMAGE_SIZE 0x20
+
+// Offset of a TCD register inside the TCD image
+#define NXPS32K358_TCD_IMAGE_OFF(reg) (A_##reg - A_TCD_SADDR)
 
 /**
  * @struct NXPS32K358EDMATCDState
  * @brief Represents the state of an NXP S32K358 eDMA TCD (Transfer Control
  * Descriptor).
  *
- * @note This implementation does not support minor loop offset enable and
- * channel linking.
- *
  * @var NXPS32K358EDMATCDState::ch_csr
  * Channel Control and Status register.
  *
@@ -157,7 +188,7 @@ struct NXPS32K358EDMATCDState {
     uint32_t tcd_nbytes_mloff;
     uint32_t tcd_slast_sda;
     uint32_t tcd_daddr;
-    uint16_t tcd_doff;
+    int16_t tcd_doff;
     uint16_t tcd_citer;
     uint32_t tcd_dlast_sga;
     uint16_t tcd_csr;
@@ -166,4 +197,59 @@ struct NXPS32K358EDMATCDState {
     qemu_irq irq;
 };
 
+/**
+ * @brief Loads the TCD registers from a TCD image.
+ *
+ * The image has the little-endian layout of the TCD registers, from TCD_SADDR
+ * to TCD_BITER, as found in memory when scatter-gather is used. The channel
+ * registers (CH_*) are not part of the image and are left untouched.
+ *
+ * @param tcd Pointer to the NXPS32K358EDMATCDState structure to be loaded.
+ * @param image Pointer to the NXPS32K358_TCD_IMAGE_SIZE bytes of the image.
+ */
+static inline void nxps32k358_tcd_decode(struct NXPS32K358EDMATCDState *tcd,
+                                         const uint8_t *image) {
+    tcd->tcd_saddr = ldl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_SADDR));
+    tcd->tcd_soff = lduw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_SOFF));
+    tcd->tcd_attr = lduw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_ATTR));
+    tcd->tcd_nbytes_mloff =
+        ldl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_NBYTES_MLOFF));
+    tcd->tcd_slast_sda =
+        ldl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_SLAST_SDA));
+    tcd->tcd_daddr = ldl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_DADDR));
+    tcd->tcd_doff = lduw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_DOFF));
+    tcd->tcd_citer = lduw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_CITER));
+    tcd->tcd_dlast_sga =
+        ldl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_DLAST_SGA));
+    tcd->tcd_csr = lduw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_CSR));
+    tcd->tcd_biter = lduw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_BITER));
+}
+
+/**
+ * @brief Stores the TCD registers into a TCD image.
+ *
+ * This is the inverse of nxps32k358_tcd_decode().
+ *
+ * @param tcd Pointer to the NXPS32K358EDMATCDState structure to be stored.
+ * @param image Pointer to the NXPS32K358_TCD_IMAGE_SIZE bytes of the image.
+ */
+static inline void
+nxps32k358_tcd_encode(const struct NXPS32K358EDMATCDState *tcd,
+                      uint8_t *image) {
+    stl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_SADDR), tcd->tcd_saddr);
+    stw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_SOFF), tcd->tcd_soff);
+    stw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_ATTR), tcd->tcd_attr);
+    stl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_NBYTES_MLOFF),
+             tcd->tcd_nbytes_mloff);
+    stl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_SLAST_SDA),
+             tcd->tcd_slast_sda);
+    stl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_DADDR), tcd->tcd_daddr);
+    stw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_DOFF), tcd->tcd_doff);
+    stw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_CITER), tcd->tcd_citer);
+    stl_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_DLAST_SGA),
+             tcd->tcd_dlast_sga);
+    stw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_CSR), tcd->tcd_csr);
+    stw_le_p(image + NXPS32K358_TCD_IMAGE_OFF(TCD_BITER), tcd->tcd_biter);
+}
+
 #endif
@@ -0,0 +1,107 @@
+/*
+ * NXPS32K358 peripheral fabric
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_fabric.h
+ * @brief Definition of the NXPS32K358 peripheral fabric, the background of
+ * the peripheral address space.
+ */
+
+#ifndef HW_NXPS32K358_FABRIC_H
+#define HW_NXPS32K358_FABRIC_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+// Window of the peripheral address space covered by the fabric
+#define FABRIC_BASE_ADDRESS 0x40000000
+#define FABRIC_SIZE 0x00600000
+
+#define TYPE_NXPS32K358_FABRIC "nxps32k358-fabric"
+OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358FabricState, NXPS32K358_FABRIC)
+
+/**
+ * @struct NXPS32K358FabricRegion
+ * @brief A peripheral of the address map of the fabric.
+ *
+ * @var NXPS32K358FabricRegion::name
+ * Name of the peripheral, as in the reference manual.
+ *
+ * @var NXPS32K358FabricRegion::base
+ * Offset of the peripheral in the fabric window.
+ *
+ * @var NXPS32K358FabricRegion::size
+ * Size of the peripheral.
+ */
+typedef struct NXPS32K358FabricRegion {
+    const char *name;
+    uint32_t base;
+    uint32_t size;
+} NXPS32K358FabricRegion;
+
+/**
+ * @struct NXPS32K358FabricState
+ * @brief Represents the state of the NXP S32K358 peripheral fabric.
+ *
+ * The fabric stands in for every peripheral of the address map that is not
+ * modelled, with a single memory region mapped below the real devices. The
+ * peripherals are looked up in a static table sorted by address; accesses
+ * between them fail as bus errors, as if nothing were mapped there.
+ *
+ * Reads return 0, unless the fabric remembers writes: then each word reads
+ * back the last value written to it, so that initialization code polling a
+ * bit it has just set can go on.
+ *
+ * @var NXPS32K358FabricState::parent_obj
+ * The parent system bus device.
+ *
+ * @var NXPS32K358FabricState::mmio
+ * Memory-mapped I/O region covering the whole fabric window.
+ *
+ * @var NXPS32K358FabricState::regs
+ * Words written to the peripherals, keyed by offset in the window, when
+ * remember_writes is set. Only the words actually written are stored.
+ *
+ * @var NXPS32K358FabricState::log_count
+ * Number of accesses logged for each peripheral of the table.
+ *
+ * @var NXPS32K358FabricState::remember_writes
+ * Property "remember-writes": if true, the words written read back.
+ *
+ * @var NXPS32K358FabricState::log_limit
+ * Property "log-limit": number of accesses logged for each peripheral with
+ * LOG_UNIMP before it goes quiet, 0 to log them all.
+ */
+struct NXPS32K358FabricState {
+    SysBusDevice parent_obj;
+    MemoryRegion mmio;
+
+    GHashTable *regs;
+    uint32_t *log_count;
+
+    bool remember_writes;
+    uint32_t log_limit;
+};
+
+#endif
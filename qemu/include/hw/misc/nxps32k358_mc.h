@@ -0,0 +1,292 @@
+/*
+ * NXPS32K358 clock generation and mode entry
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * @file nxps32k358_mc.h
+ * @brief Definition of the NXPS32K358 clock generation and mode entry: the
+ * FXOSC, the MC_CGM, the MC_ME and the PLL.
+ */
+
+#ifndef HW_NXPS32K358_MC_H
+#define HW_NXPS32K358_MC_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+#include "hw/clock.h"
+#include "hw/registerfields.h"
+
+// Each block of the clock tree takes one 16KB slot of the peripheral space
+#define MC_BLOCK_SIZE 0x4000
+
+// Internal oscillators, always running
+#define FIRC_FRQ 48000000
+#define SIRC_FRQ 32000
+
+// FXOSC (crystal oscillator) registers
+REG32(FXOSC_CTRL, 0x00)
+// OSCON = 1 to switch the oscillator on
+FIELD(FXOSC_CTRL, OSCON, 0, 1)
+REG32(FXOSC_STAT, 0x04)
+// OSC_STAT = 1 once the oscillator is stable
+FIELD(FXOSC_STAT, OSC_STAT, 31, 1)
+
+// MC_CGM clock multiplexers, MUX_n registers at MC_CGM_MUX_ADDR(n). MUX_0
+// drives the core and the AIPS buses through its dividers DC_0, DC_1 and DC_2
+#define MC_CGM_MUX_BASE_ADDR 0x300
+#define MC_CGM_MUX_STRIDE 0x40
+#define MC_CGM_NUM_MUX 12
+static inline uint32_t MC_CGM_MUX_ADDR(int n) {
+    return MC_CGM_MUX_BASE_ADDR + MC_CGM_MUX_STRIDE * n;
+}
+
+// Offsets in the MUX_n registers
+REG32(CGM_MUX_CSC, 0x00)
+FIELD(CGM_MUX_CSC, RAMPUP, 0, 1)
+FIELD(CGM_MUX_CSC, RAMPDOWN, 1, 1)
+// CLK_SW = 1 to switch to the source selected by SELCTL
+FIELD(CGM_MUX_CSC, CLK_SW, 2, 1)
+// SAFE_SW = 1 to switch to FIRC, the safe clock
+FIELD(CGM_MUX_CSC, SAFE_SW, 3, 1)
+FIELD(CGM_MUX_CSC, SELCTL, 24, 6)
+REG32(CGM_MUX_CSS, 0x04)
+// CLK_SW = 1 once a clock switch has been done
+FIELD(CGM_MUX_CSS, CLK_SW, 2, 1)
+FIELD(CGM_MUX_CSS, SWIP, 16, 1)
+// SWTRG: outcome of the last clock switch
+FIELD(CGM_MUX_CSS, SWTRG, 17, 3)
+// SELSTAT: source in use
+FIELD(CGM_MUX_CSS, SELSTAT, 24, 6)
+REG32(CGM_MUX_DC_0, 0x08)
+// The output of divider DC_m is the source divided by DIV + 1, if DE = 1
+FIELD(CGM_MUX_DC, DIV, 16, 8)
+FIELD(CGM_MUX_DC, DE, 31, 1)
+REG32(CGM_MUX_DIV_TRIG_CTRL, 0x34)
+// TCTL = 1 to hold the divider changes until DIV_TRIG is written
+FIELD(CGM_MUX_DIV_TRIG_CTRL, TCTL, 0, 1)
+FIELD(CGM_MUX_DIV_TRIG_CTRL, HHEN, 31, 1)
+REG32(CGM_MUX_DIV_TRIG, 0x38)
+REG32(CGM_MUX_DIV_UPD_STAT, 0x3C)
+FIELD(CGM_MUX_DIV_UPD_STAT, DIV_STAT, 0, 1)
+
+#define MC_CGM_NUM_DC ((A_CGM_MUX_DIV_TRIG_CTRL - A_CGM_MUX_DC_0) / 4)
+#define MC_CGM_MUX_NUM_REGS (MC_CGM_MUX_STRIDE / 4)
+
+// Outcomes of a clock switch, in CSS[SWTRG]
+#define MC_CGM_SWTRG_SUCCEEDED 1
+#define MC_CGM_SWTRG_INACTIVE 2
+
+// Sources of the clock multiplexers, in CSC[SELCTL] and CSS[SELSTAT]
+#define MC_CGM_SEL_FIRC 0
+#define MC_CGM_SEL_SIRC 1
+#define MC_CGM_SEL_FXOSC 2
+#define MC_CGM_SEL_PLL_PHI0 8
+#define MC_CGM_SEL_PLL_PHI1 9
+
+// Dividers of MUX_0
+#define MC_CGM_DC_CORE 0
+#define MC_CGM_DC_AIPS_PLAT 1
+#define MC_CGM_DC_AIPS_SLOW 2
+
+// MC_ME registers
+REG32(MC_ME_CTL_KEY, 0x000)
+REG32(MC_ME_MODE_CONF, 0x004)
+REG32(MC_ME_MODE_UPD, 0x008)
+REG32(MC_ME_MODE_STAT, 0x00C)
+REG32(MC_ME_MAIN_COREID, 0x010)
+
+// Writing MC_ME_KEY then MC_ME_INVERTED_KEY to CTL_KEY applies the updates
+// requested in the PUPD registers
+#define MC_ME_KEY 0x5AF0
+#define MC_ME_INVERTED_KEY 0xA50F
+
+// Partitions, PRTNn registers at MC_ME_PRTN_ADDR(n)
+#define MC_ME_PRTN_BASE_ADDR 0x100
+#define MC_ME_PRTN_STRIDE 0x200
+#define MC_ME_NUM_PRTN 4
+static inline uint32_t MC_ME_PRTN_ADDR(int n) {
+    return MC_ME_PRTN_BASE_ADDR + MC_ME_PRTN_STRIDE * n;
+}
+
+// Offsets in the PRTNn registers
+REG32(ME_PRTN_PCONF, 0x00)
+FIELD(ME_PRTN_PCONF, PCE, 0, 1)
+REG32(ME_PRTN_PUPD, 0x04)
+FIELD(ME_PRTN_PUPD, PCUD, 0, 1)
+REG32(ME_PRTN_STAT, 0x08)
+FIELD(ME_PRTN_STAT, PCS, 0, 1)
+// COFBk_STAT: clocks running, one bit per peripheral (REQ input)
+REG32(ME_PRTN_COFB0_STAT, 0x10)
+// COFBk_CLKEN: clocks requested, applied to COFBk_STAT by the key sequence
+REG32(ME_PRTN_COFB0_CLKEN, 0x30)
+#define MC_ME_NUM_COFB 4
+#define MC_ME_COFB_SIZE (4 * MC_ME_NUM_COFB)
+
+// Cores of a partition, COREc registers at offset MC_ME_CORE_OFFSET(c)
+#define MC_ME_CORE_BASE_OFFSET 0x40
+#define MC_ME_CORE_STRIDE 0x20
+#define MC_ME_NUM_CORE 4
+static inline uint32_t MC_ME_CORE_OFFSET(int c) {
+    return MC_ME_CORE_BASE_OFFSET + MC_ME_CORE_STRIDE * c;
+}
+
+// Offsets in the COREc registers
+REG32(ME_CORE_PCONF, 0x00)
+FIELD(ME_CORE_PCONF, CCE, 0, 1)
+REG32(ME_CORE_PUPD, 0x04)
+FIELD(ME_CORE_PUPD, CCUPD, 0, 1)
+REG32(ME_CORE_STAT, 0x08)
+FIELD(ME_CORE_STAT, CCS, 0, 1)
+REG32(ME_CORE_ADDR, 0x0C)
+
+#define MC_ME_NUM_REGS \
+    ((MC_ME_PRTN_BASE_ADDR + MC_ME_PRTN_STRIDE * MC_ME_NUM_PRTN) / 4)
+
+// PLL registers
+REG32(PLL_PLLCR, 0x00)
+// PLLPD = 1 to power the PLL down
+FIELD(PLL_PLLCR, PLLPD, 31, 1)
+REG32(PLL_PLLSR, 0x04)
+FIELD(PLL_PLLSR, LOCK, 2, 1)
+REG32(PLL_PLLDV, 0x08)
+FIELD(PLL_PLLDV, MFI, 0, 8)
+FIELD(PLL_PLLDV, RDIV, 12, 3)
+FIELD(PLL_PLLDV, ODIV2, 25, 6)
+REG32(PLL_PLLFM, 0x0C)
+REG32(PLL_PLLFD, 0x10)
+FIELD(PLL_PLLFD, MFN, 0, 15)
+FIELD(PLL_PLLFD, SDMEN, 30, 1)
+REG32(PLL_PLLCAL2, 0x18)
+REG32(PLL_PLLCLKMUX, 0x20)
+// REFCLKSEL = 0 to run the PLL from FIRC, 1 from FXOSC
+FIELD(PLL_PLLCLKMUX, REFCLKSEL, 0, 1)
+// PLL_PHIn output, PLLODIV_n: the PLL output divided by DIV + 1, if DE = 1
+REG32(PLL_PLLODIV_0, 0x80)
+REG32(PLL_PLLODIV_1, 0x84)
+FIELD(PLL_PLLODIV, DIV, 16, 8)
+FIELD(PLL_PLLODIV, DE, 31, 1)
+
+#define PLL_NUM_REGS (R_PLL_PLLODIV_1 + 1)
+// Denominator of the fractional part of the loop divider, PLLFD[MFN]
+#define PLL_MFN_DEN 18432
+
+#define PLL_PLLCR_RESET 0x80000000
+
+// Peripheral clocks fed by the partitions
+#define MC_NUM_LPUART_CLKS 16
+
+#define TYPE_NXPS32K358_MC "nxps32k358-mc"
+OBJECT_DECLARE_SIMPLE_TYPE(NXPS32K358MCState, NXPS32K358_MC)
+
+/**
+ * @struct NXPS32K358MCState
+ * @brief Represents the state of the NXP S32K358 clock generation and mode
+ * entry.
+ *
+ * The device models the blocks that make up the clock tree: FXOSC, the PLL,
+ * the MC_CGM multiplexers and dividers, and the peripheral clock gates of
+ * the MC_ME partitions. Every register write that changes the tree computes
+ * the frequencies again and updates the output clocks, which propagate them
+ * to the cores and the peripherals.
+ *
+ * The tree resets as the hardware does, running from FIRC at 48MHz: the
+ * firmware switches it to the PLL (Clock_Ip_Init() in the NXP RTD). Clock
+ * switches, PLL lock and divider updates complete immediately.
+ *
+ * @note The progressive frequency switching (PCFS) and the clock monitors
+ * (CMU) are not modelled, the PCFS registers only store their value. The
+ * peripheral clock enables reset to 1, unlike the hardware, so that firmware
+ * that does not program MC_ME still finds its peripherals running.
+ *
+ * @var NXPS32K358MCState::parent_obj
+ * The parent system bus device.
+ *
+ * @var NXPS32K358MCState::fxosc_mmio
+ * Memory-mapped I/O region for the FXOSC registers.
+ *
+ * @var NXPS32K358MCState::cgm_mmio
+ * Memory-mapped I/O region for the MC_CGM registers.
+ *
+ * @var NXPS32K358MCState::me_mmio
+ * Memory-mapped I/O region for the MC_ME registers.
+ *
+ * @var NXPS32K358MCState::pll_mmio
+ * Memory-mapped I/O region for the PLL registers.
+ *
+ * @var NXPS32K358MCState::fxosc_ctrl
+ * FXOSC Control register.
+ *
+ * @var NXPS32K358MCState::cgm_pcfs
+ * MC_CGM registers below the multiplexers (PCFS), stored only.
+ *
+ * @var NXPS32K358MCState::cgm_mux
+ * MC_CGM MUX_n registers.
+ *
+ * @var NXPS32K358MCState::cgm_div
+ * Dividers of each multiplexer in effect: the DC_m registers, as they were
+ * when last applied.
+ *
+ * @var NXPS32K358MCState::me
+ * MC_ME registers.
+ *
+ * @var NXPS32K358MCState::pll
+ * PLL registers.
+ *
+ * @var NXPS32K358MCState::fxosc
+ * Input clock: the crystal of FXOSC.
+ *
+ * @var NXPS32K358MCState::core_clk
+ * Output clock: CORE_CLK, MUX_0 through DC_0, which runs the cores.
+ *
+ * @var NXPS32K358MCState::aips_plat_clk
+ * Output clock: AIPS_PLAT_CLK, MUX_0 through DC_1.
+ *
+ * @var NXPS32K358MCState::aips_slow_clk
+ * Output clock: AIPS_SLOW_CLK, MUX_0 through DC_2.
+ *
+ * @var NXPS32K358MCState::lpuart_clk
+ * Output clocks "lpuartN_clk": the AIPS clock of each LPUART, gated by its
+ * partition.
+ */
+struct NXPS32K358MCState {
+    SysBusDevice parent_obj;
+    MemoryRegion fxosc_mmio;
+    MemoryRegion cgm_mmio;
+    MemoryRegion me_mmio;
+    MemoryRegion pll_mmio;
+
+    uint32_t fxosc_ctrl;
+    uint32_t cgm_pcfs[MC_CGM_MUX_BASE_ADDR / 4];
+    uint32_t cgm_mux[MC_CGM_NUM_MUX][MC_CGM_MUX_NUM_REGS];
+    uint32_t cgm_div[MC_CGM_NUM_MUX][MC_CGM_NUM_DC];
+    uint32_t me[MC_ME_NUM_REGS];
+    uint32_t pll[PLL_NUM_REGS];
+
+    Clock *fxosc;
+    Clock *core_clk;
+    Clock *aips_plat_clk;
+    Clock *aips_slow_clk;
+    Clock *lpuart_clk[MC_NUM_LPUART_CLKS];
+};
+
+#endif
@@ -3697,6 +3697,8 @@ DEF("chardev", HAS_ARG, QEMU_OPTION_chardev,
     "-chardev serial,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
 #else
     "-chardev pty,id=id[,path=path][,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
+    "-chardev shmring,id=id,path=path[,size=size][,watermark=count][,mux=on|off]\n"
+    "         [,logfile=PATH][,logappend=on|off]\n"
     "-chardev stdio,id=id[,mux=on|off][,signal=on|off][,logfile=PATH][,logappend=on|off]\n"
 #endif
 #ifdef CONFIG_BRLAPI
@@ -3722,7 +3724,7 @@ The general form of a character device option is:
 ``-chardev backend,id=id[,mux=on|off][,options]``
     Backend is one of: ``null``, ``socket``, ``udp``, ``msmouse``,
     ``vc``, ``ringbuf``, ``file``, ``pipe``, ``console``, ``serial``,
-    ``pty``, ``stdio``, ``braille``, ``parallel``,
+    ``pty``, ``shmring``, ``stdio``, ``braille``, ``parallel``,
     ``spicevmc``, ``spiceport``. The specific backend will determine the
     applicable options.
 
@@ -3893,6 +3895,25 @@ The available backends are:
     Create a ring buffer with fixed size ``size``. size must be a power
     of two and defaults to ``64K``.
 
+``-chardev shmring,id=id,path=path[,size=size][,watermark=count]``
+    Create a pair of single-producer/single-consumer ring buffers in a
+    memfd, one per direction, that a local process can map and drive
+    without system calls. ``shmring`` is only available on POSIX hosts.
+
+    ``path`` is a unix socket on which QEMU listens; every client that
+    connects receives the memfd and two eventfds (one to wait on, one
+    to signal QEMU) as ``SCM_RIGHTS`` ancillary data. The layout of the
+    shared area is described in ``chardev/char-shmring.c``.
+
+    ``size`` is the size of each direction; it must be a power of two
+    and defaults to ``64K``.
+
+    ``watermark`` is the number of bytes of data (or of free space, for
+    flow control) that must be available before QEMU wakes up a
+    sleeping client through its eventfd. It defaults to ``1``, i.e.
+    every wakeup is delivered. The client always wakes up QEMU as soon
+    as data or space is available.
+
 ``-chardev file,id=id,path=path[,input-path=input-path]``
     Log all traffic received from the guest to a file.
 
@@ -4322,6 +4343,11 @@ SRST
         startup errors. It is recommended that the user checks and
         removes the symlink after QEMU terminates to account for this.
 
+    ``shmring:path``
+        [POSIX only] Shared-memory ring buffer handed out to local
+        processes through the unix socket ``path``; see
+        ``-chardev shmring``.
+
     ``none``
         No device is allocated. Note that for machine types which
         emulate systems where a serial device is always present in
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+#
+# NXPS32K358 flash image builder
+#
+# Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+"""
+Build the code and data flash images of the nxps32k3x8evb machine from an ELF
+file, once, so that each QEMU instance maps them instead of loading the ELF:
+
+    nxps32k358-flash-image.py firmware.elf code.img data.img
+
+    qemu-system-arm -M nxps32k3x8evb,code-flash=cf,data-flash=df \\
+        -object memory-backend-file,id=cf,mem-path=code.img,size=8M,\\
+    share=off,readonly=on,rom=off \\
+        -object memory-backend-file,id=df,mem-path=data.img,size=128K,\\
+    share=off,readonly=on,rom=off ...
+
+The images are mapped copy-on-write (share=off): instances running the same
+image share its pages, and writes never reach the files.
+
+Every loadable segment is placed at its physical (load) address, which must
+fall in the code or the data flash. Unused flash reads as erased (0xFF).
+"""
+
+import argparse
+import struct
+import sys
+
+# Keep in sync with include/hw/arm/nxps32k358_soc.h
+CODE_FLASH_BASE_ADDRESS = 0x00400000
+CODE_FLASH_SIZE = 4 * 2 * 1024 * 1024
+DATA_FLASH_BASE_ADDRESS = 0x10000000
+DATA_FLASH_SIZE = 128 * 1024
+
+PT_LOAD = 1
+
+
+def load_segments(path):
+    """Return the (address, data) pairs of the loadable segments of an ELF."""
+    with open(path, 'rb') as f:
+        elf = f.read()
+
+    if elf[:4] != b'\x7fELF' or elf[4] != 1 or elf[5] != 1:
+        raise ValueError(f'{path}: not a 32-bit little-endian ELF file')
+
+    e_phoff, = struct.unpack_from('<I', elf, 28)
+    e_phentsize, e_phnum = struct.unpack_from('<HH', elf, 42)
+
+    segments = []
+    for i in range(e_phnum):
+        (p_type, p_offset, _, p_paddr,
+         p_filesz, _, _, _) = struct.unpack_from('<8I', elf,
+                                                 e_phoff + i * e_phentsize)
+        if p_type == PT_LOAD and p_filesz:
+            segments.append((p_paddr, elf[p_offset:p_offset + p_filesz]))
+    return segments
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Build nxps32k3x8evb flash images from an ELF file.')
+    parser.add_argument('elf', help='firmware ELF file')
+    parser.add_argument('code', help='code flash image to write')
+    parser.add_argument('data', nargs='?', help='data flash image to write')
+    parser.add_argument('--fill', type=lambda x: int(x, 0), default=0xFF,
+                        help='value of the unused bytes (default: 0xFF)')
+    args = parser.parse_args()
+
+    flashes = [
+        (CODE_FLASH_BASE_ADDRESS, bytearray([args.fill]) * CODE_FLASH_SIZE,
+         args.code),
+        (DATA_FLASH_BASE_ADDRESS, bytearray([args.fill]) * DATA_FLASH_SIZE,
+         args.data),
+    ]
+
+    try:
+        segments = load_segments(args.elf)
+    except (OSError, ValueError, struct.error) as e:
+        sys.exit(f'error: {e}')
+
+    for addr, data in segments:
+        for base, image, path in flashes:
+            if base <= addr and addr + len(data) <= base + len(image):
+                if path is None:
+                    sys.exit(f'error: segment at 0x{addr:08x} is in the data '
+                             'flash, but no data flash image was given')
+                image[addr - base:addr - base + len(data)] = data
+                break
+        else:
+            sys.exit(f'error: segment at 0x{addr:08x} ({len(data)} bytes) is '
+                     'outside the flash; load this ELF with -kernel instead')
+
+    for _, image, path in flashes:
+        if path is not None:
+            with open(path, 'wb') as f:
+                f.write(image)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,535 @@
+/*
+ * QTest testcase for the NXP S32K358 eDMA engine (on the NXPS32K3X8EVB board)
+ * and its interrupts coming to the NVIC.
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The functional tests run with the engine in instant mode, plus one test
+ * checking the timing of the default (timed) mode.
+ *
+ * Running the test with "-m perf" also registers the benchmarks, which print
+ * one line per configuration in the form:
+ *
+ *   # nxps32k358-edma-bench test=<name> size=<bytes> iterations=<n>
+ *     host_ns_per_mb=<ns> device_ns_per_mb=<ns> host_ns_per_irq=<ns>
+ *
+ * (on a single line). host_ns_* is the wall clock time seen by the test,
+ * including the qtest protocol overhead; device_ns_per_mb is the time spent
+ * by the device moving data, as reported by its stats-host-time counters.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "qapi/qmp/qnum.h"
+
+#define MACHINE_ARGS "-machine nxps32k3x8evb"
+#define INSTANT_ARGS MACHINE_ARGS " -global nxps32k358-edma.instant=on"
+
+#define NVIC_PATH  "/machine/s32k/cluster[0]/armv7m"
+#define EDMA_PATH  "/machine/s32k/edma"
+
+/* Offsets in the S32K358 memory map: */
+#define EDMA_BASE       0x4020c000
+#define EDMA_TCD12_BASE 0x40410000
+#define SRAM_BASE       0x20400000
+
+/* Global registers: */
+#define EDMA_CSR        0x00
+#define EDMA_CSR_HAE    (1u << 4)
+#define EDMA_CSR_HALT   (1u << 5)
+#define EDMA_ES         0x04
+#define EDMA_ES_ERRCHN(n) ((n) << 24)
+#define EDMA_ES_VLD     (1u << 31)
+
+/* Channel and TCD registers: */
+#define CH_CSR          0x00
+#define CH_CSR_EEI      (1u << 2)
+#define CH_CSR_DONE     (1u << 30)
+#define CH_ES           0x04
+#define CH_ES_DBE       (1u << 0)
+#define CH_ES_SBE       (1u << 1)
+#define CH_ES_NCE       (1u << 3)
+#define CH_ES_SAE       (1u << 7)
+#define CH_ES_ERR       (1u << 31)
+#define CH_INT          0x08
+#define TCD_SADDR       0x20
+#define TCD_SOFF        0x24
+#define TCD_ATTR        0x26
+#define TCD_NBYTES      0x28
+#define TCD_SLAST_SDA   0x2c
+#define TCD_DADDR       0x30
+#define TCD_DOFF        0x34
+#define TCD_CITER       0x36
+#define TCD_DLAST_SGA   0x38
+#define TCD_CSR         0x3c
+#define TCD_BITER       0x3e
+
+#define TCD_IMAGE_SIZE  0x20
+
+/* TCD fields: */
+#define ATTR_32BIT      0x0202 /* SSIZE = DSIZE = 4 bytes */
+#define ITER_ELINK      (1 << 15)
+#define ITER_LINKCH(n)  ((n) << 9)
+#define CSR_START       (1 << 0)
+#define CSR_INTMAJOR    (1 << 1)
+#define CSR_ESG         (1 << 4)
+#define CSR_MAJORELINK  (1 << 5)
+#define CSR_MAJORLINKCH(n) ((n) << 8)
+
+/* Data for the test: */
+#define SRC_ADDR        (SRAM_BASE)
+#define DST_ADDR        (SRAM_BASE + 0x40000)
+#define DESC_ADDR       (SRAM_BASE + 0x80000)
+#define MAX_LEN         0x10000
+#define SG_DESCS        64
+#define UNMAPPED_ADDR   0x60000000
+
+/* Polling bound while waiting for a transfer to complete */
+#define MAX_POLLS       100000
+
+static inline uint32_t edma_irq(int ch)
+{
+    return 4 + ch;
+}
+
+static uint64_t tcd_base(int ch)
+{
+    if (ch < 12) {
+        return EDMA_BASE + 0x4000 * (ch + 1);
+    }
+    return EDMA_TCD12_BASE + 0x4000 * (ch - 12);
+}
+
+static QTestState *edma_init(const char *args)
+{
+    QTestState *qts = qtest_init(args);
+
+    qtest_irq_intercept_in(qts, NVIC_PATH);
+    return qts;
+}
+
+/* Fill the source buffer with a pattern and clear the destination buffer */
+static void fill_buffers(QTestState *qts, uint32_t len, uint8_t seed)
+{
+    g_autofree uint8_t *buf = g_malloc(len);
+
+    for (uint32_t i = 0; i < len; i++) {
+        buf[i] = seed + i * 7 + (i >> 8);
+    }
+    qtest_memwrite(qts, SRC_ADDR, buf, len);
+    qtest_memset(qts, DST_ADDR, 0, len);
+}
+
+static void check_copy(QTestState *qts, uint64_t dst, uint64_t src,
+                       uint32_t len)
+{
+    g_autofree uint8_t *s = g_malloc(len);
+    g_autofree uint8_t *d = g_malloc(len);
+
+    qtest_memread(qts, src, s, len);
+    qtest_memread(qts, dst, d, len);
+    g_assert(memcmp(s, d, len) == 0);
+}
+
+/* Program a channel with a single descriptor through its registers */
+static void tcd_write(QTestState *qts, int ch, uint32_t saddr, int16_t soff,
+                      uint32_t nbytes, uint32_t daddr, int16_t doff,
+                      uint16_t iter, uint32_t dlast_sga, uint16_t csr)
+{
+    uint64_t base = tcd_base(ch);
+
+    /* DONE is write 1 to clear, so that wait_done() sees this transfer only */
+    qtest_writel(qts, base + CH_CSR, CH_CSR_DONE);
+    qtest_writel(qts, base + TCD_SADDR, saddr);
+    qtest_writew(qts, base + TCD_SOFF, soff);
+    qtest_writew(qts, base + TCD_ATTR, ATTR_32BIT);
+    qtest_writel(qts, base + TCD_NBYTES, nbytes);
+    qtest_writel(qts, base + TCD_SLAST_SDA, 0);
+    qtest_writel(qts, base + TCD_DADDR, daddr);
+    qtest_writew(qts, base + TCD_DOFF, doff);
+    qtest_writew(qts, base + TCD_BITER, iter);
+    qtest_writew(qts, base + TCD_CITER, iter);
+    qtest_writel(qts, base + TCD_DLAST_SGA, dlast_sga);
+    /* Writing TCD_CSR last, START kicks off the transfer */
+    qtest_writew(qts, base + TCD_CSR, csr);
+}
+
+/* Write a TCD image in memory, for scatter-gather */
+static void tcd_image_write(QTestState *qts, uint64_t addr, uint32_t saddr,
+                            uint32_t nbytes, uint32_t daddr,
+                            uint32_t dlast_sga, uint16_t csr)
+{
+    uint8_t image[TCD_IMAGE_SIZE] = { 0 };
+
+    stl_le_p(image + TCD_SADDR - TCD_SADDR, saddr);
+    stw_le_p(image + TCD_SOFF - TCD_SADDR, 4);
+    stw_le_p(image + TCD_ATTR - TCD_SADDR, ATTR_32BIT);
+    stl_le_p(image + TCD_NBYTES - TCD_SADDR, nbytes);
+    stl_le_p(image + TCD_DADDR - TCD_SADDR, daddr);
+    stw_le_p(image + TCD_DOFF - TCD_SADDR, 4);
+    stw_le_p(image + TCD_CITER - TCD_SADDR, 1);
+    stl_le_p(image + TCD_DLAST_SGA - TCD_SADDR, dlast_sga);
+    stw_le_p(image + TCD_CSR - TCD_SADDR, csr);
+    stw_le_p(image + TCD_BITER - TCD_SADDR, 1);
+    qtest_memwrite(qts, addr, image, sizeof(image));
+}
+
+/*
+ * Wait for the DONE flag of a channel. In instant mode the engine runs in a
+ * bottom half, so the transfer may complete a few commands later.
+ */
+static void wait_done(QTestState *qts, int ch)
+{
+    for (int i = 0; i < MAX_POLLS; i++) {
+        if (qtest_readl(qts, tcd_base(ch) + CH_CSR) & CH_CSR_DONE) {
+            return;
+        }
+    }
+    g_assert_not_reached();
+}
+
+static void check_and_clear_irq(QTestState *qts, int ch)
+{
+    g_assert_true(qtest_get_irq(qts, edma_irq(ch)));
+    qtest_writel(qts, tcd_base(ch) + CH_INT, 1);
+    g_assert_false(qtest_get_irq(qts, edma_irq(ch)));
+}
+
+/* Run a whole memcpy on a channel: one minor loop of len bytes */
+static void do_memcpy(QTestState *qts, int ch, uint32_t len)
+{
+    tcd_write(qts, ch, SRC_ADDR, 4, len, DST_ADDR, 4, 1, 0,
+              CSR_START | CSR_INTMAJOR);
+    wait_done(qts, ch);
+}
+
+static void test_memcpy(void)
+{
+    static const uint32_t sizes[] = { 4, 64, 1024, 16384, MAX_LEN };
+    QTestState *qts = edma_init(INSTANT_ARGS);
+
+    /* Interrupts are silent by default */
+    g_assert_false(qtest_get_irq(qts, edma_irq(0)));
+
+    for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+        int ch = i * 7 % 32;
+
+        fill_buffers(qts, sizes[i], i);
+        do_memcpy(qts, ch, sizes[i]);
+        check_copy(qts, DST_ADDR, SRC_ADDR, sizes[i]);
+        check_and_clear_irq(qts, ch);
+    }
+
+    qtest_quit(qts);
+}
+
+static void test_strided(void)
+{
+    QTestState *qts = edma_init(INSTANT_ARGS);
+    const uint32_t words = 256;
+
+    fill_buffers(qts, words * 8, 3);
+
+    /* Gather every other word of the source */
+    tcd_write(qts, 1, SRC_ADDR, 8, words * 4, DST_ADDR, 4, 1, 0,
+              CSR_START | CSR_INTMAJOR);
+    wait_done(qts, 1);
+
+    for (uint32_t i = 0; i < words; i++) {
+        g_assert_cmphex(qtest_readl(qts, DST_ADDR + 4 * i), ==,
+                        qtest_readl(qts, SRC_ADDR + 8 * i));
+    }
+    check_and_clear_irq(qts, 1);
+
+    /* Scatter to every fourth word of the destination, across 4 minor loops */
+    qtest_memset(qts, DST_ADDR, 0, words * 16);
+    tcd_write(qts, 13, SRC_ADDR, 4, words, DST_ADDR, 16, 4 | ITER_ELINK |
+              ITER_LINKCH(13), 0, CSR_START | CSR_INTMAJOR);
+    wait_done(qts, 13);
+
+    for (uint32_t i = 0; i < words; i++) {
+        g_assert_cmphex(qtest_readl(qts, DST_ADDR + 16 * i), ==,
+                        qtest_readl(qts, SRC_ADDR + 4 * i));
+        g_assert_cmphex(qtest_readl(qts, DST_ADDR + 16 * i + 4), ==, 0);
+    }
+    check_and_clear_irq(qts, 13);
+
+    qtest_quit(qts);
+}
+
+/* Build a chain of descriptors, each copying a chunk of len / descs bytes */
+static void build_sg_chain(QTestState *qts, uint32_t len, int descs)
+{
+    uint32_t chunk = len / descs;
+
+    for (int i = 0; i < descs; i++) {
+        uint64_t addr = DESC_ADDR + i * TCD_IMAGE_SIZE;
+        bool last = i == descs - 1;
+
+        /* Each loaded descriptor starts itself */
+        tcd_image_write(qts, addr, SRC_ADDR + i * chunk, chunk,
+                        DST_ADDR + i * chunk,
+                        last ? 0 : addr + TCD_IMAGE_SIZE,
+                        CSR_START | (last ? CSR_INTMAJOR : CSR_ESG));
+    }
+}
+
+static void do_sg(QTestState *qts, int ch, uint32_t len, int descs)
+{
+    build_sg_chain(qts, len, descs);
+    /* The first descriptor only loads the chain */
+    tcd_write(qts, ch, SRC_ADDR, 4, 0, DST_ADDR, 4, 1, DESC_ADDR,
+              CSR_START | CSR_ESG);
+    wait_done(qts, ch);
+    for (int i = 0; i < MAX_POLLS; i++) {
+        if (qtest_get_irq(qts, edma_irq(ch))) {
+            return;
+        }
+        qtest_readl(qts, tcd_base(ch) + CH_CSR);
+    }
+    g_assert_not_reached();
+}
+
+static void test_scatter_gather(void)
+{
+    QTestState *qts = edma_init(INSTANT_ARGS);
+    const uint32_t len = 4096;
+
+    fill_buffers(qts, len, 5);
+    do_sg(qts, 2, len, SG_DESCS);
+    check_copy(qts, DST_ADDR, SRC_ADDR, len);
+    check_and_clear_irq(qts, 2);
+
+    qtest_quit(qts);
+}
+
+static void test_linked(void)
+{
+    QTestState *qts = edma_init(INSTANT_ARGS);
+    const uint32_t len = 1024;
+
+    fill_buffers(qts, len, 9);
+
+    /*
+     * Channel 4 links to itself on every minor loop, so a single START runs
+     * its whole major loop (the first half of the buffer), then its major
+     * loop links to channel 20, which copies the second half.
+     */
+    tcd_write(qts, 20, SRC_ADDR + len / 2, 4, len / 2, DST_ADDR + len / 2, 4,
+              1, 0, CSR_INTMAJOR);
+    tcd_write(qts, 4, SRC_ADDR, 4, len / 8, DST_ADDR, 4,
+              4 | ITER_ELINK | ITER_LINKCH(4), 0,
+              CSR_START | CSR_MAJORELINK | CSR_MAJORLINKCH(20));
+    wait_done(qts, 20);
+
+    check_copy(qts, DST_ADDR, SRC_ADDR, len);
+    g_assert_false(qtest_get_irq(qts, edma_irq(4)));
+    check_and_clear_irq(qts, 20);
+
+    qtest_quit(qts);
+}
+
+static void test_timed(void)
+{
+    QTestState *qts = edma_init(MACHINE_ARGS);
+    const uint32_t len = 1024;
+
+    fill_buffers(qts, len, 11);
+    tcd_write(qts, 0, SRC_ADDR, 4, len, DST_ADDR, 4, 1, 0,
+              CSR_START | CSR_INTMAJOR);
+
+    /* Virtual time does not advance under qtest until the test steps it */
+    g_assert_false(qtest_readl(qts, tcd_base(0) + CH_CSR) & CH_CSR_DONE);
+    g_assert_false(qtest_get_irq(qts, edma_irq(0)));
+
+    qtest_clock_step(qts, 100 * 1000);
+    g_assert_true(qtest_readl(qts, tcd_base(0) + CH_CSR) & CH_CSR_DONE);
+    check_copy(qts, DST_ADDR, SRC_ADDR, len);
+    check_and_clear_irq(qts, 0);
+
+    qtest_quit(qts);
+}
+
+/* Wait for a channel to record an error, and return its error status */
+static uint32_t wait_error(QTestState *qts, int ch)
+{
+    for (int i = 0; i < MAX_POLLS; i++) {
+        uint32_t es = qtest_readl(qts, tcd_base(ch) + CH_ES);
+
+        if (es & CH_ES_ERR) {
+            return es;
+        }
+    }
+    g_assert_not_reached();
+}
+
+static void test_errors(void)
+{
+    QTestState *qts = edma_init(INSTANT_ARGS);
+    const uint32_t len = 64;
+    uint32_t csr;
+
+    fill_buffers(qts, len, 13);
+
+    /* A misaligned source address is a configuration error: nothing moves */
+    tcd_write(qts, 3, SRC_ADDR + 2, 4, len, DST_ADDR, 4, 1, 0,
+              CSR_START | CSR_INTMAJOR);
+    qtest_writel(qts, tcd_base(3) + CH_CSR, CH_CSR_EEI);
+    g_assert_cmphex(wait_error(qts, 3), ==, CH_ES_ERR | CH_ES_SAE);
+    g_assert_cmphex(qtest_readl(qts, EDMA_BASE + EDMA_ES), ==,
+                    EDMA_ES_VLD | EDMA_ES_ERRCHN(3) | CH_ES_SAE);
+    g_assert_false(qtest_readl(qts, tcd_base(3) + CH_CSR) & CH_CSR_DONE);
+    g_assert_cmphex(qtest_readl(qts, DST_ADDR), ==, 0);
+
+    /* The error interrupt stays up until ERR is cleared */
+    g_assert_true(qtest_get_irq(qts, edma_irq(3)));
+    qtest_writel(qts, tcd_base(3) + CH_ES, CH_ES_ERR);
+    g_assert_cmphex(qtest_readl(qts, tcd_base(3) + CH_ES), ==, 0);
+    g_assert_false(qtest_readl(qts, EDMA_BASE + EDMA_ES) & EDMA_ES_VLD);
+    g_assert_false(qtest_get_irq(qts, edma_irq(3)));
+
+    /* Bus errors, without error interrupt */
+    tcd_write(qts, 7, UNMAPPED_ADDR, 4, len, DST_ADDR, 4, 1, 0, CSR_START);
+    g_assert_cmphex(wait_error(qts, 7), ==, CH_ES_ERR | CH_ES_SBE);
+    tcd_write(qts, 8, SRC_ADDR, 4, len, UNMAPPED_ADDR, 4, 1, 0, CSR_START);
+    g_assert_cmphex(wait_error(qts, 8), ==, CH_ES_ERR | CH_ES_DBE);
+    g_assert_cmphex(qtest_readl(qts, EDMA_BASE + EDMA_ES), ==,
+                    EDMA_ES_VLD | EDMA_ES_ERRCHN(8) | CH_ES_DBE);
+    g_assert_false(qtest_get_irq(qts, edma_irq(7)));
+    g_assert_false(qtest_get_irq(qts, edma_irq(8)));
+
+    /* With HAE, an error halts the engine until the guest clears HALT */
+    csr = qtest_readl(qts, EDMA_BASE + EDMA_CSR);
+    qtest_writel(qts, EDMA_BASE + EDMA_CSR, csr | EDMA_CSR_HAE);
+    tcd_write(qts, 5, SRC_ADDR, 4, len - 2, DST_ADDR, 4, 1, 0, CSR_START);
+    g_assert_cmphex(wait_error(qts, 5), ==, CH_ES_ERR | CH_ES_NCE);
+    csr = qtest_readl(qts, EDMA_BASE + EDMA_CSR);
+    g_assert_true(csr & EDMA_CSR_HALT);
+
+    tcd_write(qts, 6, SRC_ADDR, 4, len, DST_ADDR, 4, 1, 0,
+              CSR_START | CSR_INTMAJOR);
+    for (int i = 0; i < 100; i++) {
+        g_assert_false(qtest_readl(qts, tcd_base(6) + CH_CSR) & CH_CSR_DONE);
+    }
+    qtest_writel(qts, EDMA_BASE + EDMA_CSR, csr & ~EDMA_CSR_HALT);
+    wait_done(qts, 6);
+    check_copy(qts, DST_ADDR, SRC_ADDR, len);
+    check_and_clear_irq(qts, 6);
+
+    qtest_quit(qts);
+}
+
+/* Sum of the device-side host time spent in every channel, in ns */
+static uint64_t device_host_ns(QTestState *qts)
+{
+    QDict *rsp = qtest_qmp(qts, "{ 'execute': 'qom-get', 'arguments': "
+                           "{ 'path': " "'" EDMA_PATH "', "
+                           "'property': 'stats-host-time' } }");
+    QList *list;
+    QListEntry *entry;
+    uint64_t sum = 0;
+
+    g_assert(qdict_haskey(rsp, "return"));
+    list = qdict_get_qlist(rsp, "return");
+    QLIST_FOREACH_ENTRY(list, entry) {
+        sum += qnum_get_uint(qobject_to(QNum, qlist_entry_obj(entry)));
+    }
+    qobject_unref(rsp);
+
+    return sum;
+}
+
+typedef void BenchFunc(QTestState *qts, int ch, uint32_t len);
+
+static void bench_sg(QTestState *qts, int ch, uint32_t len)
+{
+    do_sg(qts, ch, len, MIN(SG_DESCS, len / 4));
+}
+
+static void bench(const char *name, BenchFunc *fn, uint32_t len, int iters)
+{
+    QTestState *qts = edma_init(INSTANT_ARGS);
+    int64_t start;
+    int64_t elapsed;
+    uint64_t dev_ns;
+
+    fill_buffers(qts, len, 1);
+    dev_ns = device_host_ns(qts);
+    start = g_get_monotonic_time();
+    for (int i = 0; i < iters; i++) {
+        fn(qts, 0, len);
+        /* Clearing the interrupt is part of the measured round trip */
+        qtest_writel(qts, tcd_base(0) + CH_INT, 1);
+    }
+    elapsed = (g_get_monotonic_time() - start) * 1000;
+    dev_ns = device_host_ns(qts) - dev_ns;
+    check_copy(qts, DST_ADDR, SRC_ADDR, len);
+
+    g_test_message("nxps32k358-edma-bench test=%s size=%" PRIu32
+                   " iterations=%d host_ns_per_mb=%" PRIu64
+                   " device_ns_per_mb=%" PRIu64 " host_ns_per_irq=%" PRIu64,
+                   name, len, iters,
+                   (uint64_t)elapsed * MiB / ((uint64_t)len * iters),
+                   dev_ns * MiB / ((uint64_t)len * iters),
+                   (uint64_t)elapsed / iters);
+
+    qtest_quit(qts);
+}
+
+static void bench_memcpy(void)
+{
+    bench("memcpy", do_memcpy, 64, 1000);
+    bench("memcpy", do_memcpy, 1024, 1000);
+    bench("memcpy", do_memcpy, 16384, 200);
+    bench("memcpy", do_memcpy, MAX_LEN, 100);
+}
+
+static void bench_scatter_gather(void)
+{
+    bench("sg", bench_sg, 1024, 200);
+    bench("sg", bench_sg, 16384, 100);
+    bench("sg", bench_sg, MAX_LEN, 50);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/nxps32k358/edma/memcpy", test_memcpy);
+    qtest_add_func("/nxps32k358/edma/strided", test_strided);
+    qtest_add_func("/nxps32k358/edma/scatter_gather", test_scatter_gather);
+    qtest_add_func("/nxps32k358/edma/linked", test_linked);
+    qtest_add_func("/nxps32k358/edma/timed", test_timed);
+    qtest_add_func("/nxps32k358/edma/errors", test_errors);
+    if (g_test_perf()) {
+        qtest_add_func("/nxps32k358/edma/bench/memcpy", bench_memcpy);
+        qtest_add_func("/nxps32k358/edma/bench/scatter_gather",
+                       bench_scatter_gather);
+    }
+
+    return g_test_run();
+}
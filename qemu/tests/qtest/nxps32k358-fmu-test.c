@@ -0,0 +1,344 @@
+/*
+ * QTest testcase for the NXP S32K358 FMU (on the NXPS32K3X8EVB board)
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The tests drive the C40 sequence of the FMU registers directly: select PGM
+ * or ERS in MCR, write PEADR (and the DATA registers), set MCR[EHV] and check
+ * MCRS[DONE] and MCRS[PEG]. The FMU runs in instant mode, except for the test
+ * of the timed mode.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+
+#define MACHINE_ARGS "-machine nxps32k3x8evb"
+#define TIMED_ARGS MACHINE_ARGS " -global nxps32k358-fmu.timed=on"
+
+/* Offsets in the S32K358 memory map: */
+#define CODE_FLASH_BASE 0x00400000
+#define CODE_BLOCK_SIZE (2 * MiB)
+#define DATA_FLASH_BASE 0x10000000
+#define DATA_FLASH_SIZE (128 * KiB)
+#define FMU_BASE        0x402ec000
+
+/* Registers: */
+#define FMU_MCR         0x000
+#define MCR_EHV         (1u << 0)
+#define MCR_ERS         (1u << 4)
+#define MCR_ESS         (1u << 5)
+#define MCR_PGM         (1u << 8)
+#define FMU_MCRS        0x004
+#define MCRS_PEG        (1u << 14)
+#define MCRS_DONE       (1u << 15)
+#define FMU_PEADR       0x014
+#define FMU_DATA(n)     (0x100 + 4 * (n))
+
+/* Flash geometry: */
+#define PAGE_SIZE       128
+#define SECTOR_SIZE     (8 * KiB)
+
+/* Modelled durations of the operations: */
+#define PROGRAM_NS      (100 * 1000)
+#define SECTOR_ERASE_NS (8 * 1000 * 1000)
+
+#define ERASED          0xffffffffu
+
+static uint32_t fmu_readl(QTestState *qts, uint32_t reg)
+{
+    return qtest_readl(qts, FMU_BASE + reg);
+}
+
+static void fmu_writel(QTestState *qts, uint32_t reg, uint32_t val)
+{
+    qtest_writel(qts, FMU_BASE + reg, val);
+}
+
+/* Stage a program operation of one word, without starting it */
+static void fmu_stage_program(QTestState *qts, uint32_t addr, uint32_t val)
+{
+    fmu_writel(qts, FMU_MCR, MCR_PGM);
+    fmu_writel(qts, FMU_PEADR, addr);
+    fmu_writel(qts, FMU_DATA((addr % PAGE_SIZE) / 4), val);
+}
+
+/* Set EHV, return MCRS once the operation is over and clear EHV again */
+static uint32_t fmu_run(QTestState *qts)
+{
+    uint32_t mcr = fmu_readl(qts, FMU_MCR);
+    uint32_t mcrs;
+
+    fmu_writel(qts, FMU_MCR, mcr | MCR_EHV);
+    mcrs = fmu_readl(qts, FMU_MCRS);
+    fmu_writel(qts, FMU_MCR, mcr);
+    fmu_writel(qts, FMU_MCR, 0);
+    return mcrs;
+}
+
+static uint32_t fmu_program(QTestState *qts, uint32_t addr, uint32_t val)
+{
+    fmu_stage_program(qts, addr, val);
+    return fmu_run(qts);
+}
+
+static uint32_t fmu_erase(QTestState *qts, uint32_t addr, bool block)
+{
+    fmu_writel(qts, FMU_MCR, MCR_ERS | (block ? MCR_ESS : 0));
+    fmu_writel(qts, FMU_PEADR, addr);
+    return fmu_run(qts);
+}
+
+static void test_program(void)
+{
+    QTestState *qts = qtest_init(MACHINE_ARGS);
+    uint32_t addr = DATA_FLASH_BASE + 0x10;
+
+    /* The data flash starts erased */
+    g_assert_cmphex(qtest_readl(qts, addr), ==, ERASED);
+
+    g_assert_cmphex(fmu_program(qts, addr, 0x12345678), ==,
+                    MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, addr), ==, 0x12345678);
+
+    /* Programming only clears bits */
+    g_assert_cmphex(fmu_program(qts, addr, 0xffff00ff), ==,
+                    MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, addr), ==, 0x12340078);
+
+    /* Only the DATA registers written are programmed */
+    g_assert_cmphex(qtest_readl(qts, addr - 4), ==, ERASED);
+    g_assert_cmphex(qtest_readl(qts, addr + 4), ==, ERASED);
+
+    /* Without any DATA register written, nothing is programmed */
+    fmu_writel(qts, FMU_MCR, MCR_PGM);
+    fmu_writel(qts, FMU_PEADR, addr + 4);
+    g_assert_cmphex(fmu_run(qts), ==, MCRS_DONE);
+
+    /* A program operation outside the flashes fails */
+    g_assert_cmphex(fmu_program(qts, 0x20400000, 0), ==, MCRS_DONE);
+
+    /* The code flash is programmed the same way */
+    g_assert_cmphex(fmu_erase(qts, CODE_FLASH_BASE, false), ==,
+                    MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(fmu_program(qts, CODE_FLASH_BASE + 0x80, 0xcafef00d), ==,
+                    MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, CODE_FLASH_BASE + 0x80), ==, 0xcafef00d);
+
+    qtest_quit(qts);
+}
+
+static void test_erase(void)
+{
+    QTestState *qts = qtest_init(MACHINE_ARGS);
+    uint32_t block1 = CODE_FLASH_BASE + CODE_BLOCK_SIZE;
+
+    fmu_program(qts, DATA_FLASH_BASE, 0);
+    fmu_program(qts, DATA_FLASH_BASE + SECTOR_SIZE, 0);
+    fmu_program(qts, DATA_FLASH_BASE + DATA_FLASH_SIZE - 4, 0);
+
+    /* A sector erase clears the sector containing PEADR only */
+    g_assert_cmphex(fmu_erase(qts, DATA_FLASH_BASE + 0x44, false), ==,
+                    MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, DATA_FLASH_BASE), ==, ERASED);
+    g_assert_cmphex(qtest_readl(qts, DATA_FLASH_BASE + SECTOR_SIZE), ==, 0);
+
+    /* With ESS the whole block is erased: the data flash is a single one */
+    g_assert_cmphex(fmu_erase(qts, DATA_FLASH_BASE + SECTOR_SIZE, true), ==,
+                    MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, DATA_FLASH_BASE + SECTOR_SIZE), ==,
+                    ERASED);
+    g_assert_cmphex(qtest_readl(qts, DATA_FLASH_BASE + DATA_FLASH_SIZE - 4),
+                    ==, ERASED);
+
+    /* A code flash block erase stops at the block boundaries */
+    g_assert_cmphex(fmu_erase(qts, block1 + 0x1234, true), ==,
+                    MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, block1), ==, ERASED);
+    g_assert_cmphex(qtest_readl(qts, block1 + CODE_BLOCK_SIZE - 4), ==,
+                    ERASED);
+    g_assert_cmphex(qtest_readl(qts, block1 - 4), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, block1 + CODE_BLOCK_SIZE), ==, 0);
+
+    /* EHV without exactly one of PGM and ERS starts nothing */
+    fmu_writel(qts, FMU_MCR, MCR_PGM | MCR_ERS);
+    fmu_writel(qts, FMU_PEADR, DATA_FLASH_BASE);
+    g_assert_cmphex(fmu_run(qts), ==, MCRS_DONE);
+
+    qtest_quit(qts);
+}
+
+static void test_timed(void)
+{
+    QTestState *qts = qtest_init(TIMED_ARGS);
+    uint32_t addr = DATA_FLASH_BASE + SECTOR_SIZE;
+
+    /* MCRS[DONE] stays clear for the duration of the operation */
+    fmu_stage_program(qts, addr, 0);
+    fmu_writel(qts, FMU_MCR, MCR_PGM | MCR_EHV);
+    g_assert_cmphex(fmu_readl(qts, FMU_MCRS), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, addr), ==, ERASED);
+    qtest_clock_step(qts, PROGRAM_NS);
+    g_assert_cmphex(fmu_readl(qts, FMU_MCRS), ==, MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, addr), ==, 0);
+    fmu_writel(qts, FMU_MCR, 0);
+
+    /* The flash is modified only when the operation completes */
+    fmu_writel(qts, FMU_MCR, MCR_ERS);
+    fmu_writel(qts, FMU_PEADR, addr);
+    fmu_writel(qts, FMU_MCR, MCR_ERS | MCR_EHV);
+    g_assert_cmphex(fmu_readl(qts, FMU_MCRS), ==, 0);
+    qtest_clock_step(qts, SECTOR_ERASE_NS - 1);
+    g_assert_cmphex(fmu_readl(qts, FMU_MCRS), ==, 0);
+    g_assert_cmphex(qtest_readl(qts, addr), ==, 0);
+
+    /* PEADR and DATA cannot change while the operation runs */
+    fmu_writel(qts, FMU_PEADR, DATA_FLASH_BASE);
+    fmu_writel(qts, FMU_DATA(0), 0x5a5a5a5a);
+    g_assert_cmphex(fmu_readl(qts, FMU_PEADR), ==, addr);
+    g_assert_cmphex(fmu_readl(qts, FMU_DATA(0)), ==, 0);
+
+    /* Clearing EHV aborts it, leaving the flash untouched */
+    fmu_writel(qts, FMU_MCR, MCR_ERS);
+    g_assert_cmphex(fmu_readl(qts, FMU_MCRS), ==, MCRS_DONE);
+    qtest_clock_step(qts, SECTOR_ERASE_NS);
+    g_assert_cmphex(fmu_readl(qts, FMU_MCRS), ==, MCRS_DONE);
+    g_assert_cmphex(qtest_readl(qts, addr), ==, 0);
+
+    /* Run to completion, the erase takes effect */
+    fmu_writel(qts, FMU_MCR, MCR_ERS | MCR_EHV);
+    qtest_clock_step(qts, SECTOR_ERASE_NS);
+    g_assert_cmphex(fmu_readl(qts, FMU_MCRS), ==, MCRS_DONE | MCRS_PEG);
+    g_assert_cmphex(qtest_readl(qts, addr), ==, ERASED);
+    fmu_writel(qts, FMU_MCR, 0);
+
+    qtest_quit(qts);
+}
+
+/* Create an erased data flash image */
+static char *create_image(void)
+{
+    g_autofree uint8_t *buf = g_malloc(DATA_FLASH_SIZE);
+    char *path = NULL;
+    int fd = g_file_open_tmp("qtest-fmu-XXXXXX", &path, NULL);
+
+    g_assert_cmpint(fd, >=, 0);
+    memset(buf, 0xff, DATA_FLASH_SIZE);
+    g_assert_cmpint(write(fd, buf, DATA_FLASH_SIZE), ==, DATA_FLASH_SIZE);
+    close(fd);
+    return path;
+}
+
+static void test_persistence(void)
+{
+    g_autofree char *image = create_image();
+    uint32_t offset = 3 * SECTOR_SIZE + 0x24;
+    QTestState *qts;
+    uint32_t word;
+    int fd;
+
+    qts = qtest_initf(MACHINE_ARGS " -drive if=pflash,format=raw,file=%s",
+                      image);
+    g_assert_cmphex(fmu_program(qts, DATA_FLASH_BASE + offset, 0x0badcafe),
+                    ==, MCRS_DONE | MCRS_PEG);
+    qtest_quit(qts);
+
+    /* Every operation is written through to the image */
+    fd = open(image, O_RDONLY);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(pread(fd, &word, 4, offset), ==, 4);
+    g_assert_cmphex(le32_to_cpu(word), ==, 0x0badcafe);
+    close(fd);
+
+    /* ... and read back by the next run */
+    qts = qtest_initf(MACHINE_ARGS " -drive if=pflash,format=raw,file=%s",
+                      image);
+    g_assert_cmphex(qtest_readl(qts, DATA_FLASH_BASE + offset), ==,
+                    0x0badcafe);
+    g_assert_cmphex(fmu_erase(qts, DATA_FLASH_BASE + offset, false), ==,
+                    MCRS_DONE | MCRS_PEG);
+    qtest_quit(qts);
+
+    fd = open(image, O_RDONLY);
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(pread(fd, &word, 4, offset), ==, 4);
+    g_assert_cmphex(word, ==, ERASED);
+    close(fd);
+
+    unlink(image);
+}
+
+/*
+ * A ROM memory backend cannot be loaded with -kernel. The image, created by
+ * test_rom(), also stands in for the kernel: the machine refuses it before
+ * loading anything.
+ */
+static void test_rom_subprocess(void)
+{
+    const char *image = g_getenv("QTEST_FMU_IMAGE");
+    QTestState *qts;
+
+    qts = qtest_initf("-machine nxps32k3x8evb,data-flash=df "
+                      "-object memory-backend-file,id=df,mem-path=%s,"
+                      "size=128K,share=off,readonly=on,rom=on "
+                      "-kernel %s", image, image);
+    qtest_quit(qts);
+}
+
+static void test_rom(void)
+{
+    g_autofree char *image = create_image();
+    QTestState *qts;
+
+    g_setenv("QTEST_FMU_IMAGE", image, true);
+    g_test_trap_subprocess("/nxps32k358/fmu/rom/subprocess", 0, 0);
+    g_test_trap_assert_failed();
+    g_test_trap_assert_stderr("*-kernel cannot be loaded on top of memory "
+                              "backend 'df', which is ROM*");
+
+    /* Without -kernel the machine runs, and the FMU cannot modify it */
+    qts = qtest_initf("-machine nxps32k3x8evb,data-flash=df "
+                      "-object memory-backend-file,id=df,mem-path=%s,"
+                      "size=128K,share=off,readonly=on,rom=on", image);
+    g_assert_cmphex(fmu_program(qts, DATA_FLASH_BASE, 0), ==, MCRS_DONE);
+    g_assert_cmphex(fmu_erase(qts, DATA_FLASH_BASE, false), ==, MCRS_DONE);
+    g_assert_cmphex(qtest_readl(qts, DATA_FLASH_BASE), ==, ERASED);
+    qtest_quit(qts);
+
+    unlink(image);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/nxps32k358/fmu/program", test_program);
+    qtest_add_func("/nxps32k358/fmu/erase", test_erase);
+    qtest_add_func("/nxps32k358/fmu/timed", test_timed);
+    qtest_add_func("/nxps32k358/fmu/persistence", test_persistence);
+    g_test_add_func("/nxps32k358/fmu/rom/subprocess", test_rom_subprocess);
+    qtest_add_func("/nxps32k358/fmu/rom", test_rom);
+
+    return g_test_run();
+}
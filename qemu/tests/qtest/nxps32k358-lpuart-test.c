@@ -0,0 +1,124 @@
+/*
+ * QTest testcase for the NXP S32K358 LPUART ports linked to each other (on the
+ * NXPS32K3X8EVB board).
+ *
+ * Copyright (c) 2024-2025 CAOS group 27: C. F. Vescovo, C. Sanna, F. Stella
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The board sets the "peer" link on the first port of each pair only. The
+ * tests check both orders: with "lpuart-links=3-1" LPUART1 is realized before
+ * it learns about the link, and must still ignore its character backend.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+/* Offsets in the S32K358 memory map: */
+#define LPUART_BASE(n)  (0x40328000 + 0x4000 * (n))
+
+/* Registers: */
+#define LPUART_CONTROL  0x18
+#define CONTROL_RE      (1u << 18)
+#define CONTROL_TE      (1u << 19)
+#define LPUART_DATA     0x1c
+#define DATA_RXEMPT     (1u << 12)
+
+/* Polling bound while waiting for a character */
+#define MAX_POLLS       1000
+
+/* Start the board with a socket as the character backend of LPUART1 */
+static QTestState *lpuart_init(const char *links, int *sock_fd)
+{
+    g_autofree char *sock_dir = g_dir_make_tmp("qtest-lpuart-XXXXXX", NULL);
+    g_autofree char *sock_path = g_strdup_printf("%s/sock", sock_dir);
+    int listen_fd = qtest_socket_server(sock_path);
+    QTestState *qts;
+
+    qts = qtest_initf("-machine nxps32k3x8evb,lpuart-links=%s "
+                      "-chardev socket,id=s1,path=%s "
+                      "-serial null -serial chardev:s1", links, sock_path);
+    *sock_fd = accept(listen_fd, NULL, NULL);
+    g_assert_cmpint(*sock_fd, >=, 0);
+
+    close(listen_fd);
+    unlink(sock_path);
+    rmdir(sock_dir);
+
+    for (int n = 1; n <= 3; n += 2) {
+        qtest_writel(qts, LPUART_BASE(n) + LPUART_CONTROL,
+                     CONTROL_RE | CONTROL_TE);
+    }
+    return qts;
+}
+
+/* Read a character from an LPUART, DATA_RXEMPT if none arrives */
+static uint32_t lpuart_getc(QTestState *qts, int n)
+{
+    uint32_t data = DATA_RXEMPT;
+
+    for (int i = 0; i < MAX_POLLS && (data & DATA_RXEMPT); i++) {
+        data = qtest_readl(qts, LPUART_BASE(n) + LPUART_DATA);
+        if (data & DATA_RXEMPT) {
+            g_usleep(100);
+        }
+    }
+    return data;
+}
+
+static void check_link(const char *links)
+{
+    int sock_fd;
+    QTestState *qts = lpuart_init(links, &sock_fd);
+
+    /* Both directions of the link work, whichever port carries it */
+    qtest_writel(qts, LPUART_BASE(3) + LPUART_DATA, 'a');
+    g_assert_cmphex(lpuart_getc(qts, 1), ==, 'a');
+    qtest_writel(qts, LPUART_BASE(1) + LPUART_DATA, 'b');
+    g_assert_cmphex(lpuart_getc(qts, 3), ==, 'b');
+
+    /* LPUART1 ignores its character backend */
+    g_assert_cmpint(send(sock_fd, "x", 1, 0), ==, 1);
+    g_assert_cmphex(lpuart_getc(qts, 1), ==, DATA_RXEMPT);
+
+    close(sock_fd);
+    qtest_quit(qts);
+}
+
+static void test_link_forward(void)
+{
+    check_link("1-3");
+}
+
+static void test_link_backward(void)
+{
+    check_link("3-1");
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/nxps32k358/lpuart/link/forward", test_link_forward);
+    qtest_add_func("/nxps32k358/lpuart/link/backward", test_link_backward);
+
+    return g_test_run();
+}
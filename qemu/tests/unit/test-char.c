@@ -3,6 +3,7 @@
 
 #include "qapi/error.h"
 #include "qemu/config-file.h"
+#include "qemu/memfd.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/sockets.h"
@@ -550,6 +551,161 @@ static void char_pipe_test(void)
 }
 #endif
 
+#ifdef CONFIG_LINUX
+/* Layout of the shared header, as seen by a client of the shmring chardev */
+typedef struct ShmringTestQueue {
+    uint32_t prod QEMU_ALIGNED(64);
+    uint32_t prod_wait;
+    uint32_t cons QEMU_ALIGNED(64);
+    uint32_t cons_wait;
+} ShmringTestQueue;
+
+typedef struct ShmringTestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t watermark;
+    uint64_t offset[2];
+    ShmringTestQueue q[2];
+} ShmringTestHeader;
+
+enum {
+    SHMRING_TEST_OUT,
+    SHMRING_TEST_IN,
+};
+
+static bool eventfd_signalled(int fd)
+{
+    uint64_t val;
+
+    return read(fd, &val, sizeof(val)) == sizeof(val);
+}
+
+/* Produce into the IN ring and wake QEMU, as a client must */
+static void shmring_client_write(ShmringTestHeader *hdr, int wfd,
+                                 const char *buf, uint32_t len)
+{
+    ShmringTestQueue *q = &hdr->q[SHMRING_TEST_IN];
+    uint8_t *data = (uint8_t *)hdr + hdr->offset[SHMRING_TEST_IN];
+    uint32_t prod = q->prod;
+    uint64_t one = 1;
+
+    for (uint32_t i = 0; i < len; i++) {
+        data[(prod + i) & (hdr->size - 1)] = buf[i];
+    }
+    qatomic_store_release(&q->prod, prod + len);
+    smp_mb();
+    g_assert_cmpint(qatomic_read(&q->cons_wait), ==, 1);
+    qatomic_set(&q->cons_wait, 0);
+    g_assert_cmpint(write(wfd, &one, sizeof(one)), ==, sizeof(one));
+}
+
+static void char_shmring_test(void)
+{
+    g_autofree char *tmp_path = g_dir_make_tmp("qemu-test-char.XXXXXX",
+                                               NULL);
+    g_autofree char *sock = g_build_filename(tmp_path, "sock", NULL);
+    SocketAddress addr = {
+        .type = SOCKET_ADDRESS_TYPE_UNIX,
+        .u.q_unix.path = sock,
+    };
+    QIOChannelSocket *ioc;
+    QemuOpts *opts;
+    Chardev *chr;
+    CharBackend be;
+    FeHandler fe = { 0, };
+    uint32_t magic;
+    struct iovec iov = { .iov_base = &magic, .iov_len = sizeof(magic) };
+    g_autofree int *fds = NULL;
+    size_t nfds = 0;
+    ssize_t ret;
+    ShmringTestHeader *hdr;
+    ShmringTestQueue *q;
+    uint8_t *out;
+    size_t map_size = 4096 + 2 * 16;
+
+    if (!qemu_memfd_check(MFD_ALLOW_SEALING)) {
+        g_test_skip("memfd with sealing not supported");
+        return;
+    }
+
+    opts = qemu_opts_create(qemu_find_opts("chardev"), "shmring-label",
+                            1, &error_abort);
+    qemu_opt_set(opts, "backend", "shmring", &error_abort);
+    qemu_opt_set(opts, "path", sock, &error_abort);
+    qemu_opt_set(opts, "size", "16", &error_abort);
+    qemu_opt_set(opts, "watermark", "4", &error_abort);
+    chr = qemu_chr_new_from_opts(opts, NULL, &error_abort);
+    g_assert_nonnull(chr);
+    qemu_opts_del(opts);
+
+    qemu_chr_fe_init(&be, chr, &error_abort);
+    qemu_chr_fe_set_handlers(&be, fe_can_read, fe_read, NULL, NULL, &fe,
+                             NULL, true);
+
+    /* Connect and get the memfd and the eventfds */
+    ioc = qio_channel_socket_new();
+    qio_channel_socket_connect_sync(ioc, &addr, &error_abort);
+    qio_channel_set_blocking(QIO_CHANNEL(ioc), false, &error_abort);
+    while ((ret = qio_channel_readv_full(QIO_CHANNEL(ioc), &iov, 1, &fds,
+                                         &nfds, 0, &error_abort)) ==
+           QIO_CHANNEL_ERR_BLOCK) {
+        main_loop_wait(false);
+    }
+    g_assert_cmpint(ret, ==, sizeof(magic));
+    g_assert_cmphex(le32_to_cpu(magic), ==, 0x474e5253);
+    g_assert_cmpint(nfds, ==, 3);
+
+    hdr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    g_assert(hdr != MAP_FAILED);
+    g_assert_cmpint(hdr->size, ==, 16);
+    g_assert_cmpint(hdr->watermark, ==, 4);
+
+    /* OUT ring: a sleeping client is woken at the watermark only */
+    q = &hdr->q[SHMRING_TEST_OUT];
+    out = (uint8_t *)hdr + hdr->offset[SHMRING_TEST_OUT];
+    qatomic_set(&q->cons_wait, 1);
+    g_assert_cmpint(qemu_chr_fe_write(&be, (void *)"ab", 2), ==, 2);
+    g_assert_false(eventfd_signalled(fds[1]));
+    g_assert_cmpint(qemu_chr_fe_write(&be, (void *)"cd", 2), ==, 2);
+    g_assert_true(eventfd_signalled(fds[1]));
+    g_assert_cmpint(qatomic_read(&q->cons_wait), ==, 0);
+    g_assert_cmpint(qatomic_load_acquire(&q->prod), ==, 4);
+    g_assert(memcmp(out, "abcd", 4) == 0);
+    qatomic_store_release(&q->cons, 4);
+
+    /* A full ring accepts a partial write, wrapping around */
+    g_assert_cmpint(qemu_chr_fe_write(&be, (void *)"0123456789abcdefXY", 18),
+                    ==, 16);
+    g_assert(memcmp(out + 4, "0123456789ab", 12) == 0);
+    g_assert(memcmp(out, "cdef", 4) == 0);
+    qatomic_store_release(&q->cons, 20);
+
+    /* IN ring: input shorter than the watermark reaches the frontend */
+    shmring_client_write(hdr, fds[2], "hi", 2);
+    main_loop();
+    g_assert_cmpint(fe.read_count, ==, 2);
+    g_assert(memcmp(fe.read_buf, "hi", 2) == 0);
+
+    /* ... and so does input wrapping around the end of the ring */
+    shmring_client_write(hdr, fds[2], "0123456789abcde", 15);
+    main_loop();
+    g_assert_cmpint(fe.read_count, ==, 17);
+    g_assert(memcmp(fe.read_buf + 2, "0123456789abcde", 15) == 0);
+    g_assert_cmpint(qatomic_load_acquire(&hdr->q[SHMRING_TEST_IN].cons), ==,
+                    17);
+    g_assert_cmpint(qatomic_read(&hdr->q[SHMRING_TEST_IN].cons_wait), ==, 1);
+
+    munmap(hdr, map_size);
+    for (size_t i = 0; i < nfds; i++) {
+        close(fds[i]);
+    }
+    object_unref(OBJECT(ioc));
+    qemu_chr_fe_deinit(&be, true);
+    g_assert(g_rmdir(tmp_path) == 0);
+}
+#endif
+
 typedef struct SocketIdleData {
     GMainLoop *loop;
     Chardev *chr;
@@ -1515,6 +1671,9 @@ int main(int argc, char **argv)
     g_test_add_func("/char/stdio", char_stdio_test);
 #ifndef _WIN32
     g_test_add_func("/char/pipe", char_pipe_test);
+#endif
+#ifdef CONFIG_LINUX
+    g_test_add_func("/char/shmring", char_shmring_test);
 #endif
     g_test_add_func("/char/file", char_file_test);
 #ifndef _WIN32